@@ -221,6 +221,16 @@ void display_data(uint8_t *data, size_t length, uint8_t line, uint8_t offset, bo
     i2c_cmd_link_delete(cmd);
 }
 
+void display_glyphs(uint8_t *chars, size_t length, uint8_t line, uint8_t offset, bool invert)
+{
+    display_glyphs_data(chars, length, line, offset, invert);
+}
+
+void display_flush(void)
+{
+    // written directly
+}
+
 void display_flipped(bool flipped)
 {
 
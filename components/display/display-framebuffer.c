@@ -0,0 +1,543 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <string.h>
+#include <stdlib.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+
+#include "display.h"
+#include "display-gfx.h"
+#include "display-framebuffer.h"
+
+// pixels are kept in panel byte order (most significant byte first) to send them without conversion
+#define DISPLAY_FRAMEBUFFER_PIXEL(color) ((uint16_t)(((color) >> 8) | ((color) << 8)))
+#define DISPLAY_FRAMEBUFFER_GLYPH_SIZE (8) // width and height of a glyph of the font
+#define DISPLAY_FRAMEBUFFER_CELL_LINES (8)    // text lines of the interface area
+#define DISPLAY_FRAMEBUFFER_CELL_COLUMNS (16) // glyph columns of the interface area
+
+/**
+ * @brief rectangle on the panel, last row and column inclusive
+ */
+typedef struct
+{
+    uint16_t x1;
+    uint16_t y1;
+    uint16_t x2;
+    uint16_t y2;
+} display_framebuffer_rect_t;
+
+/**
+ * @brief glyph of the font rendered in one color
+ */
+typedef struct
+{
+    uint32_t used;      // last use for LRU, 0 if empty
+    uint16_t color;     // foreground color
+    uint8_t character;  // char of the font
+    bool invert;        // if glyph is inverted
+    uint16_t pixels[DISPLAY_FRAMEBUFFER_GLYPH_SIZE * DISPLAY_FRAMEBUFFER_GLYPH_SIZE]; // rows in panel byte order
+} display_framebuffer_glyph_t;
+
+/**
+ * @brief state of a text cell of the interface area
+ */
+typedef enum
+{
+    DISPLAY_FRAMEBUFFER_CELL_UNKNOWN = 0,
+    DISPLAY_FRAMEBUFFER_CELL_GLYPH,
+    DISPLAY_FRAMEBUFFER_CELL_GLYPH_INVERTED,
+} display_framebuffer_cell_state_t;
+
+/**
+ * @brief glyph shown in a text cell, to skip drawing it again
+ */
+typedef struct
+{
+    uint16_t color;
+    uint8_t character;
+    uint8_t state;
+} display_framebuffer_cell_t;
+
+static uint16_t *framebuffer = NULL;
+static uint8_t *transfer_buffers[2] = {NULL, NULL};
+static size_t transfer_index = 0;
+static uint16_t framebuffer_width = 0;
+static uint16_t framebuffer_height = 0;
+static uint16_t framebuffer_offset_x = 0;
+static uint16_t framebuffer_offset_y = 0;
+
+static display_framebuffer_rect_t dirty[DISPLAY_FRAMEBUFFER_DIRTY_MAX];
+static size_t dirty_count = 0;
+
+static SemaphoreHandle_t framebuffer_mutex = NULL;
+
+static display_framebuffer_cell_t cells[DISPLAY_FRAMEBUFFER_CELL_LINES][DISPLAY_FRAMEBUFFER_CELL_COLUMNS];
+
+static display_framebuffer_glyph_t glyph_cache[DISPLAY_FRAMEBUFFER_GLYPH_CACHE_SIZE];
+static uint32_t glyph_clock = 0;
+
+static display_framebuffer_stats_t framebuffer_stats;
+static TickType_t stats_start = 0;
+static uint32_t stats_bytes = 0;
+static uint32_t stats_frames = 0;
+
+void display_framebuffer_lock(void)
+{
+    xSemaphoreTake(framebuffer_mutex, portMAX_DELAY);
+}
+
+void display_framebuffer_unlock(void)
+{
+    xSemaphoreGive(framebuffer_mutex);
+}
+
+uint32_t display_framebuffer_rect_area(display_framebuffer_rect_t *rect)
+{
+    return (uint32_t)(rect->x2 - rect->x1 + 1) * (rect->y2 - rect->y1 + 1);
+}
+
+display_framebuffer_rect_t display_framebuffer_rect_union(display_framebuffer_rect_t *a, display_framebuffer_rect_t *b)
+{
+    display_framebuffer_rect_t rect = {
+        .x1 = a->x1 < b->x1 ? a->x1 : b->x1,
+        .y1 = a->y1 < b->y1 ? a->y1 : b->y1,
+        .x2 = a->x2 > b->x2 ? a->x2 : b->x2,
+        .y2 = a->y2 > b->y2 ? a->y2 : b->y2,
+    };
+    return rect;
+}
+
+/**
+ * @brief mark a rectangle dirty, merge it with dirty rectangles as long as this resends only few clean pixels
+ *
+ * Must be called with framebuffer locked and the rectangle clipped to the panel.
+ */
+void display_framebuffer_mark(display_framebuffer_rect_t rect)
+{
+    while (true)
+    {
+        size_t best = dirty_count;
+        int64_t best_cost = INT64_MAX;
+        for (size_t i = 0; i < dirty_count; i++)
+        {
+            display_framebuffer_rect_t merged = display_framebuffer_rect_union(&dirty[i], &rect);
+            int64_t cost = (int64_t)display_framebuffer_rect_area(&merged) - display_framebuffer_rect_area(&dirty[i]) - display_framebuffer_rect_area(&rect);
+            if (cost < best_cost)
+            {
+                best = i;
+                best_cost = cost;
+            }
+        }
+
+        if (best == dirty_count || (best_cost > DISPLAY_FRAMEBUFFER_MERGE_SLACK && dirty_count < DISPLAY_FRAMEBUFFER_DIRTY_MAX))
+        {
+            dirty[dirty_count++] = rect;
+            return;
+        }
+
+        // merge and retry, the grown rectangle might now touch others
+        rect = display_framebuffer_rect_union(&dirty[best], &rect);
+        dirty[best] = dirty[--dirty_count];
+    }
+}
+
+/**
+ * @brief forget the glyphs of all text cells overlapping a rectangle
+ *
+ * Must be called with framebuffer locked.
+ */
+void display_framebuffer_cells_invalidate(display_framebuffer_rect_t rect)
+{
+    if (rect.x2 < framebuffer_offset_x || rect.y2 < framebuffer_offset_y)
+    {
+        return;
+    }
+    uint16_t first_column = rect.x1 < framebuffer_offset_x ? 0 : (rect.x1 - framebuffer_offset_x) / DISPLAY_FRAMEBUFFER_GLYPH_SIZE;
+    uint16_t last_column = (rect.x2 - framebuffer_offset_x) / DISPLAY_FRAMEBUFFER_GLYPH_SIZE;
+    uint16_t first_line = rect.y1 < framebuffer_offset_y ? 0 : (rect.y1 - framebuffer_offset_y) / DISPLAY_FRAMEBUFFER_GLYPH_SIZE;
+    uint16_t last_line = (rect.y2 - framebuffer_offset_y) / DISPLAY_FRAMEBUFFER_GLYPH_SIZE;
+    for (uint16_t line = first_line; line <= last_line && line < DISPLAY_FRAMEBUFFER_CELL_LINES; line++)
+    {
+        for (uint16_t column = first_column; column <= last_column && column < DISPLAY_FRAMEBUFFER_CELL_COLUMNS; column++)
+        {
+            cells[line][column].state = DISPLAY_FRAMEBUFFER_CELL_UNKNOWN;
+        }
+    }
+}
+
+/**
+ * @brief fill a rectangle of the framebuffer with a color and mark it dirty
+ *
+ * Must be called with framebuffer locked.
+ */
+void display_framebuffer_fill(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint16_t color)
+{
+    if (x >= framebuffer_width || y >= framebuffer_height || width == 0 || height == 0)
+    {
+        return;
+    }
+    if (width > framebuffer_width - x)
+    {
+        width = framebuffer_width - x;
+    }
+    if (height > framebuffer_height - y)
+    {
+        height = framebuffer_height - y;
+    }
+
+    uint16_t pixel = DISPLAY_FRAMEBUFFER_PIXEL(color);
+    for (uint16_t row = y; row < y + height; row++)
+    {
+        uint16_t *line = &framebuffer[row * framebuffer_width + x];
+        for (uint16_t i = 0; i < width; i++)
+        {
+            line[i] = pixel;
+        }
+    }
+
+    display_framebuffer_rect_t rect = {x, y, x + width - 1, y + height - 1};
+    display_framebuffer_cells_invalidate(rect);
+    display_framebuffer_mark(rect);
+}
+
+void display_framebuffer_start(uint16_t width, uint16_t height, uint16_t offset_x, uint16_t offset_y)
+{
+    if (framebuffer_mutex == NULL)
+    {
+        framebuffer_mutex = xSemaphoreCreateMutex();
+    }
+
+    display_framebuffer_lock();
+    display_panel_wait(0);
+    free(framebuffer);
+    free(transfer_buffers[0]);
+    free(transfer_buffers[1]);
+    framebuffer = calloc((size_t)width * height, sizeof(uint16_t));
+    transfer_buffers[0] = heap_caps_malloc(DISPLAY_FRAMEBUFFER_TRANSFER_SIZE, MALLOC_CAP_DMA);
+    transfer_buffers[1] = heap_caps_malloc(DISPLAY_FRAMEBUFFER_TRANSFER_SIZE, MALLOC_CAP_DMA);
+    if (framebuffer == NULL || transfer_buffers[0] == NULL || transfer_buffers[1] == NULL)
+    {
+        ESP_LOGE(DISPLAY_LOG, "Warning %s malloc low memory", __func__);
+        free(framebuffer);
+        free(transfer_buffers[0]);
+        free(transfer_buffers[1]);
+        framebuffer = NULL;
+        transfer_buffers[0] = NULL;
+        transfer_buffers[1] = NULL;
+        width = 0;
+        height = 0;
+    }
+    framebuffer_width = width;
+    framebuffer_height = height;
+    framebuffer_offset_x = offset_x;
+    framebuffer_offset_y = offset_y;
+    dirty_count = 0;
+    memset(cells, 0, sizeof(cells));
+    display_framebuffer_unlock();
+}
+
+void display_framebuffer_invalidate(void)
+{
+    display_framebuffer_lock();
+    if (framebuffer != NULL)
+    {
+        display_framebuffer_rect_t rect = {0, 0, framebuffer_width - 1, framebuffer_height - 1};
+        display_framebuffer_mark(rect);
+    }
+    display_framebuffer_unlock();
+}
+
+void display_clear_line(uint8_t line, bool invert)
+{
+    display_framebuffer_lock();
+    display_framebuffer_fill(0, framebuffer_offset_y + line * 8, framebuffer_width, 8, invert ? display_get_color() : BLACK);
+    display_framebuffer_unlock();
+}
+
+void display_clear(void)
+{
+    display_framebuffer_lock();
+    display_framebuffer_fill(0, 0, framebuffer_width, framebuffer_height, BLACK);
+    display_framebuffer_unlock();
+}
+
+void display_data(uint8_t *data, size_t length, uint8_t line, uint8_t offset, bool invert)
+{
+    display_framebuffer_lock();
+
+    uint16_t x = framebuffer_offset_x + offset;
+    uint16_t y = framebuffer_offset_y + line * 8;
+    if (framebuffer == NULL || length == 0 || x >= framebuffer_width || y >= framebuffer_height)
+    {
+        display_framebuffer_unlock();
+        return;
+    }
+    if (length > framebuffer_width - x)
+    {
+        length = framebuffer_width - x;
+    }
+    uint16_t rows = framebuffer_height - y < 8 ? framebuffer_height - y : 8;
+
+    uint16_t foreground = DISPLAY_FRAMEBUFFER_PIXEL(display_get_color());
+    uint16_t background = DISPLAY_FRAMEBUFFER_PIXEL(BLACK);
+    if (invert)
+    {
+        foreground = background;
+        background = DISPLAY_FRAMEBUFFER_PIXEL(display_get_color());
+    }
+
+    // every byte of data is a column of 8 pixels, least significant bit on top, only changed pixels get dirty
+    display_framebuffer_rect_t rect = {framebuffer_width, framebuffer_height, 0, 0};
+    for (uint16_t j = 0; j < rows; j++)
+    {
+        uint16_t *pixels = &framebuffer[(y + j) * framebuffer_width + x];
+        for (size_t i = 0; i < length; i++)
+        {
+            uint16_t pixel = (data[i] & (1 << j)) ? foreground : background;
+            if (pixels[i] != pixel)
+            {
+                pixels[i] = pixel;
+                rect.x1 = x + i < rect.x1 ? x + i : rect.x1;
+                rect.x2 = x + i > rect.x2 ? x + i : rect.x2;
+                rect.y1 = y + j < rect.y1 ? y + j : rect.y1;
+                rect.y2 = y + j;
+            }
+        }
+    }
+
+    if (rect.x1 <= rect.x2)
+    {
+        display_framebuffer_cells_invalidate(rect);
+        display_framebuffer_mark(rect);
+    }
+
+    display_framebuffer_unlock();
+}
+
+/**
+ * @brief get the transfer buffer to fill next
+ *
+ * The buffer was sent two transfers ago, so only wait for that one while the last transfer may go on.
+ */
+uint8_t *display_framebuffer_transfer_buffer(void)
+{
+    display_panel_wait(1);
+    return transfer_buffers[transfer_index];
+}
+
+/**
+ * @brief queue the current transfer buffer and switch to the other one
+ */
+void display_framebuffer_transfer(size_t length)
+{
+    display_panel_data(transfer_buffers[transfer_index], length);
+    transfer_index ^= 1;
+    framebuffer_stats.transfers++;
+    framebuffer_stats.bytes += length;
+}
+
+void display_framebuffer_stats_update(void)
+{
+    TickType_t now = xTaskGetTickCount();
+    uint32_t elapsed_ms = (now - stats_start) * portTICK_PERIOD_MS;
+    if (elapsed_ms >= DISPLAY_FRAMEBUFFER_STATS_INTERVAL * 1000)
+    {
+        framebuffer_stats.bytes_per_second = (uint64_t)(framebuffer_stats.bytes - stats_bytes) * 1000 / elapsed_ms;
+        framebuffer_stats.frames_per_second = (framebuffer_stats.frames - stats_frames) * 1000.0f / elapsed_ms;
+        ESP_LOGD(DISPLAY_LOG, "%u bytes/s, %.1f frames/s", framebuffer_stats.bytes_per_second, framebuffer_stats.frames_per_second);
+        stats_start = now;
+        stats_bytes = framebuffer_stats.bytes;
+        stats_frames = framebuffer_stats.frames;
+    }
+}
+
+void display_framebuffer_stats(display_framebuffer_stats_t *stats)
+{
+    display_framebuffer_lock();
+    *stats = framebuffer_stats;
+    display_framebuffer_unlock();
+}
+
+/**
+ * @brief get the pixels of a glyph, render it in place of the least recently used one if not cached
+ *
+ * Must be called with framebuffer locked.
+ */
+uint16_t *display_framebuffer_glyph(uint8_t character, uint16_t color, bool invert)
+{
+    display_framebuffer_glyph_t *glyph = &glyph_cache[0];
+    for (size_t i = 0; i < DISPLAY_FRAMEBUFFER_GLYPH_CACHE_SIZE; i++)
+    {
+        display_framebuffer_glyph_t *entry = &glyph_cache[i];
+        if (entry->used > 0 && entry->character == character && entry->color == color && entry->invert == invert)
+        {
+            entry->used = ++glyph_clock;
+            framebuffer_stats.glyph_hits++;
+            return entry->pixels;
+        }
+        if (entry->used < glyph->used)
+        {
+            glyph = entry;
+        }
+    }
+
+    framebuffer_stats.glyph_misses++;
+
+    uint16_t foreground = DISPLAY_FRAMEBUFFER_PIXEL(color);
+    uint16_t background = DISPLAY_FRAMEBUFFER_PIXEL(BLACK);
+    if (invert)
+    {
+        foreground = background;
+        background = DISPLAY_FRAMEBUFFER_PIXEL(color);
+    }
+
+    uint8_t *data = display_gfx_font[character >= 32 ? character - 32 : 0];
+    for (uint8_t j = 0; j < DISPLAY_FRAMEBUFFER_GLYPH_SIZE; j++)
+    {
+        for (uint8_t i = 0; i < DISPLAY_FRAMEBUFFER_GLYPH_SIZE; i++)
+        {
+            glyph->pixels[j * DISPLAY_FRAMEBUFFER_GLYPH_SIZE + i] = (data[i] & (1 << j)) ? foreground : background;
+        }
+    }
+    glyph->character = character;
+    glyph->color = color;
+    glyph->invert = invert;
+    glyph->used = ++glyph_clock;
+
+    return glyph->pixels;
+}
+
+void display_glyphs(uint8_t *chars, size_t length, uint8_t line, uint8_t offset, bool invert)
+{
+    display_framebuffer_lock();
+
+    uint16_t x = framebuffer_offset_x + offset;
+    uint16_t y = framebuffer_offset_y + line * 8;
+    if (framebuffer == NULL || length == 0 || x >= framebuffer_width || y >= framebuffer_height)
+    {
+        display_framebuffer_unlock();
+        return;
+    }
+    uint16_t rows = framebuffer_height - y < DISPLAY_FRAMEBUFFER_GLYPH_SIZE ? framebuffer_height - y : DISPLAY_FRAMEBUFFER_GLYPH_SIZE;
+
+    uint16_t color = display_get_color();
+    uint8_t state = invert ? DISPLAY_FRAMEBUFFER_CELL_GLYPH_INVERTED : DISPLAY_FRAMEBUFFER_CELL_GLYPH;
+    uint16_t glyph_x = x;
+    for (size_t c = 0; c < length && glyph_x < framebuffer_width; c++)
+    {
+        uint16_t columns = framebuffer_width - glyph_x < DISPLAY_FRAMEBUFFER_GLYPH_SIZE ? framebuffer_width - glyph_x : DISPLAY_FRAMEBUFFER_GLYPH_SIZE;
+        display_framebuffer_rect_t rect = {glyph_x, y, glyph_x + columns - 1, y + rows - 1};
+
+        // glyphs aligned to the text cells of the interface area are remembered and skipped if unchanged
+        display_framebuffer_cell_t *cell = NULL;
+        uint16_t column = (glyph_x - framebuffer_offset_x) / DISPLAY_FRAMEBUFFER_GLYPH_SIZE;
+        if ((glyph_x - framebuffer_offset_x) % DISPLAY_FRAMEBUFFER_GLYPH_SIZE == 0 && column < DISPLAY_FRAMEBUFFER_CELL_COLUMNS &&
+            line < DISPLAY_FRAMEBUFFER_CELL_LINES && columns == DISPLAY_FRAMEBUFFER_GLYPH_SIZE && rows == DISPLAY_FRAMEBUFFER_GLYPH_SIZE)
+        {
+            cell = &cells[line][column];
+            if (cell->state == state && cell->character == chars[c] && cell->color == color)
+            {
+                framebuffer_stats.glyph_skips++;
+                glyph_x += columns;
+                continue;
+            }
+        }
+
+        uint16_t *pixels = display_framebuffer_glyph(chars[c], color, invert);
+        for (uint16_t j = 0; j < rows; j++)
+        {
+            memcpy(&framebuffer[(y + j) * framebuffer_width + glyph_x], &pixels[j * DISPLAY_FRAMEBUFFER_GLYPH_SIZE], columns * sizeof(uint16_t));
+        }
+
+        if (cell != NULL)
+        {
+            cell->state = state;
+            cell->character = chars[c];
+            cell->color = color;
+        }
+        else
+        {
+            display_framebuffer_cells_invalidate(rect);
+        }
+        display_framebuffer_mark(rect);
+        glyph_x += columns;
+    }
+
+    display_framebuffer_unlock();
+}
+
+void display_flush(void)
+{
+    display_framebuffer_lock();
+
+    if (dirty_count > 0)
+    {
+        framebuffer_stats.frames++;
+    }
+
+    uint8_t *buffer = NULL;
+    size_t filled = 0;
+    for (size_t i = 0; i < dirty_count; i++)
+    {
+        display_framebuffer_rect_t *rect = &dirty[i];
+        display_panel_window(rect->x1, rect->y1, rect->x2, rect->y2);
+        framebuffer_stats.windows++;
+
+        // collect the rows of the rectangle in the transfer buffers
+        size_t row_length = (rect->x2 - rect->x1 + 1) * sizeof(uint16_t);
+        for (uint16_t y = rect->y1; y <= rect->y2; y++)
+        {
+            uint8_t *row = (uint8_t *)&framebuffer[y * framebuffer_width + rect->x1];
+            size_t length = row_length;
+            while (length > 0)
+            {
+                if (buffer == NULL)
+                {
+                    buffer = display_framebuffer_transfer_buffer();
+                }
+                size_t chunk = DISPLAY_FRAMEBUFFER_TRANSFER_SIZE - filled;
+                if (chunk > length)
+                {
+                    chunk = length;
+                }
+                memcpy(&buffer[filled], row, chunk);
+                filled += chunk;
+                row += chunk;
+                length -= chunk;
+                if (filled == DISPLAY_FRAMEBUFFER_TRANSFER_SIZE)
+                {
+                    display_framebuffer_transfer(filled);
+                    buffer = NULL;
+                    filled = 0;
+                }
+            }
+        }
+        if (filled > 0)
+        {
+            display_framebuffer_transfer(filled);
+            buffer = NULL;
+            filled = 0;
+        }
+    }
+    dirty_count = 0;
+
+    display_framebuffer_stats_update();
+
+    // the last transfers are still running, drawing can go on as they are sent from the transfer buffers
+    display_framebuffer_unlock();
+}
@@ -0,0 +1,112 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * @file
+ *
+ * @brief RGB565 framebuffer in RAM for the TFT displays
+ *
+ * Implements the drawing functions of display.h for color panels. Drawing only writes to the framebuffer and marks the
+ * changed area dirty, display_flush() sends every dirty rectangle with one address window and a few large transfers.
+ * Pixels are copied to two DMA buffers in turn, the next buffer is filled while the other one is on the wire.
+ * Glyphs are kept rendered in RGB565 per color in a small LRU cache and copied to the framebuffer as they are.
+ * The glyph shown in every 8x8 text cell of the interface area is remembered, so redrawing the same text changes
+ * nothing and a new text only sends the glyphs which differ.
+ *
+ */
+#ifndef _display_FRAMEBUFFER_H_
+#define _display_FRAMEBUFFER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define DISPLAY_LOG "DISPLAY" // TAG for Logging
+
+#define DISPLAY_FRAMEBUFFER_DIRTY_MAX (8)       // max. number of dirty rectangles, more are merged
+#define DISPLAY_FRAMEBUFFER_MERGE_SLACK (256)   // max. number of clean pixels resent to merge two dirty rectangles
+#define DISPLAY_FRAMEBUFFER_TRANSFER_SIZE (8192) // size of each of the two DMA transfer buffers, also SPI max_transfer_sz
+#define DISPLAY_FRAMEBUFFER_STATS_INTERVAL (5)   // interval in seconds to update the throughput
+#define DISPLAY_FRAMEBUFFER_GLYPH_CACHE_SIZE (64) // number of rendered glyphs kept, 128 bytes each
+
+/**
+ * @brief statistics of data sent to the panel
+ */
+typedef struct
+{
+    uint32_t frames;           // number of flushes which sent data
+    uint32_t windows;          // number of address windows set
+    uint32_t transfers;        // number of pixel data transfers
+    uint32_t bytes;            // number of pixel data bytes
+    uint32_t bytes_per_second; // pixel data bytes per second in the last interval
+    float frames_per_second;   // frames per second in the last interval
+    uint32_t glyph_hits;       // number of glyphs taken from the glyph cache
+    uint32_t glyph_misses;     // number of glyphs rendered to the glyph cache
+    uint32_t glyph_skips;      // number of glyphs not drawn as the text cell shows them already
+} display_framebuffer_stats_t;
+
+/**
+ * @brief allocate the framebuffer for a panel, called on display_start
+ *
+ * @param[in] width width of the panel in pixels
+ * @param[in] height height of the panel in pixels
+ * @param[in] offset_x x position of the 128x64 interface area on the panel
+ * @param[in] offset_y y position of the 128x64 interface area on the panel
+ */
+void display_framebuffer_start(uint16_t width, uint16_t height, uint16_t offset_x, uint16_t offset_y);
+
+/**
+ * @brief mark the complete framebuffer dirty, e.g. after the panel orientation changed
+ */
+void display_framebuffer_invalidate(void);
+
+/**
+ * @brief get the statistics of data sent to the panel
+ *
+ * @param[out] stats pointer to write the statistics to
+ */
+void display_framebuffer_stats(display_framebuffer_stats_t *stats);
+
+/**
+ * @brief set the address window on the panel and start a memory write
+ *
+ * MUST BE DEFINED DEVICE SPECIFIC
+ *
+ * @param[in] x1 first column in panel pixels, without panel RAM offset
+ * @param[in] y1 first row in panel pixels, without panel RAM offset
+ * @param[in] x2 last column (inclusive)
+ * @param[in] y2 last row (inclusive)
+ */
+void display_panel_window(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2);
+
+/**
+ * @brief queue pixel data for the current address window of the panel
+ *
+ * The transfer may still be running on return, data must not be changed until display_panel_wait() reports it done.
+ *
+ * MUST BE DEFINED DEVICE SPECIFIC
+ *
+ * @param[in] data RGB565 pixels in DMA capable memory, most significant byte first
+ * @param[in] length length of data in bytes, at most DISPLAY_FRAMEBUFFER_TRANSFER_SIZE
+ */
+void display_panel_data(uint8_t *data, size_t length);
+
+/**
+ * @brief wait for queued pixel data transfers to finish
+ *
+ * MUST BE DEFINED DEVICE SPECIFIC
+ *
+ * @param[in] pending number of the latest transfers which may still be running on return
+ */
+void display_panel_wait(size_t pending);
+
+#endif
@@ -22,41 +22,41 @@
 
 #include <stdint.h>
 
-uint8_t display_gfx_clear[8];
+extern uint8_t display_gfx_clear[8];
 
 // Dogica Font https://www.dafont.com/de/dogica.font starting at space (32)
-uint8_t display_gfx_font[224][8];
+extern uint8_t display_gfx_font[224][8];
 
-uint8_t display_gfx_button[3][64];
+extern uint8_t display_gfx_button[3][64];
 
-uint8_t display_gfx_button_sel[3][64];
+extern uint8_t display_gfx_button_sel[3][64];
 
-uint8_t display_gfx_clock[8];
+extern uint8_t display_gfx_clock[8];
 
-uint8_t display_gfx_menu_head[112];
+extern uint8_t display_gfx_menu_head[112];
 
-uint8_t display_gfx_sad[4][24];
+extern uint8_t display_gfx_sad[4][24];
 
-uint8_t display_gfx_smile[4][24];
+extern uint8_t display_gfx_smile[4][24];
 
-uint8_t display_gfx_question[4][24];
+extern uint8_t display_gfx_question[4][24];
 
-uint8_t display_gfx_wifi[8];
+extern uint8_t display_gfx_wifi[8];
 
-uint8_t display_gfx_wifi_low[8];
+extern uint8_t display_gfx_wifi_low[8];
 
-uint8_t display_gfx_wifi_lowest[8];
+extern uint8_t display_gfx_wifi_lowest[8];
 
-uint8_t display_gfx_arrow_down[8];
+extern uint8_t display_gfx_arrow_down[8];
 
-uint8_t display_gfx_arrow_left[8];
+extern uint8_t display_gfx_arrow_left[8];
 
-uint8_t display_gfx_arrow_right[8];
+extern uint8_t display_gfx_arrow_right[8];
 
-uint8_t display_gfx_arrow_up[8];
+extern uint8_t display_gfx_arrow_up[8];
 
-uint8_t display_gfx_cross[8];
+extern uint8_t display_gfx_cross[8];
 
-uint8_t display_gfx_logo[8][64];
+extern uint8_t display_gfx_logo[8][64];
 
 #endif
\ No newline at end of file
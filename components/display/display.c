@@ -63,7 +63,7 @@ void display_utf8_to_ascii(char *input, char *output)
 
 uint8_t *display_text_to_data(char *text, size_t text_length, size_t *length)
 {
-    char target_text[strlen(text)];
+    char target_text[strlen(text) + 1];
     display_utf8_to_ascii(text, target_text);
 
     uint8_t font_width = sizeof(display_gfx_font[0]);
@@ -79,18 +79,42 @@ uint8_t *display_text_to_data(char *text, size_t text_length, size_t *length)
     return data;
 }
 
-void display_chars(char *text, size_t length, uint8_t line, uint8_t offset, bool invert)
+void display_glyphs_data(uint8_t *chars, size_t length, uint8_t line, uint8_t offset, bool invert)
 {
+    uint8_t font_width = sizeof(display_gfx_font[0]);
+    uint8_t data[length * font_width];
+    for (size_t i = 0; i < length; i++)
+    {
+        memcpy(&data[i * font_width], display_gfx_font[chars[i] >= 32 ? chars[i] - 32 : 0], font_width);
+    }
+    display_data(data, length * font_width, line, offset, invert);
+}
+
+/**
+ * @brief convert UTF-8 text to the font and write it at a pixel offset
+ */
+void display_text_glyphs(char *text, size_t length, uint8_t line, uint8_t offset, bool invert)
+{
+    char target_text[strlen(text) + 1];
+    display_utf8_to_ascii(text, target_text);
+
+    size_t target_length = strlen(target_text);
+    if (length > target_length)
+    {
+        length = target_length;
+    }
     if (length > 0)
     {
-        uint8_t font_width = sizeof(display_gfx_font[0]);
-        size_t res_length = 0;
-        uint8_t *textdata = display_text_to_data(text, length, &res_length);
-        display_data(textdata, res_length, line, offset * font_width, invert);
-        free(textdata);
+        display_glyphs((uint8_t *)target_text, length, line, offset, invert);
     }
 }
 
+void display_chars(char *text, size_t length, uint8_t line, uint8_t offset, bool invert)
+{
+    uint8_t font_width = sizeof(display_gfx_font[0]);
+    display_text_glyphs(text, length, line, offset * font_width, invert);
+}
+
 void display_text_line_column(char *text, uint8_t line, uint8_t offset, bool invert)
 {
     display_chars(text, strlen(text), line, offset, invert);
@@ -109,7 +133,9 @@ void display_text_input(char *text, uint8_t position)
         position = 13;
         start = position - 13;
     }
-    uint8_t cur_char = (uint8_t)text[start + position] - 32;
+    uint8_t cur_char = (uint8_t)text[start + position];
+    uint8_t upper_char = cur_char - 1;
+    uint8_t lower_char = cur_char + 1;
 
     // arrow
     display_data(display_gfx_arrow_left, 8, 2, 0, false);
@@ -123,18 +149,15 @@ void display_text_input(char *text, uint8_t position)
     {
         text_length = 14;
     }
-    size_t length = 0;
-    uint8_t *textdata = display_text_to_data(text, text_length, &length);
-    display_data(textdata, length, 2, 8, true);
-    free(textdata);
+    display_text_glyphs(text, text_length, 2, 8, true);
     // arrow
     display_data(display_gfx_arrow_up, 8, 0, (position + 1) * 8, false);
     // upper char
-    display_data(display_gfx_font[cur_char - 1], 8, 1, (position + 1) * 8, false);
+    display_glyphs(&upper_char, 1, 1, (position + 1) * 8, false);
     // sel char
-    display_data(display_gfx_font[cur_char], 8, 2, (position + 1) * 8, false);
+    display_glyphs(&cur_char, 1, 2, (position + 1) * 8, false);
     // lower char
-    display_data(display_gfx_font[cur_char + 1], 8, 3, (position + 1) * 8, false);
+    display_glyphs(&lower_char, 1, 3, (position + 1) * 8, false);
     // arrow
     display_data(display_gfx_arrow_down, 8, 4, (position + 1) * 8, false);
 }
@@ -164,17 +187,13 @@ void display_set_button(char *text, bool selected, bool primary)
     {
         text_length = 6;
     }
-    size_t length = 0;
-    uint8_t *textdata = display_text_to_data(text, text_length, &length);
-
     uint8_t offset = 0;
     if (text_length < 6)
     {
         offset = (6 - text_length) / 2 * 8;
     }
 
-    display_data(textdata, length, 6, start + 8 + offset, selected);
-    free(textdata);
+    display_text_glyphs(text, text_length, 6, start + 8 + offset, selected);
 }
 
 void display_menu_headline(char *text, bool arrows, uint8_t line)
@@ -193,17 +212,13 @@ void display_menu_headline(char *text, bool arrows, uint8_t line)
     {
         text_length = 10;
     }
-    size_t length = 0;
-    uint8_t *textdata = display_text_to_data(text, text_length, &length);
-
     uint8_t offset = 0;
     if (text_length < 10)
     {
         offset = (10 - text_length) / 2 * 8;
     }
 
-    display_data(textdata, length, line, 24 + offset, true);
-    free(textdata);
+    display_text_glyphs(text, text_length, line, 24 + offset, true);
 }
 
 void display_set_color(uint16_t color)
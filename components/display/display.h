@@ -91,6 +91,40 @@ void display_flipped(bool flipped);
  */
 void display_data(uint8_t *data, size_t length, uint8_t line, uint8_t offset, bool invert);
 
+/**
+ * @brief write chars of the font to display line at starting column
+ * 
+ * MUST BE DEFINED DEVICE SPECIFIC, display_glyphs_data() writes them as raw bytes
+ * 
+ * @param[in] chars chars already converted from UTF-8, see display_utf8_to_ascii()
+ * @param[in] length number of chars
+ * @param[in] line the line to write to
+ * @param[in] offset offset in pixels to start
+ * @param[in] invert if true, image is inverted
+ */
+void display_glyphs(uint8_t *chars, size_t length, uint8_t line, uint8_t offset, bool invert);
+
+/**
+ * @brief write chars of the font as raw bytes with display_data()
+ * 
+ * @param[in] chars chars already converted from UTF-8, see display_utf8_to_ascii()
+ * @param[in] length number of chars
+ * @param[in] line the line to write to
+ * @param[in] offset offset in pixels to start
+ * @param[in] invert if true, image is inverted
+ */
+void display_glyphs_data(uint8_t *chars, size_t length, uint8_t line, uint8_t offset, bool invert);
+
+/**
+ * @brief send all changes since the last flush to the display
+ * 
+ * Buffered displays only draw to RAM, this writes the changed areas to the panel.
+ * 
+ * MUST BE DEFINED DEVICE SPECIFIC
+ * 
+ */
+void display_flush(void);
+
 /**
  * 
  */
@@ -34,6 +34,14 @@ void display_data(uint8_t *data, size_t length, uint8_t line, uint8_t offset, bo
 {
 }
 
+void display_glyphs(uint8_t *chars, size_t length, uint8_t line, uint8_t offset, bool invert)
+{
+}
+
+void display_flush(void)
+{
+}
+
 void display_flipped(bool flipped)
 {
 }
\ No newline at end of file
@@ -20,26 +20,103 @@
 #include <driver/spi_master.h>
 #include <driver/gpio.h>
 #include "esp_log.h"
+#include "esp_attr.h"
 
 #include "display.h"
 #include "display-gfx.h"
+#include "display-framebuffer.h"
 
 #include "axp192.h"
 
 #include "st7789.h"
 
 static spi_device_handle_t st7789_handle;
+static spi_transaction_t spi_transactions[SPI_QUEUE_SIZE];
+static size_t spi_transactions_next = 0;
+static size_t spi_transactions_queued = 0;
+static size_t spi_transactions_data = 0;
+
+/**
+ * @brief set DC line right before a transaction starts, user holds the mode
+ */
+void IRAM_ATTR spi_master_pre_transfer_callback(spi_transaction_t *spi_trans)
+{
+	gpio_set_level(M5_ST7789_DC_GPIO, (int)spi_trans->user);
+}
 
-bool spi_master_write(uint8_t *data, size_t len, uint8_t dc)
+/**
+ * @brief wait for the oldest queued transaction
+ */
+void spi_master_collect(void)
+{
+	spi_transaction_t *spi_trans;
+	esp_err_t ret = spi_device_get_trans_result(st7789_handle, &spi_trans, portMAX_DELAY);
+	assert(ret == ESP_OK);
+	spi_transactions_queued--;
+	if (!(spi_trans->flags & SPI_TRANS_USE_TXDATA))
+	{
+		spi_transactions_data--;
+	}
+}
+
+/**
+ * @brief queue a transaction, up to 4 bytes are copied, larger data must stay valid until collected
+ */
+bool spi_master_queue(uint8_t *data, size_t len, uint8_t dc)
 {
-	spi_transaction_t spi_trans;
+	if (spi_transactions_queued == SPI_QUEUE_SIZE)
+	{
+		spi_master_collect();
+	}
+
+	// transactions complete in order, so the next descriptor is free now
+	spi_transaction_t *spi_trans = &spi_transactions[spi_transactions_next];
+	spi_transactions_next = (spi_transactions_next + 1) % SPI_QUEUE_SIZE;
+
+	memset(spi_trans, 0, sizeof(spi_transaction_t));
+	spi_trans->length = len * 8;
+	spi_trans->user = (void *)(int)dc;
+	if (len <= sizeof(spi_trans->tx_data))
+	{
+		spi_trans->flags = SPI_TRANS_USE_TXDATA;
+		memcpy(spi_trans->tx_data, data, len);
+	}
+	else
+	{
+		spi_trans->tx_buffer = data;
+		spi_transactions_data++;
+	}
+
+	esp_err_t ret = spi_device_queue_trans(st7789_handle, spi_trans, portMAX_DELAY);
+	assert(ret == ESP_OK);
+	spi_transactions_queued++;
+
+	return true;
+}
+
+bool spi_master_queue_command(uint8_t cmd)
+{
+	return spi_master_queue(&cmd, 1, SPI_COMMAND_MODE);
+}
+
+bool spi_master_queue_addr(uint16_t addr1, uint16_t addr2)
+{
+	uint8_t data[4];
+	data[0] = (addr1 >> 8) & 0xFF;
+	data[1] = addr1 & 0xFF;
+	data[2] = (addr2 >> 8) & 0xFF;
+	data[3] = addr2 & 0xFF;
 
-	gpio_set_level(M5_ST7789_DC_GPIO, dc);
+	return spi_master_queue(data, 4, SPI_DATA_MODE);
+}
 
-	memset(&spi_trans, 0, sizeof(spi_transaction_t));
-	spi_trans.length = len * 8;
-	spi_trans.tx_buffer = data;
-	spi_device_transmit(st7789_handle, &spi_trans);
+bool spi_master_write(uint8_t *data, size_t len, uint8_t dc)
+{
+	spi_master_queue(data, len, dc);
+	while (spi_transactions_queued > 0)
+	{
+		spi_master_collect();
+	}
 
 	return true;
 }
@@ -70,34 +147,6 @@ bool spi_master_write_addr(uint16_t addr1, uint16_t addr2)
 	return spi_master_write_data(data, 4);
 }
 
-bool spi_master_write_color(uint16_t color, size_t size)
-{
-	uint8_t data[size * 2];
-	int index = 0;
-
-	uint8_t msbColor = (color >> 8) & 0xFF;
-	uint8_t lsbColor = color & 0xFF;
-
-	for (int i = 0; i < size; i++)
-	{
-		data[index++] = msbColor;
-		data[index++] = lsbColor;
-	}
-	return spi_master_write_data(data, size * 2);
-}
-
-bool spi_master_write_colors(uint16_t *colors, size_t size)
-{
-	uint8_t data[size * 2];
-	int index = 0;
-	for (int i = 0; i < size; i++)
-	{
-		data[index++] = (colors[i] >> 8) & 0xFF;
-		data[index++] = colors[i] & 0xFF;
-	}
-	return spi_master_write_data(data, size * 2);
-}
-
 void display_start(void)
 {
 
@@ -132,14 +181,16 @@ void display_start(void)
 			.mosi_io_num = M5_ST7789_MOSI_GPIO,
 			.miso_io_num = -1,
 			.quadwp_io_num = -1,
-			.quadhd_io_num = -1};
+			.quadhd_io_num = -1,
+			.max_transfer_sz = DISPLAY_FRAMEBUFFER_TRANSFER_SIZE};
 
 	ret = spi_bus_initialize(HSPI_HOST, &buscfg, 1);
 	assert(ret == ESP_OK);
 
 	spi_device_interface_config_t devcfg = {
 			.clock_speed_hz = SPI_MASTER_FREQ_20M,
-			.queue_size = 7,
+			.queue_size = SPI_QUEUE_SIZE,
+			.pre_cb = spi_master_pre_transfer_callback,
 			.mode = 2,
 			.flags = SPI_DEVICE_NO_DUMMY,
 	};
@@ -149,6 +200,8 @@ void display_start(void)
 	ret = spi_bus_add_device(HSPI_HOST, &devcfg, &st7789_handle);
 	assert(ret == ESP_OK);
 
+	display_framebuffer_start(M5_ST7789_WIDTH, M5_ST7789_HEIGHT, M5_ST7789_INTERFACE_OFFSETX, M5_ST7789_INTERFACE_OFFSETY);
+
 	spi_master_write_command(0x01); //Software Reset
 	vTaskDelay(150 / portTICK_PERIOD_MS);
 
@@ -200,82 +253,32 @@ void display_flipped(bool flipped)
 	{
 		spi_master_write_data_byte(M5_ST7789_LANDSCAPE);
 	}
+	display_framebuffer_invalidate();
 }
 
-void display_clear_line(uint8_t line, bool invert)
+void display_on(bool on)
 {
-	uint16_t _x1 = 0 + M5_ST7789_OFFSETX;
-	uint16_t _x2 = M5_ST7789_WIDTH + M5_ST7789_OFFSETX - 1;
-	uint16_t _y1 = line * 8 + M5_ST7789_OFFSETY + M5_ST7789_INTERFACE_OFFSETY;
-	uint16_t _y2 = line * 8 + 8 + M5_ST7789_OFFSETY - 1 + M5_ST7789_INTERFACE_OFFSETY;
-
-	spi_master_write_command(0x2A); // set column(x) address
-	spi_master_write_addr(_x1, _x2);
-	spi_master_write_command(0x2B); // set Page(y) address
-	spi_master_write_addr(_y1, _y2);
-	spi_master_write_command(0x2C); //	Memory Write
-	for (int i = _x1; i <= _x2; i++)
-	{
-		uint16_t size = _y2 - _y1 + 1;
-		spi_master_write_color(invert ? display_get_color() : BLACK, size);
-	}
+	axp192_screen_breath(on ? 10 : 0);
 }
 
-void display_clear(void)
+void display_panel_window(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2)
 {
-	uint16_t _x1 = 0 + M5_ST7789_OFFSETX;
-	uint16_t _x2 = M5_ST7789_WIDTH + M5_ST7789_OFFSETX - 1;
-	uint16_t _y1 = 0 + M5_ST7789_OFFSETY;
-	uint16_t _y2 = M5_ST7789_HEIGHT + M5_ST7789_OFFSETY - 1;
-
-	spi_master_write_command(0x2A); // set column(x) address
-	spi_master_write_addr(_x1, _x2);
-	spi_master_write_command(0x2B); // set Page(y) address
-	spi_master_write_addr(_y1, _y2);
-	spi_master_write_command(0x2C); //	Memory Write
-	for (int i = _x1; i <= _x2; i++)
-	{
-		uint16_t size = _y2 - _y1 + 1;
-		spi_master_write_color(BLACK, size);
-	}
+	spi_master_queue_command(0x2A); // set column(x) address
+	spi_master_queue_addr(x1 + M5_ST7789_OFFSETX, x2 + M5_ST7789_OFFSETX);
+	spi_master_queue_command(0x2B); // set Page(y) address
+	spi_master_queue_addr(y1 + M5_ST7789_OFFSETY, y2 + M5_ST7789_OFFSETY);
+	spi_master_queue_command(0x2C); //Memory Write
 }
 
-void display_on(bool on)
+void display_panel_data(uint8_t *data, size_t length)
 {
-	axp192_screen_breath(on ? 10 : 0);
+	spi_master_queue(data, length, SPI_DATA_MODE);
 }
 
-void display_data(uint8_t *data, size_t length, uint8_t line, uint8_t offset, bool invert)
+void display_panel_wait(size_t pending)
 {
-	uint16_t _x1 = offset + M5_ST7789_OFFSETX + M5_ST7789_INTERFACE_OFFSETX;
-	uint16_t _x2 = offset + length + M5_ST7789_OFFSETX - 1 + M5_ST7789_INTERFACE_OFFSETX;
-	uint16_t _y1 = line * 8 + M5_ST7789_OFFSETY + M5_ST7789_INTERFACE_OFFSETY;
-	uint16_t _y2 = line * 8 + 8 + M5_ST7789_OFFSETY - 1 + M5_ST7789_INTERFACE_OFFSETY;
-
-	spi_master_write_command(0x2A); // set column(x) address
-	spi_master_write_addr(_x1, _x2);
-	spi_master_write_command(0x2B); // set Page(y) address
-	spi_master_write_addr(_y1, _y2);
-	spi_master_write_command(0x2C); //Memory Write
-
-	uint8_t msbColor = (display_get_color() >> 8) & 0xFF;
-	uint8_t lsbColor = display_get_color() & 0xFF;
-
-	for (int j = 0; j < 8; j++)
+	while (spi_transactions_data > pending)
 	{
-		uint8_t color[length * 2];
-		int index = 0;
-
-		for (int i = 0; i < length; i++)
-		{
-			bool bit = (data[i] & (1 << j));
-			if (invert)
-			{
-				bit = !bit;
-			}
-			color[index++] = bit ? msbColor : 0x00;
-			color[index++] = bit ? lsbColor : 0x00;
-		}
-		spi_master_write_data(color, length * 2);
+		spi_master_collect();
 	}
 }
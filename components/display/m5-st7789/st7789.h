@@ -23,6 +23,7 @@
 
 #define SPI_COMMAND_MODE 0
 #define SPI_DATA_MODE 1
+#define SPI_QUEUE_SIZE 7
 
 
 
@@ -19,6 +19,7 @@
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 
 #include "ena-crypto.h"
 #include "ena-storage.h"
@@ -37,127 +38,146 @@ static size_t current_page = 0;
 static time_t request_sleep = 0;
 static uint32_t request_sleep_waiting = 30;
 static time_t last_check = 0;
-static bool wait_for_request = false;
-static bool request_pause = false;
+static SemaphoreHandle_t request_semaphore = NULL;
 
-void ena_eke_proxy_pause(void)
+static bool stream_active = false;
+static uint8_t stream_record[ENA_EKE_PROXY_KEY_SIZE];
+static size_t stream_record_len = 0;
+static ena_temporary_exposure_key_t stream_keys[ENA_EKE_PROXY_KEY_BATCH];
+static size_t stream_keys_count = 0;
+static size_t stream_keys_total = 0;
+
+SemaphoreHandle_t ena_eke_proxy_request_semaphore(void)
 {
-    while (wait_for_request || request_pause)
+    if (request_semaphore == NULL)
     {
-        ESP_LOGD(ENA_EKE_PROXY_LOG, "waiting for other requests to finish...");
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
+        request_semaphore = xSemaphoreCreateBinary();
+        assert(request_semaphore);
+        xSemaphoreGive(request_semaphore);
     }
+    return request_semaphore;
+}
 
-    request_pause = true;
+void ena_eke_proxy_pause(void)
+{
+    ESP_LOGD(ENA_EKE_PROXY_LOG, "waiting for other requests to finish...");
+    xSemaphoreTake(ena_eke_proxy_request_semaphore(), portMAX_DELAY);
 }
 
 void ena_eke_proxy_resume(void)
 {
-    request_pause = false;
+    xSemaphoreGive(ena_eke_proxy_request_semaphore());
+}
+
+void ena_eke_proxy_stream_reset(void)
+{
+    if (stream_active)
+    {
+        // incomplete response, page is requested again
+        ena_exposure_worker_end(false);
+        ESP_LOGW(ENA_EKE_PROXY_LOG, "discarded incomplete response after %zu keys", stream_keys_total);
+    }
+    stream_active = false;
+    stream_record_len = 0;
+    stream_keys_count = 0;
+    stream_keys_total = 0;
+}
+
+void ena_eke_proxy_stream_check_keys(void)
+{
+    if (stream_keys_count > 0)
+    {
+        ena_exposure_worker_check(stream_keys, stream_keys_count);
+        stream_keys_total += stream_keys_count;
+        stream_keys_count = 0;
+    }
+}
+
+void ena_eke_proxy_stream_parse_record(void)
+{
+    ena_temporary_exposure_key_t *key = &stream_keys[stream_keys_count];
+    memset(key, 0, sizeof(ena_temporary_exposure_key_t));
+    memcpy(&(key->key_data), &stream_record[0], ENA_KEY_LENGTH);
+    memcpy(&(key->rolling_start_interval_number), &stream_record[ENA_KEY_LENGTH], 4);
+    memcpy(&(key->rolling_period), &stream_record[ENA_KEY_LENGTH + 4], 4);
+    memcpy(&(key->days_since_onset_of_symptoms), &stream_record[ENA_KEY_LENGTH + 8], 4);
+#ifdef DEBUG_ENA_EKE_PROXY
+    ESP_LOGD(ENA_EKE_PROXY_LOG, "key payload: ");
+    ESP_LOG_BUFFER_HEXDUMP(ENA_EKE_PROXY_LOG, stream_record, ENA_EKE_PROXY_KEY_SIZE, ESP_LOG_DEBUG);
+    ESP_LOGD(ENA_EKE_PROXY_LOG, "received key: ");
+    ESP_LOG_BUFFER_HEXDUMP(ENA_EKE_PROXY_LOG, &(key->key_data), ENA_KEY_LENGTH, ESP_LOG_DEBUG);
+    ESP_LOGD(ENA_EKE_PROXY_LOG, "rolling_start_interval_number %u", key->rolling_start_interval_number);
+    ESP_LOGD(ENA_EKE_PROXY_LOG, "rolling_period %u", key->rolling_period);
+    ESP_LOGD(ENA_EKE_PROXY_LOG, "days_since_onset_of_symptoms %u", key->days_since_onset_of_symptoms);
+#endif
+    stream_keys_count++;
+    if (stream_keys_count == ENA_EKE_PROXY_KEY_BATCH)
+    {
+        ena_eke_proxy_stream_check_keys();
+    }
+}
+
+void ena_eke_proxy_stream_data(const uint8_t *data, size_t len)
+{
+    while (len > 0)
+    {
+        // collect record, it may straddle received chunks
+        size_t copy = ENA_EKE_PROXY_KEY_SIZE - stream_record_len;
+        if (copy > len)
+        {
+            copy = len;
+        }
+        memcpy(&stream_record[stream_record_len], data, copy);
+        stream_record_len += copy;
+        data += copy;
+        len -= copy;
+
+        if (stream_record_len == ENA_EKE_PROXY_KEY_SIZE)
+        {
+            ena_eke_proxy_stream_parse_record();
+            stream_record_len = 0;
+        }
+    }
 }
 
 esp_err_t ena_eke_proxy_fetch_event_handler(esp_http_client_event_t *evt)
 {
-    static uint8_t *output_buffer;
-    static int output_len;
     switch (evt->event_id)
     {
     case HTTP_EVENT_ON_DATA:
-        if (!esp_http_client_is_chunked_response(evt->client))
+        // data of chunked responses is passed already decoded
+        if (esp_http_client_get_status_code(evt->client) == 200)
         {
-            if (output_buffer == NULL)
+            if (!stream_active)
             {
-                output_buffer = malloc(esp_http_client_get_content_length(evt->client));
-                output_len = 0;
-                if (output_buffer == NULL)
-                {
-                    ESP_LOGE(ENA_EKE_PROXY_LOG, "Failed to allocate memory for output buffer, memory: %d kB", (xPortGetFreeHeapSize() / 1024));
-                    return ESP_FAIL;
-                }
+                ena_exposure_worker_begin();
+                stream_active = true;
             }
-            memcpy(output_buffer + output_len, evt->data, evt->data_len);
-            output_len += evt->data_len;
+            ena_eke_proxy_stream_data(evt->data, evt->data_len);
         }
-
         break;
     case HTTP_EVENT_ON_FINISH:
-        if (output_buffer != NULL && esp_http_client_get_status_code(evt->client) == 200)
+        if (esp_http_client_get_status_code(evt->client) == 200)
         {
-
-            if (output_len % 28 != 0)
+            if (stream_record_len != 0)
             {
-                ESP_LOGW(ENA_EKE_PROXY_LOG, "Response length does not match key size! %d", output_len);
+                ESP_LOGW(ENA_EKE_PROXY_LOG, "Response length does not match key size! %zu bytes left", stream_record_len);
             }
 
-            size_t temporary_exposure_keys = (output_len / 28);
-
-            if (temporary_exposure_keys > 0)
+            if (stream_active)
             {
-                uint32_t start_time = (uint32_t)time(NULL);
-                ena_temporary_exposure_key_t temporary_exposure_key;
-                int tek_index = 0;
-
-                memcpy(&(temporary_exposure_key.key_data), &output_buffer[tek_index * 28], ENA_KEY_LENGTH);
-                memcpy(&(temporary_exposure_key.rolling_start_interval_number), &output_buffer[tek_index * 28 + ENA_KEY_LENGTH], 4);
-                memcpy(&(temporary_exposure_key.rolling_period), &output_buffer[tek_index * 28 + ENA_KEY_LENGTH + 4], 4);
-                memcpy(&(temporary_exposure_key.days_since_onset_of_symptoms), &output_buffer[tek_index * 28 + ENA_KEY_LENGTH + 8], 4);
-
-                uint32_t timestamp_start = temporary_exposure_key.rolling_start_interval_number * ENA_TIME_WINDOW;
-                int min = ena_expore_check_find_min(timestamp_start);
-
-                tek_index = temporary_exposure_keys - 1;
-                memcpy(&(temporary_exposure_key.key_data), &output_buffer[tek_index * 28], ENA_KEY_LENGTH);
-                memcpy(&(temporary_exposure_key.rolling_start_interval_number), &output_buffer[tek_index * 28 + ENA_KEY_LENGTH], 4);
-                memcpy(&(temporary_exposure_key.rolling_period), &output_buffer[tek_index * 28 + ENA_KEY_LENGTH + 4], 4);
-                memcpy(&(temporary_exposure_key.days_since_onset_of_symptoms), &output_buffer[tek_index * 28 + ENA_KEY_LENGTH + 8], 4);
-
-                uint32_t timestamp_end = (temporary_exposure_key.rolling_start_interval_number + temporary_exposure_key.rolling_period) * ENA_TIME_WINDOW;
-                int max = ena_expore_check_find_max(timestamp_end);
-
-                if (min >= 0 && max >= 0 && min <= max)
-                {
-                    ESP_LOGI(ENA_EKE_PROXY_LOG, "start check with beacons [%d,%d] for [%u,%u]", min, max, timestamp_start, timestamp_end);
-                    ena_beacon_t beacon;
-                    for (int y = min; y <= max; y++)
-                    {
-                        ena_storage_get_beacon(y, &beacon);
-                        for (int i = 0; i < temporary_exposure_keys; i++)
-                        {
-                            memcpy(&(temporary_exposure_key.key_data), &output_buffer[i * 28], ENA_KEY_LENGTH);
-                            memcpy(&(temporary_exposure_key.rolling_start_interval_number), &output_buffer[i * 28 + ENA_KEY_LENGTH], 4);
-                            memcpy(&(temporary_exposure_key.rolling_period), &output_buffer[i * 28 + ENA_KEY_LENGTH + 4], 4);
-                            memcpy(&(temporary_exposure_key.days_since_onset_of_symptoms), &output_buffer[i * 28 + ENA_KEY_LENGTH + 8], 4);
-#ifdef DEBUG_ENA_EKE_PROXY
-                            ESP_LOGD(ENA_EKE_PROXY_LOG, "key payload: ");
-                            ESP_LOG_BUFFER_HEXDUMP(ENA_EKE_PROXY_LOG, &output_buffer[i * 28], 28, ESP_LOG_DEBUG);
-                            ESP_LOGD(ENA_EKE_PROXY_LOG, "received key: ");
-                            ESP_LOG_BUFFER_HEXDUMP(ENA_EKE_PROXY_LOG, &(temporary_exposure_key.key_data), ENA_KEY_LENGTH, ESP_LOG_DEBUG);
-                            ESP_LOG_BUFFER_HEXDUMP(ENA_EKE_PROXY_LOG, &output_buffer[i * 28], ENA_KEY_LENGTH, ESP_LOG_DEBUG);
-                            ESP_LOGD(ENA_EKE_PROXY_LOG, "rolling_start_interval_number %u", temporary_exposure_key.rolling_start_interval_number);
-                            ESP_LOG_BUFFER_HEXDUMP(ENA_EKE_PROXY_LOG, &output_buffer[i * 28 + ENA_KEY_LENGTH], 4, ESP_LOG_DEBUG);
-                            ESP_LOGD(ENA_EKE_PROXY_LOG, "rolling_period %u", temporary_exposure_key.rolling_period);
-                            ESP_LOG_BUFFER_HEXDUMP(ENA_EKE_PROXY_LOG, &output_buffer[i * 28 + ENA_KEY_LENGTH + 4], 4, ESP_LOG_DEBUG);
-                            ESP_LOGD(ENA_EKE_PROXY_LOG, "days_since_onset_of_symptoms %u", temporary_exposure_key.days_since_onset_of_symptoms);
-                            ESP_LOG_BUFFER_HEXDUMP(ENA_EKE_PROXY_LOG, &output_buffer[i * 28 + ENA_KEY_LENGTH + 8], 4, ESP_LOG_DEBUG);
-#endif
-                            ena_exposure_check(beacon, temporary_exposure_key);
-                        }
-                    }
-                    uint32_t end_time = (uint32_t)time(NULL);
-                    ESP_LOGI(ENA_EKE_PROXY_LOG, "check took %u seconds", (end_time - start_time));
-                }
-                else
-                {
-                    ESP_LOGD(ENA_EKE_PROXY_LOG, "no matching beacons for [%u,%u]", timestamp_start, timestamp_end);
-                }
+                ena_eke_proxy_stream_check_keys();
+                ena_exposure_worker_end(true);
+                stream_active = false;
+                ESP_LOGI(ENA_EKE_PROXY_LOG, "received %zu keys", stream_keys_total);
             }
-            else
+
+            if (stream_keys_total == 0)
             {
                 ESP_LOGW(ENA_EKE_PROXY_LOG, "no keys in request, should not happen on 200 status!");
             }
 
             current_page = current_page + 1;
-            free(output_buffer);
         }
         else if (esp_http_client_get_status_code(evt->client) == 204)
         {
@@ -170,19 +190,12 @@ esp_err_t ena_eke_proxy_fetch_event_handler(esp_http_client_event_t *evt)
             {
                 last_check = last_check + HOUR_IN_SECONDS;
             }
-            ena_storage_write_last_exposure_date(last_check);
             current_page = 0;
             request_sleep = 0;
             request_sleep_waiting = 30;
-            ena_exposure_summary(ena_exposure_default_config());
-
-            ena_exposure_summary_t *current_summary = ena_exposure_current_summary();
-            ESP_LOGD(ENA_EKE_PROXY_LOG, "current summary\nlast update: %u\ndays_since_last_exposure: %d\nnum_exposures: %d\nmax_risk_score: %d\nrisk_score_sum: %d",
-                     current_summary->last_update,
-                     current_summary->days_since_last_exposure,
-                     current_summary->num_exposures,
-                     current_summary->max_risk_score,
-                     current_summary->risk_score_sum);
+            // after all queued checks, so the date is never stored before their exposure information
+            ena_exposure_worker_last_check(last_check);
+            ena_exposure_worker_summary(ena_exposure_default_config());
         }
         else
         {
@@ -194,10 +207,12 @@ esp_err_t ena_eke_proxy_fetch_event_handler(esp_http_client_event_t *evt)
             }
         }
 
-        output_buffer = NULL;
-        output_len = 0;
-        wait_for_request = false;
+        ena_eke_proxy_stream_reset();
 
+        break;
+    case HTTP_EVENT_ERROR:
+    case HTTP_EVENT_DISCONNECTED:
+        ena_eke_proxy_stream_reset();
         break;
     default:
         break;
@@ -208,7 +223,6 @@ esp_err_t ena_eke_proxy_fetch_event_handler(esp_http_client_event_t *evt)
 esp_err_t ena_eke_proxy_receive_keys(char *url)
 {
     static int retries = 0;
-    wait_for_request = true;
     esp_http_client_config_t config = {
         .url = url,
         .timeout_ms = 30000,
@@ -233,6 +247,7 @@ esp_err_t ena_eke_proxy_receive_keys(char *url)
         retries = 0;
     }
 
+    ena_eke_proxy_stream_reset();
     free(url);
     esp_http_client_close(client);
     esp_http_client_cleanup(client);
@@ -270,10 +285,11 @@ void ena_eke_proxy_run(void)
     static time_t wifi_reconnect = 0;
     static uint32_t wifi_reconnect_waiting = 15;
     current_time = time(NULL);
-    last_check = (time_t)ena_storage_read_last_exposure_date();
+    // a date queued behind running checks counts, the same keys are not requested again
+    last_check = (time_t)ena_exposure_worker_last_check_date();
     check_diff = difftime(current_time, last_check);
 
-    if (check_diff > HOUR_IN_SECONDS && !wait_for_request && !request_pause && current_time > request_sleep)
+    if (check_diff > HOUR_IN_SECONDS && current_time > request_sleep)
     {
         if (wifi_controller_connection() == NULL && current_time > wifi_reconnect && wifi_reconnect_waiting < 86400)
         {
@@ -281,7 +297,7 @@ void ena_eke_proxy_run(void)
             wifi_reconnect = current_time + wifi_reconnect_waiting;
             wifi_reconnect_waiting = wifi_reconnect_waiting * 4;
         }
-        else if (wifi_controller_connection() != NULL)
+        else if (wifi_controller_connection() != NULL && xSemaphoreTake(ena_eke_proxy_request_semaphore(), 0) == pdTRUE)
         {
             wifi_reconnect = 0;
             wifi_reconnect_waiting = 15;
@@ -329,10 +345,27 @@ void ena_eke_proxy_run(void)
             {
                 ESP_LOGD(ENA_EKE_PROXY_LOG, "error eke-proxy /%s/%u %d, ", date_string, last_check_tm.tm_hour, (xPortGetFreeHeapSize() / 1024));
             }
+
+            xSemaphoreGive(ena_eke_proxy_request_semaphore());
         }
     }
 }
 
+void ena_eke_proxy_task(void *pvParameter)
+{
+    while (1)
+    {
+        ena_eke_proxy_run();
+        vTaskDelay(1000 / portTICK_PERIOD_MS);
+    }
+}
+
+void ena_eke_proxy_start(void)
+{
+    ena_eke_proxy_request_semaphore();
+    xTaskCreate(&ena_eke_proxy_task, "ena_eke_proxy_task", 8192, NULL, 2, NULL);
+}
+
 esp_err_t ena_eke_proxy_fetch_upload_handler(esp_http_client_event_t *evt)
 {
     switch (evt->event_id)
@@ -45,6 +45,8 @@
 #define ENA_EKE_PROXY_KEYFILES_UPLOAD_URL CONFIG_ENA_EKE_PROXY_KEYFILES_UPLOAD_URL
 #define ENA_EKE_PROXY_DEFAULT_LIMIT CONFIG_ENA_EKE_PROXY_KEY_LIMIT
 #define ENA_EKE_PROXY_MAX_PAST_DAYS CONFIG_ENA_EKE_PROXY_MAX_PAST_DAYS // ENA_STORAGE_TEK_MAX
+#define ENA_EKE_PROXY_KEY_SIZE (28)  // size of a key record in response: key data, rolling start interval number, rolling period, days since onset of symptoms
+#define ENA_EKE_PROXY_KEY_BATCH (32) // number of received keys checked at once
 
 /**
  * @brief fetch key export from given url
@@ -77,6 +79,13 @@ esp_err_t ena_eke_proxy_receive_hourly_keys(char *date_string, uint8_t hour, siz
  */
 void ena_eke_proxy_run(void);
 
+/**
+ * @brief start task running ena eke proxy every second
+ * 
+ * Received keys are checked by the matching worker, see ena_exposure_worker_start.
+ */
+void ena_eke_proxy_start(void);
+
 /**
  * @brief Upload own keys to server
  * 
@@ -88,6 +97,7 @@ esp_err_t ena_eke_proxy_upload(char *token, uint32_t days_since_onset_of_symptom
 /**
  * @brief pause requests
  * 
+ * Waits for a running request to finish.
  */
 void ena_eke_proxy_pause(void);
 
@@ -13,56 +13,312 @@
 // limitations under the License.
 #include <string.h>
 #include <time.h>
+#include <stdbool.h>
 
 #include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 
 #include "ena-crypto.h"
 #include "ena-storage.h"
 
 #include "ena-beacons.h"
 
+#define ENA_BEACONS_TEMP_TABLE_SIZE (2 * ENA_STORAGE_TEMP_BEACONS_MAX + 1) // hash table is at most half full
+#define ENA_BEACONS_TEMP_TABLE_EMPTY (0xFFFF)                              // marks unused slot in hash table
+#define ENA_BEACONS_PROMOTE_BATCH (16)                                     // temporary beacons stored permanently at once on refresh
+
 static uint32_t temp_beacons_count = 0;
 static ena_beacon_t temp_beacons[ENA_STORAGE_TEMP_BEACONS_MAX];
+static bool temp_beacons_loaded = false;
+static bool temp_beacons_changed = false; // RAM differs from last checkpoint
 
-int ena_get_temp_beacon_index(uint8_t *rpi, uint8_t *aem)
+// open addressing hash table with linear probing, maps RPI to index in temp_beacons
+static uint16_t temp_beacons_table[ENA_BEACONS_TEMP_TABLE_SIZE];
+static uint32_t temp_beacons_lookups = 0;
+static uint32_t temp_beacons_probes = 0;
+
+/**
+ * @brief type of event handled by the beacon task
+ */
+typedef enum
+{
+    ENA_BEACONS_EVENT_BEACON = 0, // beacon received
+    ENA_BEACONS_EVENT_REFRESH,    // scan finished
+} ena_beacons_event_type_t;
+
+/**
+ * @brief event handled by the beacon task
+ */
+typedef struct
+{
+    ena_beacons_event_type_t type;
+    uint32_t unix_timestamp;
+    uint8_t rpi[ENA_KEY_LENGTH];
+    uint8_t aem[ENA_AEM_METADATA_LENGTH];
+    int rssi;
+} ena_beacons_event_t;
+
+static SemaphoreHandle_t beacons_mutex = NULL;
+static QueueHandle_t beacons_queue = NULL;
+static volatile uint32_t beacons_dropped = 0;
+static uint32_t beacons_dropped_reported = 0;
+
+void ena_beacons_lock(void)
+{
+    if (beacons_mutex == NULL)
+    {
+        beacons_mutex = xSemaphoreCreateRecursiveMutex();
+        assert(beacons_mutex);
+    }
+    xSemaphoreTakeRecursive(beacons_mutex, portMAX_DELAY);
+}
+
+void ena_beacons_unlock(void)
+{
+    xSemaphoreGiveRecursive(beacons_mutex);
+}
+
+uint32_t ena_beacons_temp_hash(uint8_t *rpi)
+{
+    // RPIs are AES output, so any bytes are uniformly distributed
+    uint32_t hash;
+    memcpy(&hash, rpi, sizeof(uint32_t));
+    return hash % ENA_BEACONS_TEMP_TABLE_SIZE;
+}
+
+void ena_beacons_temp_table_insert(uint16_t index)
+{
+    uint32_t slot = ena_beacons_temp_hash(temp_beacons[index].rpi);
+    while (temp_beacons_table[slot] != ENA_BEACONS_TEMP_TABLE_EMPTY)
+    {
+        slot = (slot + 1) % ENA_BEACONS_TEMP_TABLE_SIZE;
+    }
+    temp_beacons_table[slot] = index;
+}
+
+uint32_t ena_beacons_temp_table_slot(uint16_t index)
+{
+    uint32_t slot = ena_beacons_temp_hash(temp_beacons[index].rpi);
+    while (temp_beacons_table[slot] != index)
+    {
+        slot = (slot + 1) % ENA_BEACONS_TEMP_TABLE_SIZE;
+    }
+    return slot;
+}
+
+void ena_beacons_temp_table_remove(uint32_t slot)
+{
+    // backward shift deletion, move following entries of the probe sequence into the gap
+    uint32_t gap = slot;
+    uint32_t next = slot;
+    while (true)
+    {
+        next = (next + 1) % ENA_BEACONS_TEMP_TABLE_SIZE;
+        if (temp_beacons_table[next] == ENA_BEACONS_TEMP_TABLE_EMPTY)
+        {
+            break;
+        }
+        uint32_t home = ena_beacons_temp_hash(temp_beacons[temp_beacons_table[next]].rpi);
+        // entry can be moved if its home slot is not between gap and its current slot
+        bool movable = (gap <= next) ? (home <= gap || home > next) : (home <= gap && home > next);
+        if (movable)
+        {
+            temp_beacons_table[gap] = temp_beacons_table[next];
+            gap = next;
+        }
+    }
+    temp_beacons_table[gap] = ENA_BEACONS_TEMP_TABLE_EMPTY;
+}
+
+void ena_beacons_temp_table_rebuild(void)
 {
+    memset(temp_beacons_table, 0xFF, sizeof(temp_beacons_table));
     for (int i = 0; i < temp_beacons_count; i++)
     {
-        if (memcmp(temp_beacons[i].rpi, rpi, sizeof(ENA_KEY_LENGTH)) == 0 &&
-            memcmp(temp_beacons[i].aem, aem, sizeof(ENA_AEM_METADATA_LENGTH)) == 0)
+        ena_beacons_temp_table_insert(i);
+    }
+}
+
+int ena_get_temp_beacon_index(uint8_t *rpi, uint8_t *aem)
+{
+    uint32_t slot = ena_beacons_temp_hash(rpi);
+    temp_beacons_lookups++;
+    while (temp_beacons_table[slot] != ENA_BEACONS_TEMP_TABLE_EMPTY)
+    {
+        temp_beacons_probes++;
+        uint16_t index = temp_beacons_table[slot];
+        if (memcmp(temp_beacons[index].rpi, rpi, ENA_KEY_LENGTH) == 0 &&
+            memcmp(temp_beacons[index].aem, aem, ENA_AEM_METADATA_LENGTH) == 0)
         {
-            return i;
+            return index;
         }
+        slot = (slot + 1) % ENA_BEACONS_TEMP_TABLE_SIZE;
     }
     return -1;
 }
 
+void ena_beacons_temp_load(void)
+{
+#if (CONFIG_ENA_BEACONS_TEMP_RAM_ONLY)
+    // last checkpoint, empty if invalid
+    temp_beacons_count = ena_storage_read_temp_beacons(temp_beacons, ENA_STORAGE_TEMP_BEACONS_MAX);
+#else
+    temp_beacons_count = ena_storage_temp_beacons_count();
+    if (temp_beacons_count > ENA_STORAGE_TEMP_BEACONS_MAX)
+    {
+        temp_beacons_count = ENA_STORAGE_TEMP_BEACONS_MAX;
+    }
+    for (int i = 0; i < temp_beacons_count; i++)
+    {
+        ena_storage_get_temp_beacon(i, &temp_beacons[i]);
+    }
+#endif
+    ena_beacons_temp_table_rebuild();
+    temp_beacons_loaded = true;
+    temp_beacons_changed = false;
+}
+
+void ena_beacons_temp_checkpoint(void)
+{
+#if (CONFIG_ENA_BEACONS_TEMP_RAM_ONLY)
+    ena_beacons_lock();
+    if (temp_beacons_loaded && temp_beacons_changed)
+    {
+        ena_storage_write_temp_beacons(temp_beacons, temp_beacons_count);
+        temp_beacons_changed = false;
+        ESP_LOGD(ENA_BEACON_LOG, "checkpoint of %u temporary beacons", temp_beacons_count);
+    }
+    ena_beacons_unlock();
+#endif
+}
+
+void ena_beacons_temp_erase(void)
+{
+    ena_beacons_lock();
+    temp_beacons_count = 0;
+    ena_beacons_temp_table_rebuild();
+    temp_beacons_loaded = true;
+    temp_beacons_changed = false;
+    ena_storage_erase_temporary_beacon();
+    ena_beacons_unlock();
+}
+
+void ena_beacons_temp_stats(ena_beacons_temp_stats_t *stats)
+{
+    ena_beacons_lock();
+    stats->count = temp_beacons_count;
+    stats->capacity = ENA_STORAGE_TEMP_BEACONS_MAX;
+    stats->table_size = ENA_BEACONS_TEMP_TABLE_SIZE;
+    stats->max_probe = 0;
+    for (uint32_t slot = 0; slot < ENA_BEACONS_TEMP_TABLE_SIZE; slot++)
+    {
+        if (temp_beacons_table[slot] != ENA_BEACONS_TEMP_TABLE_EMPTY)
+        {
+            uint32_t home = ena_beacons_temp_hash(temp_beacons[temp_beacons_table[slot]].rpi);
+            uint32_t probe = (slot + ENA_BEACONS_TEMP_TABLE_SIZE - home) % ENA_BEACONS_TEMP_TABLE_SIZE + 1;
+            if (probe > stats->max_probe)
+            {
+                stats->max_probe = probe;
+            }
+        }
+    }
+    stats->lookups = temp_beacons_lookups;
+    stats->probes = temp_beacons_probes;
+    stats->dropped = beacons_dropped;
+    ena_beacons_unlock();
+}
+
+/**
+ * @brief check if a temporary beacon stays temporary on refresh
+ *
+ * @param[in] beacon temporary beacon to check
+ * @param[in] context pointer to the unix timestamp of the refresh
+ *
+ * @return
+ *      false if the beacon reached the treshold or is too old
+ */
+bool ena_beacons_temp_retain(ena_beacon_t *beacon, void *context)
+{
+    uint32_t unix_timestamp = *((uint32_t *)context);
+    if (beacon->timestamp_last - beacon->timestamp_first >= ENA_BEACON_TRESHOLD)
+    {
+        return false;
+    }
+    // delete temp beacons older than two times time window (two times to be safe, one times time window enough?!)
+    return unix_timestamp - beacon->timestamp_last <= (ENA_TIME_WINDOW * 2);
+}
+
 void ena_beacons_temp_refresh(uint32_t unix_timestamp)
 {
-    for (int i = temp_beacons_count - 1; i >= 0; i--)
+    ena_beacons_lock();
+    if (!temp_beacons_loaded)
+    {
+        ena_beacons_temp_load();
+    }
+
+    // compact in one pass, beacons after treshold are stored permanently in batches
+    ena_beacon_t promoted[ENA_BEACONS_PROMOTE_BATCH];
+    size_t promoted_count = 0;
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < temp_beacons_count; i++)
     {
-        // check for treshold and add permanent beacon
+        if (ena_beacons_temp_retain(&temp_beacons[i], &unix_timestamp))
+        {
+            // table entry follows the beacon to its new index
+            if (kept != i)
+            {
+                temp_beacons_table[ena_beacons_temp_table_slot(i)] = kept;
+                temp_beacons[kept] = temp_beacons[i];
+            }
+            kept++;
+            continue;
+        }
+
+        ena_beacons_temp_table_remove(ena_beacons_temp_table_slot(i));
         if (temp_beacons[i].timestamp_last - temp_beacons[i].timestamp_first >= ENA_BEACON_TRESHOLD)
         {
             ESP_LOGD(ENA_BEACON_LOG, "create beacon after treshold");
             ESP_LOG_BUFFER_HEXDUMP(ENA_BEACON_LOG, temp_beacons[i].rpi, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
-            ena_storage_add_beacon(&temp_beacons[i]);
-            ena_storage_remove_temp_beacon(i);
+            promoted[promoted_count++] = temp_beacons[i];
+            if (promoted_count == ENA_BEACONS_PROMOTE_BATCH)
+            {
+                ena_storage_add_beacons(promoted, promoted_count);
+                promoted_count = 0;
+            }
         }
         else
-            // delete temp beacons older than two times time window (two times to be safe, one times time window enough?!)
-            if (unix_timestamp - temp_beacons[i].timestamp_last > (ENA_TIME_WINDOW * 2))
         {
             ESP_LOGD(ENA_BEACON_LOG, "remove old temporary beacon %u", i);
-            ena_storage_remove_temp_beacon(i);
         }
     }
+    if (promoted_count > 0)
+    {
+        ena_storage_add_beacons(promoted, promoted_count);
+    }
 
-    // update beacons
-    temp_beacons_count = ena_storage_temp_beacons_count();
-    for (int i = 0; i < temp_beacons_count; i++)
+    if (kept != temp_beacons_count)
     {
-        ena_storage_get_temp_beacon(i, &temp_beacons[i]);
+#if !(CONFIG_ENA_BEACONS_TEMP_RAM_ONLY)
+        // same order as in RAM, storage keeps the same beacons
+        ena_storage_retain_temp_beacons(ena_beacons_temp_retain, &unix_timestamp);
+#endif
+        temp_beacons_count = kept;
+        temp_beacons_changed = true;
+    }
+
+    // write back collected changes after scan
+    ena_beacons_temp_checkpoint();
+    ena_beacons_unlock();
+    ena_storage_flush();
+
+    uint32_t dropped = beacons_dropped;
+    if (dropped != beacons_dropped_reported)
+    {
+        ESP_LOGW(ENA_BEACON_LOG, "dropped %u received beacons, beacon queue full", dropped - beacons_dropped_reported);
+        beacons_dropped_reported = dropped;
     }
 
 #if (CONFIG_ENA_STORAGE_DUMP)
@@ -76,29 +332,48 @@ void ena_beacons_temp_refresh(uint32_t unix_timestamp)
 
 void ena_beacons_cleanup(uint32_t unix_timestamp)
 {
-    uint32_t count = ena_storage_beacons_count();
-    ena_beacon_t beacon;
-    for (int i = count - 1; i >= 0; i--)
+    // beacons are stored in buckets per day, so whole days older than the threshold are removed
+    uint32_t threshold = (ENA_BEACON_CLEANUP_TRESHOLD + 1) * (60 * 60 * 24);
+    if (unix_timestamp <= threshold)
     {
-        ena_storage_get_beacon(i, &beacon);
-        if (((unix_timestamp - beacon.timestamp_last) / (60 * 60 * 24)) > ENA_BEACON_CLEANUP_TRESHOLD)
-        {
-            ena_storage_remove_beacon(i);
-        }
+        return;
+    }
+
+    uint32_t expired = ena_storage_remove_beacons_before(unix_timestamp - threshold);
+    if (expired > 0)
+    {
+        ESP_LOGD(ENA_BEACON_LOG, "removed %u expired beacons", expired);
     }
 }
 
 void ena_beacon(uint32_t unix_timestamp, uint8_t *rpi, uint8_t *aem, int rssi)
 {
+    ena_beacons_lock();
+    if (!temp_beacons_loaded)
+    {
+        ena_beacons_temp_load();
+    }
+
     uint32_t beacon_index = ena_get_temp_beacon_index(rpi, aem);
     if (beacon_index == -1)
     {
+        if (temp_beacons_count >= ENA_STORAGE_TEMP_BEACONS_MAX)
+        {
+            ESP_LOGW(ENA_BEACON_LOG, "too many temporary beacons, skip new beacon");
+            ena_beacons_unlock();
+            return;
+        }
         temp_beacons[temp_beacons_count].timestamp_first = unix_timestamp;
         memcpy(temp_beacons[temp_beacons_count].rpi, rpi, ENA_KEY_LENGTH);
         memcpy(temp_beacons[temp_beacons_count].aem, aem, ENA_AEM_METADATA_LENGTH);
         temp_beacons[temp_beacons_count].rssi = rssi;
         temp_beacons[temp_beacons_count].timestamp_last = unix_timestamp;
+#if (CONFIG_ENA_BEACONS_TEMP_RAM_ONLY)
+        beacon_index = temp_beacons_count;
+        temp_beacons_changed = true;
+#else
         beacon_index = ena_storage_add_temp_beacon(&temp_beacons[temp_beacons_count]);
+#endif
         ESP_LOGD(ENA_BEACON_LOG, "new temporary beacon %d at %u", temp_beacons_count, unix_timestamp);
         ESP_LOG_BUFFER_HEX_LEVEL(ENA_BEACON_LOG, rpi, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
         ESP_LOG_BUFFER_HEX_LEVEL(ENA_BEACON_LOG, aem, ENA_AEM_METADATA_LENGTH, ESP_LOG_DEBUG);
@@ -108,6 +383,7 @@ void ena_beacon(uint32_t unix_timestamp, uint8_t *rpi, uint8_t *aem, int rssi)
         {
             ESP_LOGW(ENA_BEACON_LOG, "last temporary beacon index does not match array index!");
         }
+        ena_beacons_temp_table_insert(temp_beacons_count);
         temp_beacons_count++;
     }
     else
@@ -118,6 +394,83 @@ void ena_beacon(uint32_t unix_timestamp, uint8_t *rpi, uint8_t *aem, int rssi)
         ESP_LOG_BUFFER_HEX_LEVEL(ENA_BEACON_LOG, temp_beacons[beacon_index].rpi, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
         ESP_LOG_BUFFER_HEX_LEVEL(ENA_BEACON_LOG, temp_beacons[beacon_index].aem, ENA_AEM_METADATA_LENGTH, ESP_LOG_DEBUG);
         ESP_LOGD(ENA_BEACON_LOG, "RSSI %d", temp_beacons[beacon_index].rssi);
+#if (CONFIG_ENA_BEACONS_TEMP_RAM_ONLY)
+        temp_beacons_changed = true;
+#else
         ena_storage_set_temp_beacon(beacon_index, &temp_beacons[beacon_index]);
+#endif
+    }
+    ena_beacons_unlock();
+}
+
+void ena_beacons_task(void *pvParameter)
+{
+    ena_beacons_event_t event;
+    while (1)
+    {
+        if (xQueueReceive(beacons_queue, &event, portMAX_DELAY) == pdTRUE)
+        {
+            switch (event.type)
+            {
+            case ENA_BEACONS_EVENT_BEACON:
+                ena_beacon(event.unix_timestamp, event.rpi, event.aem, event.rssi);
+                break;
+            case ENA_BEACONS_EVENT_REFRESH:
+                ena_beacons_temp_refresh(event.unix_timestamp);
+                break;
+            }
+        }
+    }
+}
+
+void ena_beacons_start(void)
+{
+    if (beacons_queue != NULL)
+    {
+        return;
+    }
+    beacons_queue = xQueueCreate(ENA_BEACONS_QUEUE_SIZE, sizeof(ena_beacons_event_t));
+    assert(beacons_queue);
+    xTaskCreate(&ena_beacons_task, "ena_beacons_task", 4096, NULL, 4, NULL);
+}
+
+void ena_beacons_receive(uint32_t unix_timestamp, uint8_t *rpi, uint8_t *aem, int rssi)
+{
+    if (beacons_queue == NULL)
+    {
+        ena_beacon(unix_timestamp, rpi, aem, rssi);
+        return;
+    }
+
+    ena_beacons_event_t event = {
+        .type = ENA_BEACONS_EVENT_BEACON,
+        .unix_timestamp = unix_timestamp,
+        .rssi = rssi,
+    };
+    memcpy(event.rpi, rpi, ENA_KEY_LENGTH);
+    memcpy(event.aem, aem, ENA_AEM_METADATA_LENGTH);
+    // never block the BLE stack, drop beacon if task is behind
+    if (xQueueSend(beacons_queue, &event, 0) != pdTRUE)
+    {
+        beacons_dropped++;
+    }
+}
+
+void ena_beacons_scan_finished(uint32_t unix_timestamp)
+{
+    if (beacons_queue == NULL)
+    {
+        ena_beacons_temp_refresh(unix_timestamp);
+        return;
+    }
+
+    ena_beacons_event_t event = {
+        .type = ENA_BEACONS_EVENT_REFRESH,
+        .unix_timestamp = unix_timestamp,
+    };
+    if (xQueueSend(beacons_queue, &event, 0) != pdTRUE)
+    {
+        // next scan refreshes again
+        ESP_LOGW(ENA_BEACON_LOG, "beacon queue full, skip refresh");
     }
 }
\ No newline at end of file
@@ -11,6 +11,8 @@
 // WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 // See the License for the specific language governing permissions and
 // limitations under the License.
+#include <string.h>
+
 #include "esp_log.h"
 #include "esp_bt.h"
 #include "esp_gap_ble_api.h"
@@ -28,6 +30,10 @@ static esp_ble_adv_params_t ena_adv_params = {
     .adv_filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY,
 };
 
+static bool key_ctx_valid = false;
+static uint8_t key_ctx_tek[ENA_KEY_LENGTH];
+static ena_crypto_key_ctx_t key_ctx;
+
 void ena_bluetooth_advertise_start(void)
 {
     ESP_ERROR_CHECK(esp_ble_gap_start_advertising(&ena_adv_params));
@@ -35,18 +41,24 @@ void ena_bluetooth_advertise_start(void)
 
 void ena_bluetooth_advertise_set_payload(uint32_t enin, uint8_t *tek)
 {
-    uint8_t rpik[ENA_KEY_LENGTH] = {0};
     uint8_t rpi[ENA_KEY_LENGTH] = {0};
-    uint8_t aemk[ENA_KEY_LENGTH] = {0};
     uint8_t aem[ENA_AEM_METADATA_LENGTH] = {0};
 
-    ena_crypto_rpik(rpik, tek);
-
-    ena_crypto_rpi(rpi, rpik, enin);
+    // TEK only changes once per rolling period, derive keys only then
+    if (!key_ctx_valid || memcmp(key_ctx_tek, tek, ENA_KEY_LENGTH) != 0)
+    {
+        if (key_ctx_valid)
+        {
+            ena_crypto_key_ctx_free(&key_ctx);
+        }
+        ena_crypto_key_ctx_init(&key_ctx, tek);
+        memcpy(key_ctx_tek, tek, ENA_KEY_LENGTH);
+        key_ctx_valid = true;
+    }
 
-    ena_crypto_aemk(aemk, tek);
+    ena_crypto_rpi_range(&key_ctx, enin, 1, rpi);
 
-    ena_crypto_aem(aem, aemk, rpi, esp_ble_tx_power_get(ESP_BLE_PWR_TYPE_ADV));
+    ena_crypto_key_ctx_aem(&key_ctx, aem, rpi, esp_ble_tx_power_get(ESP_BLE_PWR_TYPE_ADV));
 
     uint8_t adv_raw_data[31];
     // FLAG??? skipped on sniffed android packages!?
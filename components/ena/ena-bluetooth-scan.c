@@ -48,7 +48,7 @@ void ena_bluetooth_scan_event_callback(esp_gap_ble_cb_event_t event, esp_ble_gap
         break;
     case ESP_GAP_BLE_SCAN_STOP_COMPLETE_EVT:
         ESP_LOGD(ENA_SCAN_LOG, "stopped scanning...");
-        ena_beacons_temp_refresh(unix_timestamp);
+        ena_beacons_scan_finished(unix_timestamp);
         break;
     case ESP_GAP_BLE_SCAN_RESULT_EVT:
         if (p->scan_rst.search_evt == ESP_GAP_SEARCH_INQ_RES_EVT)
@@ -66,20 +66,15 @@ void ena_bluetooth_scan_event_callback(esp_gap_ble_cb_event_t event, esp_ble_gap
                     break;
                 }
 
-                uint8_t *rpi = malloc(ENA_KEY_LENGTH);
-                memcpy(rpi, &service_data[sizeof(ENA_SERVICE_UUID)], ENA_KEY_LENGTH);
-                uint8_t *aem = malloc(ENA_AEM_METADATA_LENGTH);
-                memcpy(aem, &service_data[sizeof(ENA_SERVICE_UUID) + ENA_KEY_LENGTH], ENA_AEM_METADATA_LENGTH);
-                ena_beacon(unix_timestamp, rpi, aem, p->scan_rst.rssi);
+                // handled by beacon task, do not block BLE stack
+                ena_beacons_receive(unix_timestamp, &service_data[sizeof(ENA_SERVICE_UUID)], &service_data[sizeof(ENA_SERVICE_UUID) + ENA_KEY_LENGTH], p->scan_rst.rssi);
                 last_scan_num++;
-                free(rpi);
-                free(aem);
             }
         }
         else if (p->scan_rst.search_evt == ESP_GAP_SEARCH_INQ_CMPL_EVT)
         {
             scan_status = ENA_SCAN_STATUS_NOT_SCANNING;
-            ena_beacons_temp_refresh(unix_timestamp);
+            ena_beacons_scan_finished(unix_timestamp);
             ESP_LOGD(ENA_SCAN_LOG, "finished scanning...");
         }
         break;
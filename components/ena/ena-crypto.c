@@ -11,6 +11,8 @@
 // WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 // See the License for the specific language governing permissions and
 // limitations under the License.
+#include <string.h>
+
 #include "mbedtls/md.h"
 #include "mbedtls/aes.h"
 #include "mbedtls/hkdf.h"
@@ -21,10 +23,35 @@
 
 #include "ena-crypto.h"
 
+#ifdef HOST_CRYPTO_BATCH
+#include "host-crypto.h"
+#endif
+
+#ifdef CONFIG_ENA_CRYPTO_HW_AES
+#include "esp32/aes.h"
+#include "soc/hwcrypto_reg.h"
+#include "soc/dport_access.h"
+#endif
+
 #define ESP_CRYPTO_LOG "ESP-CRYPTO"
 
+#define ENA_CRYPTO_SELF_TEST_RPIS (16) // number of RPIs of the batch compared to single RPIs on self test
+
 static mbedtls_ctr_drbg_context ctr_drbg;
 
+#ifdef CONFIG_ENA_CRYPTO_HW_AES
+static bool hw_aes = false;
+#endif
+
+// test vectors of the cryptography specification, appendix
+static const uint8_t test_tek[ENA_KEY_LENGTH] = {0x75, 0xc7, 0x34, 0xc6, 0xdd, 0x1a, 0x78, 0x2d, 0xe7, 0xa9, 0x65, 0xda, 0x5e, 0xb9, 0x31, 0x25};
+static const uint32_t test_enin = 2642976;
+static const uint8_t test_rpik[ENA_KEY_LENGTH] = {0x18, 0x5a, 0xd9, 0x1d, 0xb6, 0x9e, 0xc7, 0xdd, 0x04, 0x89, 0x60, 0xf1, 0xf3, 0xba, 0x61, 0x75};
+static const uint8_t test_rpi[ENA_KEY_LENGTH] = {0x8b, 0xe6, 0xcd, 0x37, 0x1c, 0x5c, 0x89, 0x16, 0x04, 0xbf, 0xbe, 0x49, 0xdf, 0x84, 0x50, 0x96};
+static const uint8_t test_aemk[ENA_KEY_LENGTH] = {0xd5, 0x7c, 0x46, 0xaf, 0x7a, 0x1d, 0x83, 0x96, 0x5b, 0x9b, 0xed, 0x8b, 0xd1, 0x52, 0x93, 0x6a};
+static const uint8_t test_power_level = 0x08;
+static const uint8_t test_aem[ENA_AEM_METADATA_LENGTH] = {0x72, 0x03, 0x38, 0x74};
+
 void ena_crypto_init(void)
 {
     mbedtls_entropy_context entropy;
@@ -38,6 +65,15 @@ void ena_crypto_init(void)
     {
         ESP_LOGE(ESP_CRYPTO_LOG, " failed\n ! mbedtls_ctr_drbg_init returned -0x%04x\n", -ret);
     }
+
+#ifdef CONFIG_ENA_CRYPTO_HW_AES
+    hw_aes = true;
+    if (!ena_crypto_self_test())
+    {
+        ESP_LOGE(ESP_CRYPTO_LOG, "AES accelerator failed on test vectors, fall back to software");
+        hw_aes = false;
+    }
+#endif
 }
 
 uint32_t ena_crypto_enin(uint32_t unix_epoch_time)
@@ -54,19 +90,27 @@ void ena_crypto_tek(uint8_t *tek)
     }
 }
 
+// HKDF info strings are used without terminating zero, see test vectors of the specification
+static const uint8_t ena_crypto_rpik_info[] = {'E', 'N', '-', 'R', 'P', 'I', 'K'};
+static const uint8_t ena_crypto_aemk_info[] = {'E', 'N', '-', 'A', 'E', 'M', 'K'};
+
 void ena_crypto_rpik(uint8_t *rpik, uint8_t *tek)
 {
-    const uint8_t rpik_info[] = "EN-RPIK";
-    mbedtls_hkdf(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), NULL, 0, tek, ENA_KEY_LENGTH, rpik_info, sizeof(rpik_info), rpik, ENA_KEY_LENGTH);
+    mbedtls_hkdf(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), NULL, 0, tek, ENA_KEY_LENGTH, ena_crypto_rpik_info, sizeof(ena_crypto_rpik_info), rpik, ENA_KEY_LENGTH);
 }
 
-void ena_crypto_rpi(uint8_t *rpi, uint8_t *rpik, uint32_t enin)
+void ena_crypto_rpi_block(uint8_t *padded_data, uint32_t enin)
 {
-    uint8_t padded_data[] = "EN-RPI";
     padded_data[12] = (enin & 0x000000ff);
     padded_data[13] = (enin & 0x0000ff00) >> 8;
     padded_data[14] = (enin & 0x00ff0000) >> 16;
     padded_data[15] = (enin & 0xff000000) >> 24;
+}
+
+void ena_crypto_rpi(uint8_t *rpi, uint8_t *rpik, uint32_t enin)
+{
+    uint8_t padded_data[16] = "EN-RPI";
+    ena_crypto_rpi_block(padded_data, enin);
 
     mbedtls_aes_context aes;
     mbedtls_aes_init(&aes);
@@ -77,20 +121,160 @@ void ena_crypto_rpi(uint8_t *rpi, uint8_t *rpik, uint32_t enin)
 
 void ena_crypto_aemk(uint8_t *aemk, uint8_t *tek)
 {
-    uint8_t aemkInfo[] = "EN-AEMK";
-    mbedtls_hkdf(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), NULL, 0, tek, ENA_KEY_LENGTH, aemkInfo, sizeof(aemkInfo), aemk, ENA_KEY_LENGTH);
+    mbedtls_hkdf(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), NULL, 0, tek, ENA_KEY_LENGTH, ena_crypto_aemk_info, sizeof(ena_crypto_aemk_info), aemk, ENA_KEY_LENGTH);
 }
 
-void ena_crypto_aem(uint8_t *aem, uint8_t *aemk, uint8_t *rpi, uint8_t power_level)
+void ena_crypto_aem_encrypt(mbedtls_aes_context *aes, uint8_t *aem, uint8_t *rpi, uint8_t power_level)
 {
-    uint8_t metadata[ENA_AEM_METADATA_LENGTH];
+    uint8_t metadata[ENA_AEM_METADATA_LENGTH] = {0};
     metadata[0] = 0b01000000;
     metadata[1] = power_level;
     size_t count = 0;
+    uint8_t nonce_counter[16];
     uint8_t sb[16] = {0};
+    // CTR mode increments the counter, RPI stays untouched
+    memcpy(nonce_counter, rpi, sizeof(nonce_counter));
+    mbedtls_aes_crypt_ctr(aes, ENA_AEM_METADATA_LENGTH, &count, nonce_counter, sb, metadata, aem);
+}
+
+void ena_crypto_aem(uint8_t *aem, uint8_t *aemk, uint8_t *rpi, uint8_t power_level)
+{
     mbedtls_aes_context aes;
     mbedtls_aes_init(&aes);
     mbedtls_aes_setkey_enc(&aes, aemk, ENA_KEY_LENGTH * 8);
-    mbedtls_aes_crypt_ctr(&aes, ENA_AEM_METADATA_LENGTH, &count, rpi, sb, metadata, aem);
+    ena_crypto_aem_encrypt(&aes, aem, rpi, power_level);
     mbedtls_aes_free(&aes);
-}
\ No newline at end of file
+}
+
+void ena_crypto_key_ctx_init(ena_crypto_key_ctx_t *ctx, uint8_t *tek)
+{
+    const mbedtls_md_info_t *md_info = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
+    uint8_t prk[MBEDTLS_MD_MAX_SIZE];
+
+    // RPIK and AEMK only differ in the info of the expand step
+    mbedtls_hkdf_extract(md_info, NULL, 0, tek, ENA_KEY_LENGTH, prk);
+    mbedtls_hkdf_expand(md_info, prk, mbedtls_md_get_size(md_info), ena_crypto_rpik_info, sizeof(ena_crypto_rpik_info), ctx->rpik, ENA_KEY_LENGTH);
+    mbedtls_hkdf_expand(md_info, prk, mbedtls_md_get_size(md_info), ena_crypto_aemk_info, sizeof(ena_crypto_aemk_info), ctx->aemk, ENA_KEY_LENGTH);
+    memset(prk, 0, sizeof(prk));
+
+    mbedtls_aes_init(&ctx->rpik_aes);
+    mbedtls_aes_setkey_enc(&ctx->rpik_aes, ctx->rpik, ENA_KEY_LENGTH * 8);
+    mbedtls_aes_init(&ctx->aemk_aes);
+    mbedtls_aes_setkey_enc(&ctx->aemk_aes, ctx->aemk, ENA_KEY_LENGTH * 8);
+}
+
+void ena_crypto_key_ctx_free(ena_crypto_key_ctx_t *ctx)
+{
+    mbedtls_aes_free(&ctx->rpik_aes);
+    mbedtls_aes_free(&ctx->aemk_aes);
+    memset(ctx->rpik, 0, ENA_KEY_LENGTH);
+    memset(ctx->aemk, 0, ENA_KEY_LENGTH);
+}
+
+#ifdef CONFIG_ENA_CRYPTO_HW_AES
+/**
+ * @brief encrypt RPI blocks on the AES accelerator
+ *
+ * The peripheral is locked and the key written once for all blocks, mbedTLS would do both for every block.
+ */
+void ena_crypto_hw_rpi_range(const uint8_t *rpik, uint32_t enin_start, size_t count, uint8_t *rpis)
+{
+    uint8_t padded_data[16] = "EN-RPI";
+    uint32_t words[4];
+
+    esp_aes_acquire_hardware();
+    memcpy(words, rpik, ENA_KEY_LENGTH);
+    for (int i = 0; i < 4; i++)
+    {
+        DPORT_REG_WRITE(AES_KEY_BASE + i * 4, words[i]);
+    }
+    // AES-128 encryption
+    DPORT_REG_WRITE(AES_MODE_REG, 0);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        // result replaces the text, so the whole block is written again
+        ena_crypto_rpi_block(padded_data, enin_start + i);
+        memcpy(words, padded_data, sizeof(words));
+        for (int w = 0; w < 4; w++)
+        {
+            DPORT_REG_WRITE(AES_TEXT_BASE + w * 4, words[w]);
+        }
+        DPORT_REG_WRITE(AES_START_REG, 1);
+        while (DPORT_REG_READ(AES_IDLE_REG) != 1)
+        {
+        }
+        for (int w = 0; w < 4; w++)
+        {
+            words[w] = DPORT_REG_READ(AES_TEXT_BASE + w * 4);
+        }
+        memcpy(&rpis[i * ENA_KEY_LENGTH], words, ENA_KEY_LENGTH);
+    }
+
+    esp_aes_release_hardware();
+    memset(words, 0, sizeof(words));
+}
+#endif
+
+void ena_crypto_rpi_range(ena_crypto_key_ctx_t *ctx, uint32_t enin_start, size_t count, uint8_t *rpis)
+{
+#ifdef HOST_CRYPTO_BATCH
+    // host build encrypts many blocks per call, see host/host-crypto.c
+    host_crypto_rpi_range(ctx->rpik, enin_start, count, rpis);
+#else
+#ifdef CONFIG_ENA_CRYPTO_HW_AES
+    if (hw_aes)
+    {
+        ena_crypto_hw_rpi_range(ctx->rpik, enin_start, count, rpis);
+        return;
+    }
+#endif
+    uint8_t padded_data[16] = "EN-RPI";
+    for (size_t i = 0; i < count; i++)
+    {
+        ena_crypto_rpi_block(padded_data, enin_start + i);
+        mbedtls_aes_crypt_ecb(&ctx->rpik_aes, MBEDTLS_AES_ENCRYPT, padded_data, &rpis[i * ENA_KEY_LENGTH]);
+    }
+#endif
+}
+
+void ena_crypto_key_ctx_aem(ena_crypto_key_ctx_t *ctx, uint8_t *aem, uint8_t *rpi, uint8_t power_level)
+{
+    ena_crypto_aem_encrypt(&ctx->aemk_aes, aem, rpi, power_level);
+}
+
+bool ena_crypto_self_test(void)
+{
+    ena_crypto_key_ctx_t ctx;
+    uint8_t key[ENA_KEY_LENGTH];
+    uint8_t rpi[ENA_KEY_LENGTH];
+    uint8_t rpis[ENA_CRYPTO_SELF_TEST_RPIS * ENA_KEY_LENGTH];
+    uint8_t aem[ENA_AEM_METADATA_LENGTH];
+    bool passed = true;
+
+    memcpy(key, test_tek, ENA_KEY_LENGTH);
+    ena_crypto_key_ctx_init(&ctx, key);
+    passed &= memcmp(ctx.rpik, test_rpik, ENA_KEY_LENGTH) == 0;
+    passed &= memcmp(ctx.aemk, test_aemk, ENA_KEY_LENGTH) == 0;
+
+    ena_crypto_rpi_range(&ctx, test_enin, ENA_CRYPTO_SELF_TEST_RPIS, rpis);
+    passed &= memcmp(rpis, test_rpi, ENA_KEY_LENGTH) == 0;
+    // every RPI of the batch as derived one by one in software
+    for (int i = 0; i < ENA_CRYPTO_SELF_TEST_RPIS; i++)
+    {
+        ena_crypto_rpi(rpi, ctx.rpik, test_enin + i);
+        passed &= memcmp(&rpis[i * ENA_KEY_LENGTH], rpi, ENA_KEY_LENGTH) == 0;
+    }
+
+    ena_crypto_key_ctx_aem(&ctx, aem, rpis, test_power_level);
+    passed &= memcmp(aem, test_aem, ENA_AEM_METADATA_LENGTH) == 0;
+    ena_crypto_key_ctx_free(&ctx);
+
+    // single derivation
+    ena_crypto_rpik(key, (uint8_t *)test_tek);
+    passed &= memcmp(key, test_rpik, ENA_KEY_LENGTH) == 0;
+    ena_crypto_aemk(key, (uint8_t *)test_tek);
+    passed &= memcmp(key, test_aemk, ENA_KEY_LENGTH) == 0;
+
+    return passed;
+}
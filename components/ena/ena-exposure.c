@@ -14,9 +14,14 @@
 #include <string.h>
 #include <time.h>
 #include <limits.h>
+#include <stdlib.h>
 
 #include "esp_err.h"
 #include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 
 #include "ena-crypto.h"
 #include "ena-storage.h"
@@ -24,7 +29,136 @@
 
 #include "ena-exposure.h"
 
+#define ENA_EXPOSURE_READ_BATCH (32)                                            // number of beacons read at once while building the RPI index
+#define ENA_EXPOSURE_ORDER_TOLERANCE (ENA_BEACON_TRESHOLD + 3 * ENA_TIME_WINDOW) // max. delay of storing a beacon, beacons are stored in order of storing, not receiving
+#define ENA_EXPOSURE_HELPER_CORE (tskNO_AFFINITY)                               // core of helper task checking keys, matching worker runs on last core
+#define ENA_EXPOSURE_HELPER_PRIORITY (2)                                        // priority of helper task, same as matching worker
+#define ENA_EXPOSURE_CHUNK_KEYS (4)                                             // number of keys a core takes at once from a key batch
+#define ENA_EXPOSURE_RPI_BATCH (16)                                             // number of RPIs of a key calculated at once
+#define ENA_EXPOSURE_CANDIDATE_BYTES ((ENA_TEK_ROLLING_PERIOD + 7) / 8)        // size of the bitmap of candidate RPIs of a key
+#define ENA_EXPOSURE_LUT_ATTENUATION (256)                                      // attenuations in score lookup table, higher ones share the last entry
+#define ENA_EXPOSURE_LUT_DURATION (64)                                          // durations in minutes in score lookup table, longer ones share the last entry
+#define ENA_EXPOSURE_LUT_DAYS (16)                                              // days in score lookup table, more share the last entry
+#define ENA_EXPOSURE_DAY_SECONDS (60 * 60 * 24)                                 // seconds of a UTC day of the exposure histogram
+
+/**
+ * @brief entry of the in-RAM index over stored beacon RPIs
+ */
+typedef struct
+{
+    uint32_t rpi_prefix; // first 4 bytes of the beacon RPI, RPIs are AES output and therefore uniformly distributed
+    uint32_t sequence;   // sequence number of the beacon in storage, kept while other beacons are added and removed
+} ena_exposure_rpi_index_entry_t;
+
+/**
+ * @brief exposure configuration compiled to risk values per attenuation, duration and days
+ */
+typedef struct
+{
+    bool built;                                         // tables are built
+    ena_exposure_config_t config;                       // configuration the tables are built for
+    uint8_t attenuation[ENA_EXPOSURE_LUT_ATTENUATION]; // attenuation risk value per attenuation in dB
+    uint8_t duration[ENA_EXPOSURE_LUT_DURATION];       // duration risk value per duration in minutes
+    uint8_t days[ENA_EXPOSURE_LUT_DAYS];               // days risk value per days since exposure
+} ena_exposure_score_lut_t;
+
+/**
+ * @brief type of job handled by the matching worker
+ */
+typedef enum
+{
+    ENA_EXPOSURE_JOB_BEGIN = 0,   // begin stream of keys
+    ENA_EXPOSURE_JOB_KEYS,        // check batch of keys
+    ENA_EXPOSURE_JOB_END_STORE,   // end stream and store exposure information
+    ENA_EXPOSURE_JOB_END_DISCARD, // end stream and discard exposure information
+    ENA_EXPOSURE_JOB_SUMMARY,     // update exposure summary
+    ENA_EXPOSURE_JOB_LAST_CHECK,  // store date of last check
+} ena_exposure_job_type_t;
+
+/**
+ * @brief job handled by the matching worker
+ */
+typedef struct
+{
+    ena_exposure_job_type_t type;
+    size_t count;
+    ena_exposure_config_t *config;
+    uint32_t timestamp;
+    ena_temporary_exposure_key_t keys[ENA_EXPOSURE_WORKER_BATCH];
+} ena_exposure_job_t;
+
+/**
+ * @brief RPI of a key with the prefix of an indexed beacon, the beacon is read and compared after checking on all cores
+ */
+typedef struct
+{
+    uint32_t key;                // index of the key in the batch
+    uint32_t sequence;           // sequence number of the indexed beacon
+    uint8_t rpi[ENA_KEY_LENGTH]; // RPI of the key
+} ena_exposure_hit_t;
+
+/**
+ * @brief state of one core checking keys of a batch
+ */
+typedef struct
+{
+    ena_storage_bloom_t bloom; // copy of the Bloom filter of stored beacons, bits shared with the other core
+    ena_exposure_hit_t *hits;  // hits in order of keys
+    size_t hits_count;         // number of hits
+    size_t hits_capacity;      // number of hits fitting in hits
+} ena_exposure_core_t;
+
+/**
+ * @brief key batch checked on both cores
+ *
+ * Cores take chunks of keys until all are taken, so a core busy with other tasks checks less keys. Checking keys takes
+ * no storage lock, beacons are only read for hits afterwards.
+ */
+typedef struct
+{
+    ena_exposure_rpi_index_entry_t *index;                 // index of beacon RPIs, shared and read-only
+    size_t size;                                           // number of entries in index
+    uint32_t index_timestamp_start;                        // first timestamp of indexed beacons
+    uint32_t index_timestamp_end;                          // last timestamp of indexed beacons
+    bool derive;                                           // derive keys and filter RPIs first
+    ena_temporary_exposure_key_t *temporary_exposure_keys; // keys of the batch
+    size_t count;                                          // number of keys of the batch
+    ena_crypto_key_ctx_t *key_ctxs;                        // derived keys of keys
+    uint8_t *candidates;                                   // bitmaps of RPIs passing the Bloom filter, ENA_EXPOSURE_CANDIDATE_BYTES per key
+    uint32_t next;                                         // first key not taken by a core yet
+    ena_exposure_core_t cores[2];                          // state of the calling core and of the helper
+} ena_exposure_batch_t;
+
 static ena_exposure_summary_t *current_summary;
+static ena_exposure_score_lut_t score_lut; // only used by the task calculating the exposure summary
+static ena_storage_exposure_histogram_t exposure_histogram; // stored exposure information per day and risk class
+static bool exposure_histogram_loaded = false;
+static bool exposure_histogram_valid = false; // histogram counts every stored exposure information
+
+static volatile bool stream_active = false; // read by storage task to defer clean up
+static ena_exposure_rpi_index_entry_t *stream_index = NULL;
+static size_t stream_index_size = 0;
+static uint32_t stream_index_end = 0; // sequence number of the first beacon not indexed yet
+static uint32_t stream_index_timestamp_start = 0;
+static uint32_t stream_index_timestamp_end = 0;
+static ena_exposure_information_t *stream_exposure_infos = NULL;
+static size_t stream_exposure_infos_count = 0;
+static size_t stream_exposure_infos_capacity = 0;
+
+static SemaphoreHandle_t helper_mutex = NULL;
+static SemaphoreHandle_t helper_start = NULL;
+static SemaphoreHandle_t helper_done = NULL;
+static ena_exposure_batch_t *helper_batch;
+static bool helper_enabled = true;
+
+static QueueHandle_t worker_queue = NULL;
+static ena_exposure_job_t worker_job;          // only accessed by worker
+static ena_exposure_job_t worker_producer_job; // jobs are too large for stacks, guarded by producer mutex
+static SemaphoreHandle_t worker_producer_mutex = NULL;
+static uint32_t worker_stream_start = 0;
+static size_t worker_stream_keys = 0;
+static volatile uint32_t worker_last_check = 0;          // date of last check queued by producer
+static volatile bool worker_last_check_pending = false; // queued date of last check not stored yet
 
 static ena_exposure_config_t DEFAULT_ENA_EXPOSURE_CONFIG = {
     // transmission_risk_values
@@ -78,33 +212,32 @@ int ena_exposure_transmission_risk_score(ena_exposure_config_t *config, ena_expo
     return config->transmission_risk_values[params.report_type];
 }
 
-int ena_exposure_duration_risk_score(ena_exposure_config_t *config, ena_exposure_parameter_t params)
+int ena_exposure_duration_level(int duration)
 {
-    // calc duration level
     int duration_level = MINUTES_0;
-    if (params.duration > 0)
+    if (duration > 0)
     {
-        if (params.duration <= 5)
+        if (duration <= 5)
         {
             duration_level = MINUTES_5;
         }
-        else if (params.duration <= 10)
+        else if (duration <= 10)
         {
             duration_level = MINUTES_10;
         }
-        if (params.duration <= 15)
+        if (duration <= 15)
         {
             duration_level = MINUTES_15;
         }
-        if (params.duration <= 20)
+        if (duration <= 20)
         {
             duration_level = MINUTES_20;
         }
-        if (params.duration <= 25)
+        if (duration <= 25)
         {
             duration_level = MINUTES_25;
         }
-        if (params.duration <= 30)
+        if (duration <= 30)
         {
             duration_level = MINUTES_30;
         }
@@ -114,93 +247,149 @@ int ena_exposure_duration_risk_score(ena_exposure_config_t *config, ena_exposure
         }
     }
 
-    return config->duration_risk_values[duration_level];
+    return duration_level;
 }
 
-int ena_exposure_days_risk_score(ena_exposure_config_t *config, ena_exposure_parameter_t params)
+int ena_exposure_duration_risk_score(ena_exposure_config_t *config, ena_exposure_parameter_t params)
+{
+    return config->duration_risk_values[ena_exposure_duration_level(params.duration)];
+}
+
+int ena_exposure_days_level(int days)
 {
-    // calc days level
     int days_level = DAYS_14;
 
-    if (params.days < 2)
+    if (days < 2)
     {
         days_level = DAYS_0;
     }
-    else if (params.days < 4)
+    else if (days < 4)
     {
         days_level = DAYS_3;
     }
-    else if (params.days < 6)
+    else if (days < 6)
     {
         days_level = DAYS_5;
     }
-    else if (params.days < 8)
+    else if (days < 8)
     {
         days_level = DAYS_7;
     }
-    else if (params.days < 10)
+    else if (days < 10)
     {
         days_level = DAYS_9;
     }
-    else if (params.days < 12)
+    else if (days < 12)
     {
         days_level = DAYS_11;
     }
-    else if (params.days < 14)
+    else if (days < 14)
     {
         days_level = DAYS_13;
     }
 
-    return config->days_risk_values[days_level];
+    return days_level;
 }
 
-int ena_exposure_attenuation_risk_score(ena_exposure_config_t *config, ena_exposure_parameter_t params)
+int ena_exposure_days_risk_score(ena_exposure_config_t *config, ena_exposure_parameter_t params)
+{
+    return config->days_risk_values[ena_exposure_days_level(params.days)];
+}
+
+int ena_exposure_attenuation_level(int attenuation)
 {
-    // calc attenuation level
     int attenuation_level = ATTENUATION_73;
 
-    if (params.attenuation <= 10)
+    if (attenuation <= 10)
     {
         attenuation_level = ATTENUATION_LOWER;
     }
-    else if (params.attenuation <= 15)
+    else if (attenuation <= 15)
     {
         attenuation_level = ATTENUATION_10;
     }
-    else if (params.attenuation <= 27)
+    else if (attenuation <= 27)
     {
         attenuation_level = ATTENUATION_15;
     }
-    else if (params.attenuation <= 33)
+    else if (attenuation <= 33)
     {
         attenuation_level = ATTENUATION_27;
     }
-    else if (params.attenuation <= 51)
+    else if (attenuation <= 51)
     {
         attenuation_level = ATTENUATION_33;
     }
-    else if (params.attenuation <= 63)
+    else if (attenuation <= 63)
     {
         attenuation_level = ATTENUATION_51;
     }
-    else if (params.attenuation <= 73)
+    else if (attenuation <= 73)
     {
         attenuation_level = ATTENUATION_63;
     }
 
-    return config->attenuation_risk_values[attenuation_level];
+    return attenuation_level;
 }
 
-int ena_exposure_risk_score(ena_exposure_config_t *config, ena_exposure_parameter_t params)
+int ena_exposure_attenuation_risk_score(ena_exposure_config_t *config, ena_exposure_parameter_t params)
 {
-    int score = 1;
-    score *= ena_exposure_transmission_risk_score(config, params);
+    return config->attenuation_risk_values[ena_exposure_attenuation_level(params.attenuation)];
+}
+
+/**
+ * @brief build score lookup table of an exposure configuration
+ */
+void ena_exposure_score_lut_build(ena_exposure_config_t *config)
+{
+    for (int i = 0; i < ENA_EXPOSURE_LUT_ATTENUATION; i++)
+    {
+        score_lut.attenuation[i] = config->attenuation_risk_values[ena_exposure_attenuation_level(i)];
+    }
+    for (int i = 0; i < ENA_EXPOSURE_LUT_DURATION; i++)
+    {
+        score_lut.duration[i] = config->duration_risk_values[ena_exposure_duration_level(i)];
+    }
+    for (int i = 0; i < ENA_EXPOSURE_LUT_DAYS; i++)
+    {
+        score_lut.days[i] = config->days_risk_values[ena_exposure_days_level(i)];
+    }
+    memcpy(&score_lut.config, config, sizeof(ena_exposure_config_t));
+    score_lut.built = true;
+    ESP_LOGD(ENA_EXPOSURE_LOG, "built score lookup table");
+}
 
-    score *= ena_exposure_duration_risk_score(config, params);
+/**
+ * @brief get score lookup table of an exposure configuration, built again only if the configuration changed
+ *
+ * The configuration is compared by content, callers scoring many exposures get the table once before.
+ */
+ena_exposure_score_lut_t *ena_exposure_score_lut(ena_exposure_config_t *config)
+{
+    if (!score_lut.built || memcmp(&score_lut.config, config, sizeof(ena_exposure_config_t)) != 0)
+    {
+        ena_exposure_score_lut_build(config);
+    }
+    return &score_lut;
+}
 
-    score *= ena_exposure_days_risk_score(config, params);
+/**
+ * @brief get index of a value in a lookup table, values outside share the first or last entry
+ */
+int ena_exposure_score_lut_index(int value, int size)
+{
+    return value < 0 ? 0 : (value >= size ? size - 1 : value);
+}
 
-    score *= ena_exposure_attenuation_risk_score(config, params);
+/**
+ * @brief calculate overall risk score with the score lookup table of the configuration
+ */
+int ena_exposure_lut_risk_score(ena_exposure_score_lut_t *lut, ena_exposure_parameter_t params)
+{
+    int score = lut->config.transmission_risk_values[params.report_type];
+    score *= lut->duration[ena_exposure_score_lut_index(params.duration, ENA_EXPOSURE_LUT_DURATION)];
+    score *= lut->days[ena_exposure_score_lut_index(params.days, ENA_EXPOSURE_LUT_DAYS)];
+    score *= lut->attenuation[ena_exposure_score_lut_index(params.attenuation, ENA_EXPOSURE_LUT_ATTENUATION)];
 
     if (score > 255)
     {
@@ -210,8 +399,227 @@ int ena_exposure_risk_score(ena_exposure_config_t *config, ena_exposure_paramete
     return score;
 }
 
+int ena_exposure_risk_score(ena_exposure_config_t *config, ena_exposure_parameter_t params)
+{
+    return ena_exposure_lut_risk_score(ena_exposure_score_lut(config), params);
+}
+
+uint16_t ena_exposure_risk_class(ena_exposure_information_t *exposure_info)
+{
+    return (exposure_info->report_type & 0x7) |
+           (ena_exposure_duration_level(exposure_info->duration_minutes) << 3) |
+           (ena_exposure_attenuation_level(exposure_info->typical_attenuation) << 6);
+}
+
+/**
+ * @brief calculate overall risk score of a risk class
+ *
+ * @param[in] lut score lookup table of the exposure configuration used for calculating score
+ * @param[in] risk_class risk class of exposure information, see ena_exposure_risk_class
+ * @param[in] days days since the exposure
+ *
+ * @return
+ *      same as ena_exposure_risk_score for every exposure information of the class
+ */
+int ena_exposure_class_risk_score(ena_exposure_score_lut_t *lut, uint16_t risk_class, int days)
+{
+    int score = lut->config.transmission_risk_values[risk_class & 0x7];
+    score *= lut->config.duration_risk_values[(risk_class >> 3) & 0x7];
+    score *= lut->days[ena_exposure_score_lut_index(days, ENA_EXPOSURE_LUT_DAYS)];
+    score *= lut->config.attenuation_risk_values[(risk_class >> 6) & 0x7];
+
+    if (score > 255)
+    {
+        score = 255;
+    }
+
+    return score;
+}
+
+/**
+ * @brief count exposure information of a risk class in a day of the exposure histogram
+ *
+ * @return
+ *      false if all risk classes of the day are in use
+ */
+bool ena_exposure_histogram_count(ena_storage_exposure_day_t *day, uint16_t risk_class, uint16_t count)
+{
+    ena_storage_exposure_class_t *unused = NULL;
+    for (int i = 0; i < ENA_STORAGE_EXPOSURE_CLASSES; i++)
+    {
+        if (day->classes[i].count > 0 && day->classes[i].risk_class == risk_class)
+        {
+            day->classes[i].count += count;
+            return true;
+        }
+        if (unused == NULL && day->classes[i].count == 0)
+        {
+            unused = &day->classes[i];
+        }
+    }
+    if (unused == NULL)
+    {
+        return false;
+    }
+    unused->risk_class = risk_class;
+    unused->count = count;
+    return true;
+}
+
+bool ena_exposure_histogram_day_used(ena_storage_exposure_day_t *day)
+{
+    for (int i = 0; i < ENA_STORAGE_EXPOSURE_CLASSES; i++)
+    {
+        if (day->classes[i].count > 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief count exposure information in the exposure histogram
+ *
+ * Every UTC day has its own bucket, keys not starting at midnight count to the day they start in. If all are in use,
+ * the oldest day moves to the bucket of older days. With 14 newer days it is at least 14 days ago, so all days in there
+ * share the last days risk.
+ *
+ * @return
+ *      false if the day has too many risk classes or a day would move to the older days too early
+ */
+bool ena_exposure_histogram_add(ena_storage_exposure_histogram_t *histogram, ena_exposure_information_t *exposure_info)
+{
+    ena_storage_exposure_day_t *older = &histogram->days[ENA_STORAGE_EXPOSURE_DAYS];
+    ena_storage_exposure_day_t *day = NULL;
+    ena_storage_exposure_day_t *unused = NULL;
+    ena_storage_exposure_day_t *oldest = NULL;
+    uint32_t day_start = exposure_info->day / ENA_EXPOSURE_DAY_SECONDS * ENA_EXPOSURE_DAY_SECONDS;
+    uint32_t latest = day_start;
+    for (int i = 0; i < ENA_STORAGE_EXPOSURE_DAYS && day == NULL; i++)
+    {
+        ena_storage_exposure_day_t *current = &histogram->days[i];
+        if (!ena_exposure_histogram_day_used(current))
+        {
+            unused = unused == NULL ? current : unused;
+            continue;
+        }
+        if (current->day == day_start)
+        {
+            day = current;
+            continue;
+        }
+        if (oldest == NULL || current->day < oldest->day)
+        {
+            oldest = current;
+        }
+        latest = current->day > latest ? current->day : latest;
+    }
+
+    if (day == NULL && unused != NULL)
+    {
+        day = unused;
+        day->day = day_start;
+    }
+    else if (day == NULL)
+    {
+        // only days beyond the last days risk class share the bucket of older days
+        uint32_t moved = day_start < oldest->day ? day_start : oldest->day;
+        if (latest - moved < ENA_STORAGE_EXPOSURE_DAYS * ENA_EXPOSURE_DAY_SECONDS)
+        {
+            return false;
+        }
+        if (day_start < oldest->day)
+        {
+            day = older;
+        }
+        else
+        {
+            for (int i = 0; i < ENA_STORAGE_EXPOSURE_CLASSES; i++)
+            {
+                if (oldest->classes[i].count > 0 && !ena_exposure_histogram_count(older, oldest->classes[i].risk_class, oldest->classes[i].count))
+                {
+                    return false;
+                }
+            }
+            older->day = oldest->day > older->day ? oldest->day : older->day;
+            memset(oldest, 0, sizeof(ena_storage_exposure_day_t));
+            day = oldest;
+            day->day = day_start;
+        }
+    }
+
+    if (!ena_exposure_histogram_count(day, ena_exposure_risk_class(exposure_info), 1))
+    {
+        return false;
+    }
+    if (day == older && day_start > older->day)
+    {
+        older->day = day_start;
+    }
+    histogram->count++;
+    return true;
+}
+
+void ena_exposure_histogram_load(void)
+{
+    uint32_t count = ena_storage_exposure_information_count();
+    if (exposure_histogram_loaded && exposure_histogram.count == count)
+    {
+        return;
+    }
+
+    exposure_histogram_loaded = true;
+    exposure_histogram_valid = ena_storage_read_exposure_histogram(&exposure_histogram) && exposure_histogram.count == count;
+    // histograms of earlier versions may have days not starting at midnight
+    for (int i = 0; i <= ENA_STORAGE_EXPOSURE_DAYS && exposure_histogram_valid; i++)
+    {
+        exposure_histogram_valid = exposure_histogram.days[i].day % ENA_EXPOSURE_DAY_SECONDS == 0;
+    }
+    if (exposure_histogram_valid)
+    {
+        return;
+    }
+
+    // count stored exposure information once, e.g. after update or erase
+    memset(&exposure_histogram, 0, sizeof(ena_storage_exposure_histogram_t));
+    exposure_histogram_valid = true;
+    ena_exposure_information_t exposure_info;
+    for (uint32_t i = 0; i < count && exposure_histogram_valid; i++)
+    {
+        ena_storage_get_exposure_information(i, &exposure_info);
+        exposure_histogram_valid = ena_exposure_histogram_add(&exposure_histogram, &exposure_info);
+    }
+    if (exposure_histogram_valid)
+    {
+        ena_storage_write_exposure_histogram(&exposure_histogram);
+    }
+    else
+    {
+        ESP_LOGW(ENA_EXPOSURE_LOG, "too many risk classes for exposure histogram, summary reads all exposure information");
+    }
+    exposure_histogram.count = count;
+}
+
+void ena_exposure_add_exposure_information(ena_exposure_information_t *exposure_info)
+{
+    ena_exposure_histogram_load();
+    ena_storage_add_exposure_information(exposure_info);
+    if (exposure_histogram_valid && ena_exposure_histogram_add(&exposure_histogram, exposure_info))
+    {
+        ena_storage_write_exposure_histogram(&exposure_histogram);
+    }
+    else
+    {
+        exposure_histogram_valid = false;
+        exposure_histogram.count = ena_storage_exposure_information_count();
+    }
+}
+
 void ena_exposure_summary(ena_exposure_config_t *config)
 {
+    // configuration is compared once, scores below only look up the table
+    ena_exposure_score_lut_t *lut = ena_exposure_score_lut(config);
     uint32_t count = ena_storage_exposure_information_count();
     uint32_t current_time = (uint32_t)time(NULL);
 
@@ -231,12 +639,46 @@ void ena_exposure_summary(ena_exposure_config_t *config)
         current_summary->days_since_last_exposure = -1;
     }
 
+    ena_exposure_histogram_load();
+    if (exposure_histogram_valid)
+    {
+        // days risk changes with every day, so the days are scored again instead of storing scores
+        for (int i = 0; i <= ENA_STORAGE_EXPOSURE_DAYS; i++)
+        {
+            ena_storage_exposure_day_t *day = &exposure_histogram.days[i];
+            if (!ena_exposure_histogram_day_used(day))
+            {
+                continue;
+            }
+            int days = (current_time - day->day) / ENA_EXPOSURE_DAY_SECONDS; // difference in days
+            if (days < current_summary->days_since_last_exposure)
+            {
+                current_summary->days_since_last_exposure = days;
+            }
+            for (int j = 0; j < ENA_STORAGE_EXPOSURE_CLASSES; j++)
+            {
+                if (day->classes[j].count == 0)
+                {
+                    continue;
+                }
+                int score = ena_exposure_class_risk_score(lut, day->classes[j].risk_class, days);
+                if (score > current_summary->max_risk_score)
+                {
+                    current_summary->max_risk_score = score;
+                }
+                current_summary->risk_score_sum += score * day->classes[j].count;
+            }
+        }
+        return;
+    }
+
     ena_exposure_information_t exposure_info;
     ena_exposure_parameter_t params;
     for (int i = 0; i < count; i++)
     {
         ena_storage_get_exposure_information(i, &exposure_info);
-        params.days = (current_time - exposure_info.day) / (60 * 60 * 24); // difference in days
+        // days since start of the UTC day, same as the days of the exposure histogram
+        params.days = (current_time - exposure_info.day / ENA_EXPOSURE_DAY_SECONDS * ENA_EXPOSURE_DAY_SECONDS) / ENA_EXPOSURE_DAY_SECONDS;
         if (params.days < current_summary->days_since_last_exposure)
         {
             current_summary->days_since_last_exposure = params.days;
@@ -244,7 +686,7 @@ void ena_exposure_summary(ena_exposure_config_t *config)
         params.duration = exposure_info.duration_minutes;
         params.attenuation = exposure_info.typical_attenuation;
         params.report_type = exposure_info.report_type;
-        int score = ena_exposure_risk_score(config, params);
+        int score = ena_exposure_lut_risk_score(lut, params);
         if (score > current_summary->max_risk_score)
         {
             current_summary->max_risk_score = score;
@@ -282,118 +724,748 @@ void ena_exposure_check(ena_beacon_t beacon, ena_temporary_exposure_key_t tempor
         exposure_info.min_attenuation = INT_MAX;
         exposure_info.typical_attenuation = 0;
         exposure_info.report_type = temporary_exposure_key.report_type;
-        uint8_t rpi[ENA_KEY_LENGTH];
-        uint8_t rpik[ENA_KEY_LENGTH];
-        ena_crypto_rpik(rpik, temporary_exposure_key.key_data);
+        uint8_t rpis[ENA_EXPOSURE_RPI_BATCH * ENA_KEY_LENGTH];
+        ena_crypto_key_ctx_t key_ctx;
+        ena_crypto_key_ctx_init(&key_ctx, temporary_exposure_key.key_data);
 
-        for (int i = 0; i < temporary_exposure_key.rolling_period; i++)
+        for (int i = 0; i < temporary_exposure_key.rolling_period; i += ENA_EXPOSURE_RPI_BATCH)
         {
-            ena_crypto_rpi(rpi, rpik, temporary_exposure_key.rolling_start_interval_number + i);
-            if (memcmp(beacon.rpi, rpi, sizeof(ENA_KEY_LENGTH)) == 0)
+            int batch = (temporary_exposure_key.rolling_period - i) < ENA_EXPOSURE_RPI_BATCH ? (temporary_exposure_key.rolling_period - i) : ENA_EXPOSURE_RPI_BATCH;
+            ena_crypto_rpi_range(&key_ctx, temporary_exposure_key.rolling_start_interval_number + i, batch, rpis);
+            for (int j = 0; j < batch; j++)
             {
-                match = true;
-                exposure_info.duration_minutes += ((beacon.timestamp_last - beacon.timestamp_first) / 60);
-                exposure_info.typical_attenuation = (exposure_info.typical_attenuation + beacon.rssi) / 2;
-                if (beacon.rssi < exposure_info.min_attenuation)
+                if (memcmp(beacon.rpi, &rpis[j * ENA_KEY_LENGTH], ENA_KEY_LENGTH) == 0)
                 {
-                    exposure_info.min_attenuation = beacon.rssi;
+                    match = true;
+                    exposure_info.duration_minutes += ((beacon.timestamp_last - beacon.timestamp_first) / 60);
+                    exposure_info.typical_attenuation = (exposure_info.typical_attenuation + beacon.rssi) / 2;
+                    if (beacon.rssi < exposure_info.min_attenuation)
+                    {
+                        exposure_info.min_attenuation = beacon.rssi;
+                    }
                 }
             }
         }
+        ena_crypto_key_ctx_free(&key_ctx);
 
         if (match)
         {
-            ena_storage_add_exposure_information(&exposure_info);
+            ena_exposure_add_exposure_information(&exposure_info);
         }
     }
 }
 
-int ena_expore_check_find_min_rec(int min, int max, uint32_t timestamp)
+int ena_expore_check_find_min(uint32_t timestamp)
+{
+    return ena_storage_beacons_lower_bound(timestamp);
+}
+
+int ena_expore_check_find_max(uint32_t timestamp)
+{
+    return (int)ena_storage_beacons_upper_bound(timestamp) - 1;
+}
+
+void ena_exposure_check_temporary_exposure_key(ena_temporary_exposure_key_t temporary_exposure_key)
 {
+    ena_exposure_check_temporary_exposure_keys(&temporary_exposure_key, 1);
+}
 
-    if (min < 0)
+int ena_exposure_rpi_index_compare(const void *a, const void *b)
+{
+    uint32_t prefix_a = ((ena_exposure_rpi_index_entry_t *)a)->rpi_prefix;
+    uint32_t prefix_b = ((ena_exposure_rpi_index_entry_t *)b)->rpi_prefix;
+    return (prefix_a > prefix_b) - (prefix_a < prefix_b);
+}
+
+uint32_t ena_exposure_rpi_prefix(uint8_t *rpi)
+{
+    uint32_t prefix;
+    memcpy(&prefix, rpi, sizeof(uint32_t));
+    return prefix;
+}
+
+size_t ena_exposure_rpi_index_build(ena_exposure_rpi_index_entry_t *index, uint32_t start, uint32_t end,
+                                    uint32_t timestamp_start, uint32_t timestamp_end,
+                                    uint32_t *index_timestamp_start, uint32_t *index_timestamp_end)
+{
+    ena_beacon_t beacons[ENA_EXPOSURE_READ_BATCH];
+    size_t size = 0;
+    *index_timestamp_start = UINT32_MAX;
+    *index_timestamp_end = 0;
+    uint32_t i = start;
+    while (i < end)
     {
-        return -1;
+        // beacons removed meanwhile are skipped, reading continues at the oldest stored beacon
+        size_t batch = ena_storage_get_beacons_sequence(&i, beacons, (end - i) < ENA_EXPOSURE_READ_BATCH ? (end - i) : ENA_EXPOSURE_READ_BATCH);
+        if (i >= end || batch == 0)
+        {
+            break;
+        }
+        if (batch > end - i)
+        {
+            batch = end - i;
+        }
+        for (int j = 0; j < batch; j++)
+        {
+            if (beacons[j].timestamp_first > timestamp_start && beacons[j].timestamp_last < timestamp_end)
+            {
+                index[size].rpi_prefix = ena_exposure_rpi_prefix(beacons[j].rpi);
+                index[size].sequence = i + j;
+                size++;
+                if (beacons[j].timestamp_first < *index_timestamp_start)
+                {
+                    *index_timestamp_start = beacons[j].timestamp_first;
+                }
+                if (beacons[j].timestamp_last > *index_timestamp_end)
+                {
+                    *index_timestamp_end = beacons[j].timestamp_last;
+                }
+            }
+        }
+        i += batch;
     }
+    qsort(index, size, sizeof(ena_exposure_rpi_index_entry_t), ena_exposure_rpi_index_compare);
+    return size;
+}
 
-    if (min >= max - 1)
+size_t ena_exposure_rpi_index_find(ena_exposure_rpi_index_entry_t *index, size_t size, uint32_t rpi_prefix)
+{
+    size_t min = 0;
+    size_t max = size;
+    while (min < max)
     {
-        return min;
+        size_t mid = min + (max - min) / 2;
+        if (index[mid].rpi_prefix < rpi_prefix)
+        {
+            min = mid + 1;
+        }
+        else
+        {
+            max = mid;
+        }
     }
+    return min;
+}
 
-    ena_beacon_t beacon;
-    int mid = min + (max - min) / 2;
-    ena_storage_get_beacon(min, &beacon);
+size_t ena_exposure_rpi_candidates(ena_storage_bloom_t *bloom, ena_crypto_key_ctx_t *key_ctx, ena_temporary_exposure_key_t *temporary_exposure_key, uint8_t *candidates)
+{
+    uint8_t rpis[ENA_EXPOSURE_RPI_BATCH * ENA_KEY_LENGTH];
+    bool batch_candidates[ENA_EXPOSURE_RPI_BATCH];
+    size_t found = 0;
 
-    if (beacon.timestamp_first < timestamp)
+    memset(candidates, 0, ENA_EXPOSURE_CANDIDATE_BYTES);
+    for (int i = 0; i < temporary_exposure_key->rolling_period; i += ENA_EXPOSURE_RPI_BATCH)
     {
-        return ena_expore_check_find_min_rec(mid, max, timestamp);
+        int batch = (temporary_exposure_key->rolling_period - i) < ENA_EXPOSURE_RPI_BATCH ? (temporary_exposure_key->rolling_period - i) : ENA_EXPOSURE_RPI_BATCH;
+        ena_crypto_rpi_range(key_ctx, temporary_exposure_key->rolling_start_interval_number + i, batch, rpis);
+        if (ena_storage_bloom_check(bloom, rpis, batch, batch_candidates) == 0)
+        {
+            continue;
+        }
+        for (int j = 0; j < batch; j++)
+        {
+            if (batch_candidates[j])
+            {
+                candidates[(i + j) / 8] |= 1 << ((i + j) % 8);
+                found++;
+            }
+        }
     }
-    else if (beacon.timestamp_first > timestamp)
+    return found;
+}
+
+void ena_exposure_add_hit(ena_exposure_core_t *core, uint32_t key, uint32_t sequence, uint8_t *rpi)
+{
+    if (core->hits_count == core->hits_capacity)
     {
-        return ena_expore_check_find_min_rec(min - ((max - min) / 2), mid, timestamp);
+        size_t capacity = core->hits_capacity > 0 ? core->hits_capacity * 2 : 16;
+        ena_exposure_hit_t *hits = realloc(core->hits, capacity * sizeof(ena_exposure_hit_t));
+        if (hits == NULL)
+        {
+            ESP_LOGE(ENA_EXPOSURE_LOG, "Warning %s malloc low memory, hit of key %u lost", __func__, key);
+            return;
+        }
+        core->hits = hits;
+        core->hits_capacity = capacity;
     }
-    else
+    ena_exposure_hit_t *hit = &core->hits[core->hits_count];
+    hit->key = key;
+    hit->sequence = sequence;
+    memcpy(hit->rpi, rpi, ENA_KEY_LENGTH);
+    core->hits_count++;
+}
+
+void ena_exposure_check_rpi_index(ena_exposure_batch_t *batch, ena_exposure_core_t *core, uint32_t key)
+{
+    ena_temporary_exposure_key_t *temporary_exposure_key = &batch->temporary_exposure_keys[key];
+    uint8_t *candidates = &batch->candidates[key * ENA_EXPOSURE_CANDIDATE_BYTES];
+    uint8_t rpi[ENA_KEY_LENGTH];
+
+    for (int i = 0; i < temporary_exposure_key->rolling_period; i++)
     {
-        return min;
+        // only RPIs which might be stored
+        if (!(candidates[i / 8] & (1 << (i % 8))))
+        {
+            continue;
+        }
+        ena_crypto_rpi_range(&batch->key_ctxs[key], temporary_exposure_key->rolling_start_interval_number + i, 1, rpi);
+        uint32_t rpi_prefix = ena_exposure_rpi_prefix(rpi);
+        for (size_t pos = ena_exposure_rpi_index_find(batch->index, batch->size, rpi_prefix); pos < batch->size && batch->index[pos].rpi_prefix == rpi_prefix; pos++)
+        {
+            ena_exposure_add_hit(core, key, batch->index[pos].sequence, rpi);
+        }
     }
 }
 
-int ena_expore_check_find_min(uint32_t timestamp)
+void ena_exposure_check_keys(ena_exposure_batch_t *batch, ena_exposure_core_t *core)
 {
-    return ena_expore_check_find_min_rec(0, (ena_storage_beacons_count() - 1), timestamp);
+    uint32_t start;
+    while ((start = __atomic_fetch_add(&batch->next, ENA_EXPOSURE_CHUNK_KEYS, __ATOMIC_RELAXED)) < batch->count)
+    {
+        uint32_t end = (batch->count - start) < ENA_EXPOSURE_CHUNK_KEYS ? batch->count : start + ENA_EXPOSURE_CHUNK_KEYS;
+        for (uint32_t k = start; k < end; k++)
+        {
+            ena_temporary_exposure_key_t *temporary_exposure_key = &batch->temporary_exposure_keys[k];
+            if (batch->derive)
+            {
+                // derive keys only once per key, reused for every chunk of the index
+                ena_crypto_key_ctx_init(&batch->key_ctxs[k], temporary_exposure_key->key_data);
+                ena_exposure_rpi_candidates(&core->bloom, &batch->key_ctxs[k], temporary_exposure_key, &batch->candidates[k * ENA_EXPOSURE_CANDIDATE_BYTES]);
+            }
+
+            // first pass only filters RPIs, index is built if any RPI passed
+            if (batch->index == NULL)
+            {
+                continue;
+            }
+
+            uint32_t key_start = temporary_exposure_key->rolling_start_interval_number * ENA_TIME_WINDOW;
+            uint32_t key_end = (temporary_exposure_key->rolling_start_interval_number + temporary_exposure_key->rolling_period) * ENA_TIME_WINDOW;
+            // skip keys not overlapping with indexed beacons
+            if (key_end <= batch->index_timestamp_start || key_start >= batch->index_timestamp_end)
+            {
+                continue;
+            }
+            ena_exposure_check_rpi_index(batch, core, k);
+        }
+    }
 }
 
-int ena_expore_check_find_max_rec(int min, int max, int max_max, uint32_t timestamp)
+void ena_exposure_helper_task(void *pvParameter)
 {
-    if (max > max_max)
+    while (1)
     {
-        return -1;
+        xSemaphoreTake(helper_start, portMAX_DELAY);
+        ena_exposure_check_keys(helper_batch, &helper_batch->cores[1]);
+        xSemaphoreGive(helper_done);
     }
+}
+
+void ena_exposure_helper_enable(bool enable)
+{
+    helper_enabled = enable;
+}
 
-    if (max <= (min + 1))
+bool ena_exposure_helper_available(void)
+{
+    if (portNUM_PROCESSORS < 2 || !helper_enabled)
+    {
+        return false;
+    }
+
+    if (helper_mutex == NULL)
     {
-        return max;
+        helper_mutex = xSemaphoreCreateMutex();
+        helper_start = xSemaphoreCreateBinary();
+        helper_done = xSemaphoreCreateBinary();
+        assert(helper_mutex && helper_start && helper_done);
+        // below BLE, timing, beacons and storage, runs on any core, mostly the one without matching worker
+        xTaskCreatePinnedToCore(&ena_exposure_helper_task, "ena_exposure_helper_task", 4096, NULL, ENA_EXPOSURE_HELPER_PRIORITY, NULL, ENA_EXPOSURE_HELPER_CORE);
     }
 
+    // helper is busy with another check, e.g. from a second task
+    return xSemaphoreTake(helper_mutex, 0) == pdTRUE;
+}
+
+void ena_exposure_check_parallel(ena_exposure_batch_t *batch)
+{
+    batch->next = 0;
+    if (batch->count <= ENA_EXPOSURE_CHUNK_KEYS || !ena_exposure_helper_available())
+    {
+        ena_exposure_check_keys(batch, &batch->cores[0]);
+        return;
+    }
+
+    // helper on other core takes chunks of the same keys, both probe the same read-only index and Bloom filter
+    helper_batch = batch;
+    xSemaphoreGive(helper_start);
+    ena_exposure_check_keys(batch, &batch->cores[0]);
+    // helper finishes the chunk it took last
+    xSemaphoreTake(helper_done, portMAX_DELAY);
+    xSemaphoreGive(helper_mutex);
+}
+
+void ena_exposure_check_hits(ena_exposure_batch_t *batch, ena_exposure_information_t *exposure_infos, bool *matches)
+{
+    ena_exposure_core_t *own = &batch->cores[0];
+    ena_exposure_core_t *helper = &batch->cores[1];
+    size_t own_pos = 0;
+    size_t helper_pos = 0;
     ena_beacon_t beacon;
-    int mid = min + (max - min) / 2;
-    ena_storage_get_beacon(max, &beacon);
-    if (beacon.timestamp_first > timestamp)
+
+    // hits of both cores in order of keys, as if checked on one core
+    while (own_pos < own->hits_count || helper_pos < helper->hits_count)
+    {
+        ena_exposure_hit_t *hit;
+        if (helper_pos == helper->hits_count || (own_pos < own->hits_count && own->hits[own_pos].key <= helper->hits[helper_pos].key))
+        {
+            hit = &own->hits[own_pos++];
+        }
+        else
+        {
+            hit = &helper->hits[helper_pos++];
+        }
+
+        ena_temporary_exposure_key_t *temporary_exposure_key = &batch->temporary_exposure_keys[hit->key];
+        uint32_t timestamp_day_start = temporary_exposure_key->rolling_start_interval_number * ENA_TIME_WINDOW;
+        uint32_t timestamp_day_end = (temporary_exposure_key->rolling_start_interval_number + temporary_exposure_key->rolling_period) * ENA_TIME_WINDOW;
+        if (!ena_storage_get_beacon_sequence(hit->sequence, &beacon))
+        {
+            continue;
+        }
+        if (memcmp(beacon.rpi, hit->rpi, ENA_KEY_LENGTH) == 0 && beacon.timestamp_first > timestamp_day_start && beacon.timestamp_last < timestamp_day_end)
+        {
+            ena_exposure_information_t *exposure_info = &exposure_infos[hit->key];
+            matches[hit->key] = true;
+            exposure_info->duration_minutes += ((beacon.timestamp_last - beacon.timestamp_first) / 60);
+            exposure_info->typical_attenuation = (exposure_info->typical_attenuation + beacon.rssi) / 2;
+            if (beacon.rssi < exposure_info->min_attenuation)
+            {
+                exposure_info->min_attenuation = beacon.rssi;
+            }
+        }
+    }
+    own->hits_count = 0;
+    helper->hits_count = 0;
+}
+
+void ena_exposure_stream_add_exposure_information(ena_exposure_information_t *exposure_info)
+{
+    if (stream_exposure_infos_count == stream_exposure_infos_capacity)
     {
-        return ena_expore_check_find_max_rec(min, mid, max_max, timestamp);
+        size_t capacity = stream_exposure_infos_capacity > 0 ? stream_exposure_infos_capacity * 2 : 8;
+        ena_exposure_information_t *exposure_infos = realloc(stream_exposure_infos, capacity * sizeof(ena_exposure_information_t));
+        if (exposure_infos == NULL)
+        {
+            // better store it now than losing it
+            ESP_LOGW(ENA_EXPOSURE_LOG, "Warning %s malloc low memory, store exposure information directly", __func__);
+            ena_exposure_add_exposure_information(exposure_info);
+            return;
+        }
+        stream_exposure_infos = exposure_infos;
+        stream_exposure_infos_capacity = capacity;
     }
-    else if (beacon.timestamp_first < timestamp)
+    memcpy(&stream_exposure_infos[stream_exposure_infos_count], exposure_info, sizeof(ena_exposure_information_t));
+    stream_exposure_infos_count++;
+}
+
+void ena_exposure_check_stream_update(void)
+{
+    // beacons keep their sequence number, only beacons stored since the last update have to be added
+    uint32_t end = ena_storage_beacons_sequence() + ena_storage_beacons_count();
+    if (end <= stream_index_end)
     {
-        return ena_expore_check_find_max_rec(mid, max + ((max - min) / 2), max_max, timestamp);
+        return;
+    }
+
+    ena_exposure_rpi_index_entry_t *index = realloc(stream_index, (stream_index_size + (end - stream_index_end)) * sizeof(ena_exposure_rpi_index_entry_t));
+    if (index == NULL)
+    {
+        // latest beacons are too recent to match keys of a download anyway
+        ESP_LOGW(ENA_EXPOSURE_LOG, "Warning %s malloc low memory, %u new beacons not indexed", __func__, end - stream_index_end);
+        return;
+    }
+    stream_index = index;
+
+    uint32_t index_timestamp_start, index_timestamp_end;
+    size_t size = ena_exposure_rpi_index_build(&stream_index[stream_index_size], stream_index_end, end, 0, UINT32_MAX, &index_timestamp_start, &index_timestamp_end);
+    stream_index_size += size;
+    stream_index_end = end;
+    if (size > 0)
+    {
+        qsort(stream_index, stream_index_size, sizeof(ena_exposure_rpi_index_entry_t), ena_exposure_rpi_index_compare);
+        stream_index_timestamp_start = index_timestamp_start < stream_index_timestamp_start ? index_timestamp_start : stream_index_timestamp_start;
+        stream_index_timestamp_end = index_timestamp_end > stream_index_timestamp_end ? index_timestamp_end : stream_index_timestamp_end;
+    }
+    ESP_LOGD(ENA_EXPOSURE_LOG, "indexed %zu new beacons for stream", size);
+}
+
+void ena_exposure_check_temporary_exposure_keys(ena_temporary_exposure_key_t *temporary_exposure_keys, size_t count)
+{
+    uint32_t beacons_count = ena_storage_beacons_count();
+    if (count == 0 || beacons_count == 0)
+    {
+        return;
+    }
+
+    uint32_t timestamp_start = UINT32_MAX;
+    uint32_t timestamp_end = 0;
+    for (int k = 0; k < count; k++)
+    {
+        // RPIs are only valid for one rolling period
+        if (temporary_exposure_keys[k].rolling_period > ENA_TEK_ROLLING_PERIOD)
+        {
+            temporary_exposure_keys[k].rolling_period = ENA_TEK_ROLLING_PERIOD;
+        }
+        uint32_t key_start = temporary_exposure_keys[k].rolling_start_interval_number * ENA_TIME_WINDOW;
+        uint32_t key_end = (temporary_exposure_keys[k].rolling_start_interval_number + temporary_exposure_keys[k].rolling_period) * ENA_TIME_WINDOW;
+        if (key_start < timestamp_start)
+        {
+            timestamp_start = key_start;
+        }
+        if (key_end > timestamp_end)
+        {
+            timestamp_end = key_end;
+        }
+    }
+
+    // only beacons stored around the time window of the keys can match
+    uint32_t range_start = 0;
+    uint32_t range_end = 0;
+    if (stream_index == NULL)
+    {
+        // bounds are indices, which shift if beacons are removed meanwhile
+        uint32_t sequence;
+        do
+        {
+            sequence = ena_storage_beacons_sequence();
+            range_start = sequence + ena_storage_beacons_lower_bound(timestamp_start > ENA_EXPOSURE_ORDER_TOLERANCE ? timestamp_start - ENA_EXPOSURE_ORDER_TOLERANCE : 0);
+            range_end = sequence + ena_storage_beacons_upper_bound(timestamp_end < UINT32_MAX - ENA_EXPOSURE_ORDER_TOLERANCE ? timestamp_end + ENA_EXPOSURE_ORDER_TOLERANCE : UINT32_MAX);
+        } while (sequence != ena_storage_beacons_sequence());
+        if (range_start >= range_end)
+        {
+            return;
+        }
     }
     else
     {
-        return max;
+        ena_exposure_check_stream_update();
+    }
+
+    ena_crypto_key_ctx_t *key_ctxs = malloc(count * sizeof(ena_crypto_key_ctx_t));
+    uint8_t *candidates = malloc(count * ENA_EXPOSURE_CANDIDATE_BYTES);
+    ena_exposure_information_t *exposure_infos = malloc(count * sizeof(ena_exposure_information_t));
+    bool *matches = calloc(count, sizeof(bool));
+    if (key_ctxs == NULL || candidates == NULL || exposure_infos == NULL || matches == NULL)
+    {
+        ESP_LOGE(ENA_EXPOSURE_LOG, "Failed to allocate memory for checking %zu keys", count);
+        free(key_ctxs);
+        free(candidates);
+        free(exposure_infos);
+        free(matches);
+        return;
+    }
+
+    ena_exposure_batch_t batch = {
+        .derive = true,
+        .temporary_exposure_keys = temporary_exposure_keys,
+        .count = count,
+        .key_ctxs = key_ctxs,
+        .candidates = candidates,
+    };
+    // cores check against the same copy of the Bloom filter, but count their checks separately
+    ena_storage_beacons_bloom_copy(&batch.cores[0].bloom);
+    batch.cores[1].bloom.bits = batch.cores[0].bloom.bits;
+    batch.cores[1].bloom.size = batch.cores[0].bloom.size;
+
+    for (int k = 0; k < count; k++)
+    {
+        exposure_infos[k].day = temporary_exposure_keys[k].rolling_start_interval_number * ENA_TIME_WINDOW;
+        exposure_infos[k].duration_minutes = 0;
+        exposure_infos[k].min_attenuation = INT_MAX;
+        exposure_infos[k].typical_attenuation = 0;
+        exposure_infos[k].report_type = temporary_exposure_keys[k].report_type;
+    }
+
+    // derive keys and filter their RPIs with the Bloom filter of stored beacons, without any index
+    ena_exposure_check_parallel(&batch);
+    batch.derive = false;
+
+    size_t candidates_count = 0;
+    for (size_t i = 0; i < count * ENA_EXPOSURE_CANDIDATE_BYTES; i++)
+    {
+        candidates_count += __builtin_popcount(candidates[i]);
+    }
+    ESP_LOGD(ENA_EXPOSURE_LOG, "%zu RPIs of %zu keys passed Bloom filter", candidates_count, count);
+
+    if (candidates_count > 0 && stream_index != NULL)
+    {
+        // index already built on stream begin
+        batch.index = stream_index;
+        batch.size = stream_index_size;
+        batch.index_timestamp_start = stream_index_timestamp_start;
+        batch.index_timestamp_end = stream_index_timestamp_end;
+        ena_exposure_check_parallel(&batch);
+        ena_exposure_check_hits(&batch, exposure_infos, matches);
+    }
+
+    // index as many beacons as memory allows, fall back to multiple passes over smaller chunks
+    size_t chunk_size = range_end - range_start;
+    ena_exposure_rpi_index_entry_t *index = NULL;
+    while (candidates_count > 0 && stream_index == NULL && index == NULL && chunk_size > 0)
+    {
+        index = malloc(chunk_size * sizeof(ena_exposure_rpi_index_entry_t));
+        if (index == NULL)
+        {
+            chunk_size = chunk_size > ENA_EXPOSURE_READ_BATCH ? chunk_size / 2 : 0;
+        }
     }
+    if (candidates_count > 0 && stream_index == NULL && index == NULL)
+    {
+        ESP_LOGE(ENA_EXPOSURE_LOG, "Failed to allocate memory for checking %zu keys", count);
+    }
+
+    for (uint32_t chunk_start = range_start; index != NULL && chunk_start < range_end; chunk_start += chunk_size)
+    {
+        uint32_t chunk_end = (range_end - chunk_start) < chunk_size ? range_end : (chunk_start + chunk_size);
+        uint32_t index_timestamp_start, index_timestamp_end;
+        size_t size = ena_exposure_rpi_index_build(index, chunk_start, chunk_end, timestamp_start, timestamp_end, &index_timestamp_start, &index_timestamp_end);
+        ESP_LOGD(ENA_EXPOSURE_LOG, "indexed %zu of beacons [%u,%u) for %zu keys", size, chunk_start, chunk_end, count);
+        if (size == 0)
+        {
+            continue;
+        }
+
+        batch.index = index;
+        batch.size = size;
+        batch.index_timestamp_start = index_timestamp_start;
+        batch.index_timestamp_end = index_timestamp_end;
+        ena_exposure_check_parallel(&batch);
+        ena_exposure_check_hits(&batch, exposure_infos, matches);
+    }
+
+    // results of all cores are merged in order of keys
+    batch.cores[0].bloom.lookups += batch.cores[1].bloom.lookups;
+    batch.cores[0].bloom.rejects += batch.cores[1].bloom.rejects;
+    batch.cores[0].bloom.probes += batch.cores[1].bloom.probes;
+    ena_storage_beacons_bloom_release(&batch.cores[0].bloom);
+    free(batch.cores[0].hits);
+    free(batch.cores[1].hits);
+
+    for (int k = 0; k < count; k++)
+    {
+        if (matches[k] && stream_active)
+        {
+            ena_exposure_stream_add_exposure_information(&exposure_infos[k]);
+        }
+        else if (matches[k])
+        {
+            ena_exposure_add_exposure_information(&exposure_infos[k]);
+        }
+        ena_crypto_key_ctx_free(&key_ctxs[k]);
+    }
+
+    free(index);
+    free(key_ctxs);
+    free(candidates);
+    free(exposure_infos);
+    free(matches);
 }
 
-int ena_expore_check_find_max(uint32_t timestamp)
+void ena_exposure_check_stream_begin(void)
 {
-    return ena_expore_check_find_max_rec(0, (ena_storage_beacons_count() - 1), (ena_storage_beacons_count() - 1), timestamp);
+    if (stream_active)
+    {
+        ena_exposure_check_stream_end(false);
+    }
+
+    stream_active = true;
+    stream_exposure_infos_count = 0;
+
+    uint32_t sequence = ena_storage_beacons_sequence();
+    uint32_t beacons_count = ena_storage_beacons_count();
+    // index has room for one entry, so later beacons can be added
+    stream_index = malloc((beacons_count > 0 ? beacons_count : 1) * sizeof(ena_exposure_rpi_index_entry_t));
+    if (stream_index == NULL)
+    {
+        // every key batch builds its own index in chunks
+        ESP_LOGW(ENA_EXPOSURE_LOG, "Warning %s malloc low memory, index %u beacons per key batch", __func__, beacons_count);
+        return;
+    }
+
+    stream_index_size = ena_exposure_rpi_index_build(stream_index, sequence, sequence + beacons_count, 0, UINT32_MAX, &stream_index_timestamp_start, &stream_index_timestamp_end);
+    stream_index_end = sequence + beacons_count;
+    ESP_LOGD(ENA_EXPOSURE_LOG, "indexed %zu beacons for stream", stream_index_size);
 }
 
-void ena_exposure_check_temporary_exposure_key(ena_temporary_exposure_key_t temporary_exposure_key)
+bool ena_exposure_check_stream_active(void)
+{
+    return stream_active;
+}
+
+size_t ena_exposure_check_stream_end(bool store)
+{
+    size_t matches = stream_exposure_infos_count;
+    if (store)
+    {
+        for (size_t i = 0; i < stream_exposure_infos_count; i++)
+        {
+            ena_exposure_add_exposure_information(&stream_exposure_infos[i]);
+        }
+    }
+
+    free(stream_index);
+    free(stream_exposure_infos);
+    stream_index = NULL;
+    stream_index_size = 0;
+    stream_index_end = 0;
+    stream_exposure_infos = NULL;
+    stream_exposure_infos_count = 0;
+    stream_exposure_infos_capacity = 0;
+    stream_active = false;
+    return matches;
+}
+
+void ena_exposure_worker_run(ena_exposure_job_t *job)
+{
+    switch (job->type)
+    {
+    case ENA_EXPOSURE_JOB_BEGIN:
+        worker_stream_start = (uint32_t)time(NULL);
+        worker_stream_keys = 0;
+        ena_exposure_check_stream_begin();
+        break;
+    case ENA_EXPOSURE_JOB_KEYS:
+        ena_exposure_check_temporary_exposure_keys(job->keys, job->count);
+        worker_stream_keys += job->count;
+        break;
+    case ENA_EXPOSURE_JOB_END_STORE:
+    case ENA_EXPOSURE_JOB_END_DISCARD:
+    {
+        size_t matches = ena_exposure_check_stream_end(job->type == ENA_EXPOSURE_JOB_END_STORE);
+        ESP_LOGI(ENA_EXPOSURE_LOG, "check of %zu keys took %u seconds, %zu matches%s", worker_stream_keys,
+                 ((uint32_t)time(NULL) - worker_stream_start), matches, job->type == ENA_EXPOSURE_JOB_END_STORE ? "" : " discarded");
+        break;
+    }
+    case ENA_EXPOSURE_JOB_SUMMARY:
+        ena_exposure_summary(job->config);
+        ESP_LOGD(ENA_EXPOSURE_LOG, "current summary\nlast update: %u\ndays_since_last_exposure: %d\nnum_exposures: %d\nmax_risk_score: %d\nrisk_score_sum: %d",
+                 current_summary->last_update,
+                 current_summary->days_since_last_exposure,
+                 current_summary->num_exposures,
+                 current_summary->max_risk_score,
+                 current_summary->risk_score_sum);
+        break;
+    case ENA_EXPOSURE_JOB_LAST_CHECK:
+        ena_storage_write_last_exposure_date(job->timestamp);
+        if (job->timestamp == worker_last_check)
+        {
+            worker_last_check_pending = false;
+        }
+        break;
+    }
+}
+
+void ena_exposure_worker_task(void *pvParameter)
 {
-    uint32_t timestamp_start = temporary_exposure_key.rolling_start_interval_number * ENA_TIME_WINDOW;
-    uint32_t timestamp_end = (temporary_exposure_key.rolling_start_interval_number + temporary_exposure_key.rolling_period) * ENA_TIME_WINDOW;
+    while (1)
+    {
+        if (xQueueReceive(worker_queue, &worker_job, portMAX_DELAY) == pdTRUE)
+        {
+            ena_exposure_worker_run(&worker_job);
+        }
+    }
+}
 
-    int min = ena_expore_check_find_min(timestamp_start);
-    int max = ena_expore_check_find_max(timestamp_end);
-    if (min == -1 || max == -1)
+void ena_exposure_worker_start(void)
+{
+    if (worker_queue != NULL)
     {
         return;
     }
+    worker_queue = xQueueCreate(ENA_EXPOSURE_WORKER_QUEUE_SIZE, sizeof(ena_exposure_job_t));
+    assert(worker_queue);
+    // keep matching away from BLE and timing on first core
+    xTaskCreatePinnedToCore(&ena_exposure_worker_task, "ena_exposure_worker_task", 8192, NULL, 2, NULL, portNUM_PROCESSORS - 1);
+}
 
-    ena_beacon_t beacon;
-    for (int y = min; y <= max; y++)
+void ena_exposure_worker_send(ena_exposure_job_t *job)
+{
+    if (worker_queue == NULL)
     {
-        ena_storage_get_beacon(y, &beacon);
-        ena_exposure_check(beacon, temporary_exposure_key);
+        ena_exposure_worker_run(job);
+        return;
     }
+    // job is copied to the queue, blocks while worker is behind, slows down producer instead of buffering
+    xQueueSend(worker_queue, job, portMAX_DELAY);
+}
+
+void ena_exposure_worker_producer_lock(void)
+{
+    if (worker_producer_mutex == NULL)
+    {
+        worker_producer_mutex = xSemaphoreCreateMutex();
+        assert(worker_producer_mutex);
+    }
+    xSemaphoreTake(worker_producer_mutex, portMAX_DELAY);
+}
+
+void ena_exposure_worker_producer_unlock(void)
+{
+    xSemaphoreGive(worker_producer_mutex);
+}
+
+void ena_exposure_worker_begin(void)
+{
+    ena_exposure_worker_producer_lock();
+    worker_producer_job.type = ENA_EXPOSURE_JOB_BEGIN;
+    ena_exposure_worker_send(&worker_producer_job);
+    ena_exposure_worker_producer_unlock();
+}
+
+void ena_exposure_worker_check(ena_temporary_exposure_key_t *temporary_exposure_keys, size_t count)
+{
+    // keys of one call stay in order, even with another producer
+    ena_exposure_worker_producer_lock();
+    worker_producer_job.type = ENA_EXPOSURE_JOB_KEYS;
+    for (size_t i = 0; i < count; i += worker_producer_job.count)
+    {
+        worker_producer_job.count = (count - i) < ENA_EXPOSURE_WORKER_BATCH ? (count - i) : ENA_EXPOSURE_WORKER_BATCH;
+        memcpy(worker_producer_job.keys, &temporary_exposure_keys[i], worker_producer_job.count * sizeof(ena_temporary_exposure_key_t));
+        ena_exposure_worker_send(&worker_producer_job);
+    }
+    ena_exposure_worker_producer_unlock();
+}
+
+void ena_exposure_worker_end(bool store)
+{
+    ena_exposure_worker_producer_lock();
+    worker_producer_job.type = store ? ENA_EXPOSURE_JOB_END_STORE : ENA_EXPOSURE_JOB_END_DISCARD;
+    ena_exposure_worker_send(&worker_producer_job);
+    ena_exposure_worker_producer_unlock();
+}
+
+void ena_exposure_worker_summary(ena_exposure_config_t *config)
+{
+    ena_exposure_worker_producer_lock();
+    worker_producer_job.type = ENA_EXPOSURE_JOB_SUMMARY;
+    worker_producer_job.config = config;
+    ena_exposure_worker_send(&worker_producer_job);
+    ena_exposure_worker_producer_unlock();
+}
+
+void ena_exposure_worker_last_check(uint32_t timestamp)
+{
+    ena_exposure_worker_producer_lock();
+    worker_producer_job.type = ENA_EXPOSURE_JOB_LAST_CHECK;
+    worker_producer_job.timestamp = timestamp;
+    worker_last_check = timestamp;
+    worker_last_check_pending = true;
+    ena_exposure_worker_send(&worker_producer_job);
+    ena_exposure_worker_producer_unlock();
+}
+
+uint32_t ena_exposure_worker_last_check_date(void)
+{
+    return worker_last_check_pending ? worker_last_check : ena_storage_read_last_exposure_date();
 }
@@ -14,6 +14,7 @@
 #include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
 #include "esp_partition.h"
 
@@ -21,25 +22,459 @@
 #include "ena-crypto.h"
 
 #define BLOCK_SIZE (4096)
+#define BEACONS_PER_BLOCK ((BLOCK_SIZE - sizeof(uint32_t)) / sizeof(ena_storage_beacon_record_t)) // beacons never span two blocks, last word of a block is its erase counter
+#define BEACONS_BUCKET_SECONDS (60 * 60 * 24)                                                     // UTC day of a bucket, keys start at rolling_start_interval_number of a day
+#define BEACON_RECORD_OFFSET_BITS (18)                                                           // bits for seconds of first reception since start of the day before the bucket day
+#define BEACON_RECORD_DURATION_MAX ((1u << (32 - BEACON_RECORD_OFFSET_BITS)) - 1)                 // max. seconds between first and last reception, longer beacons are not stored
+#define META_SECTOR_RECORDS ((BLOCK_SIZE - sizeof(uint32_t)) / sizeof(ena_storage_meta_record_t)) // metadata records per pool sector, first word of a sector is its erase counter
+#define EXPOSURE_INFORMATION_BLOCKS ((sizeof(ena_exposure_information_t) * ENA_STORAGE_EXPOSURE_INFORMATION_MAX + BLOCK_SIZE - 1) / BLOCK_SIZE)
+#define TEMP_BEACONS_BLOCKS ((sizeof(ena_beacon_t) * ENA_STORAGE_TEMP_BEACONS_MAX + BLOCK_SIZE - 1) / BLOCK_SIZE) // blocks of each of the two temporary beacon slots
+#define EXPOSURE_HISTOGRAM_BLOCKS ((sizeof(ena_storage_exposure_histogram_t) + BLOCK_SIZE - 1) / BLOCK_SIZE)   // blocks of each of the two exposure histogram slots
+#define FIXED_SECTORS (EXPOSURE_INFORMATION_BLOCKS + 2 * TEMP_BEACONS_BLOCKS + 2 * EXPOSURE_HISTOGRAM_BLOCKS)
+#define TEMP_BEACONS_CHUNK (16) // temporary beacons read at once when compacting
+
+/**
+ * @brief compact record of a beacon in the beacon log
+ *
+ * Timestamps are stored relative to the day of the bucket, late beacons of the day before still fit. Older beacons or
+ * beacons received longer than BEACON_RECORD_DURATION_MAX do not fit and are not stored.
+ */
+typedef struct __attribute__((__packed__))
+{
+    uint8_t rpi[ENA_KEY_LENGTH];          // received RPI of beacon
+    uint8_t aem[ENA_AEM_METADATA_LENGTH]; // received AEM of beacon
+    uint32_t time;                        // offset of first reception in low bits, duration of reception in high bits
+    int8_t rssi;                          // average measured RSSI
+} ena_storage_beacon_record_t;
+
+/**
+ * @brief directory of the day buckets of the beacon log
+ *
+ * Buckets form a ring in order of day, every bucket starts at a new block of the beacon log.
+ */
+typedef struct __attribute__((__packed__))
+{
+    uint32_t head;      // index of the oldest bucket
+    uint32_t used;      // number of buckets in use
+    uint32_t next_slot; // slot for the next bucket if no bucket is in use
+    ena_storage_beacon_bucket_t buckets[ENA_STORAGE_BEACON_BUCKETS_MAX];
+} ena_storage_beacon_directory_t;
+
+/**
+ * @brief frequently updated metadata
+ *
+ * Kept in RAM and appended as a new record to a pool of sectors on flush, so no sector is erased on every update.
+ */
+typedef struct __attribute__((__packed__))
+{
+    uint32_t version;                                // version of storage layout
+    uint32_t last_exposure_date;                     // timestamp of most recent exposure data
+    uint32_t tek_count;                              // number of TEKs ever stored
+    ena_tek_t teks[ENA_STORAGE_TEK_MAX];             // ring of the latest TEKs
+    uint32_t exposure_information_count;             // number of stored exposure information
+    uint32_t temp_beacons_count;                     // number of temporary beacons
+    uint32_t temp_beacons_slot;                      // slot of the temporary beacons, a checkpoint is written to the other one
+    uint32_t temp_beacons_crc;                       // CRC of the last checkpoint of temporary beacons
+    uint32_t exposure_histogram_slot;                // slot of the exposure histogram, an update is written to the other one
+    uint32_t exposure_histogram_crc;                 // CRC of the exposure histogram
+    uint32_t fixed_erases[FIXED_SECTORS];            // erase counts of the sectors of exposure information, temporary beacons and exposure histogram
+    ena_storage_beacon_directory_t beacon_directory; // day buckets of the beacon log
+} ena_storage_meta_t;
+
+/**
+ * @brief record of metadata in the pool, the valid one with the highest sequence is the current one
+ *
+ * A record is written with one program operation, all changes since the last commit take effect at once.
+ */
+typedef struct __attribute__((__packed__))
+{
+    uint32_t sequence; // increased on every commit, erased flash reads 0xFFFFFFFF
+    uint32_t crc;      // CRC of sequence and data, a torn record does not match
+    ena_storage_meta_t data;
+} ena_storage_meta_record_t;
+
+// a commit appends to the current pool sector, it has to hold at least two records to be written before its erase
+_Static_assert(META_SECTOR_RECORDS >= 2, "metadata record too large for a pool sector, lower max. TEKs, exposure information, temporary beacons or clean-up threshold");
+
+// metadata pool, exposure information and both slots of temporary beacons and exposure histogram start at block boundaries
+const int ENA_STORAGE_META_START_ADDRESS = ((ENA_STORAGE_START_ADDRESS + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE);
+const int ENA_STORAGE_EXPOSURE_INFORMATION_START_ADDRESS = (ENA_STORAGE_META_START_ADDRESS + ENA_STORAGE_META_SECTORS * BLOCK_SIZE);
+const int ENA_STORAGE_TEMP_BEACONS_START_ADDRESS = (ENA_STORAGE_EXPOSURE_INFORMATION_START_ADDRESS + EXPOSURE_INFORMATION_BLOCKS * BLOCK_SIZE);
+const int ENA_STORAGE_EXPOSURE_HISTOGRAM_START_ADDRESS = (ENA_STORAGE_TEMP_BEACONS_START_ADDRESS + 2 * TEMP_BEACONS_BLOCKS * BLOCK_SIZE);
+// beacon log starts at next block
+const int ENA_STORAGE_BEACONS_START_ADDRESS = (ENA_STORAGE_EXPOSURE_HISTOGRAM_START_ADDRESS + 2 * EXPOSURE_HISTOGRAM_BLOCKS * BLOCK_SIZE);
+
+/**
+ * @brief cached sector of the partition
+ */
+typedef struct
+{
+    int block_num;       // number of cached block, -1 if unused
+    bool dirty;          // cached data differs from flash
+    bool erase_required; // written data sets bits, block has to be erased before programming
+    size_t dirty_start;  // start of modified range inside block
+    size_t dirty_end;    // end of modified range inside block
+    uint32_t last_used;  // access counter for LRU eviction
+    uint8_t *data;       // content of block
+} ena_storage_cache_t;
+
+static ena_storage_cache_t storage_cache[ENA_STORAGE_CACHE_BLOCKS] = {[0 ... ENA_STORAGE_CACHE_BLOCKS - 1] = {.block_num = -1}};
+static uint32_t storage_cache_counter = 0;
+static SemaphoreHandle_t storage_mutex = NULL;
+static ena_storage_meta_record_t meta;   // latest metadata, committed to the pool on flush
+static bool meta_loaded = false;
+static bool meta_dirty = false;          // metadata changed since last commit
+static uint32_t meta_sector = 0;         // pool sector of the latest record
+static uint32_t meta_next = 0;           // index of the next record in the pool sector
+static bool exposure_histogram_pending = false; // exposure histogram written to a slot not committed yet
+static bool temp_beacons_pending = false;       // temporary beacons written to a slot not committed yet
+static uint32_t *beacons_fences = NULL; // timestamp_first of first beacon of every block in beacon log
+static uint32_t *beacons_bloom = NULL;  // Bloom filter over RPIs of stored beacons
+static uint32_t beacons_sequence = 0;   // sequence number of the oldest stored beacon, increased by every removed beacon
+static ena_storage_bloom_stats_t beacons_bloom_stats = {.hashes = ENA_STORAGE_BLOOM_HASHES};
+
+const esp_partition_t *ena_storage_partition(void)
+{
+    static const esp_partition_t *partition = NULL;
+    if (partition == NULL)
+    {
+        partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, ENA_STORAGE_PARTITION_NAME);
+        assert(partition);
+    }
+    return partition;
+}
+
+void ena_storage_lock(void)
+{
+    if (storage_mutex == NULL)
+    {
+        storage_mutex = xSemaphoreCreateRecursiveMutex();
+        assert(storage_mutex);
+    }
+    xSemaphoreTakeRecursive(storage_mutex, portMAX_DELAY);
+}
+
+void ena_storage_unlock(void)
+{
+    xSemaphoreGiveRecursive(storage_mutex);
+}
+
+uint32_t ena_storage_crc32(uint32_t crc, const void *data, size_t size)
+{
+    const uint8_t *bytes = data;
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+    {
+        crc ^= bytes[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+size_t ena_storage_meta_address(uint32_t sector, uint32_t index)
+{
+    return ENA_STORAGE_META_START_ADDRESS + sector * BLOCK_SIZE + sizeof(uint32_t) + index * sizeof(ena_storage_meta_record_t);
+}
+
+/**
+ * @brief check if data reads as erased flash
+ */
+bool ena_storage_is_erased(const void *data, size_t size)
+{
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < size; i++)
+    {
+        if (bytes[i] != 0xFF)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief calculate the CRC of a metadata record
+ */
+uint32_t ena_storage_meta_crc(ena_storage_meta_record_t *record)
+{
+    uint32_t crc = ena_storage_crc32(0, &record->sequence, sizeof(uint32_t));
+    return ena_storage_crc32(crc, &record->data, sizeof(ena_storage_meta_t));
+}
+
+/**
+ * @brief load the valid metadata record with the highest sequence
+ *
+ * A record torn by a power loss fails its CRC and the previous record is used. The next commit then continues in a
+ * freshly erased pool sector, as the rest of the current one may not be erased anymore.
+ */
+void ena_storage_meta_load(void)
+{
+    if (meta_loaded)
+    {
+        return;
+    }
+
+    const esp_partition_t *partition = ena_storage_partition();
+    bool found = false;
+    bool torn = false;
+    uint32_t sequence = 0;
+    for (uint32_t sector = 0; sector < ENA_STORAGE_META_SECTORS; sector++)
+    {
+        for (uint32_t i = 0; i < META_SECTOR_RECORDS; i++)
+        {
+            // every record is checked, the RAM copy serves as buffer until the current one is known
+            ESP_ERROR_CHECK(esp_partition_read(partition, ena_storage_meta_address(sector, i), &meta, sizeof(ena_storage_meta_record_t)));
+            // records are appended, rest of the sector is erased
+            if (ena_storage_is_erased(&meta, sizeof(ena_storage_meta_record_t)))
+            {
+                break;
+            }
+            if (meta.crc != ena_storage_meta_crc(&meta))
+            {
+                ESP_LOGW(ENA_STORAGE_LOG, "torn metadata record %u in pool sector %u", i, sector);
+                torn = true;
+                continue;
+            }
+            if (!found || meta.sequence > sequence)
+            {
+                found = true;
+                sequence = meta.sequence;
+                meta_sector = sector;
+                meta_next = i + 1;
+            }
+        }
+    }
+
+    if (found)
+    {
+        ESP_ERROR_CHECK(esp_partition_read(partition, ena_storage_meta_address(meta_sector, meta_next - 1), &meta, sizeof(ena_storage_meta_record_t)));
+        if (torn)
+        {
+            meta_next = META_SECTOR_RECORDS;
+        }
+        ESP_LOGD(ENA_STORAGE_LOG, "loaded metadata %u from pool sector %u", meta.sequence, meta_sector);
+    }
+    else
+    {
+        // no metadata at all, version 0 requires to erase the storage
+        memset(&meta, 0, sizeof(ena_storage_meta_record_t));
+        meta_sector = ENA_STORAGE_META_SECTORS - 1;
+        meta_next = META_SECTOR_RECORDS;
+        ESP_LOGI(ENA_STORAGE_LOG, "no metadata found");
+    }
+    meta_loaded = true;
+    meta_dirty = false;
+}
+
+/**
+ * @brief get offset of the erase counter inside a sector
+ *
+ * @return
+ *      offset of the counter, -1 if the erase count of the sector is kept in the metadata
+ */
+int ena_storage_erase_counter_offset(uint32_t sector)
+{
+    size_t address = sector * BLOCK_SIZE;
+    if (address >= ENA_STORAGE_BEACONS_START_ADDRESS)
+    {
+        return BLOCK_SIZE - sizeof(uint32_t);
+    }
+    if (address >= ENA_STORAGE_META_START_ADDRESS && address < ENA_STORAGE_EXPOSURE_INFORMATION_START_ADDRESS)
+    {
+        return 0;
+    }
+    return -1;
+}
+
+uint32_t ena_storage_sector_erases(uint32_t sector)
+{
+    size_t address = sector * BLOCK_SIZE;
+    int offset = ena_storage_erase_counter_offset(sector);
+    if (offset >= 0)
+    {
+        uint32_t counter = 0;
+        ESP_ERROR_CHECK(esp_partition_read(ena_storage_partition(), address + offset, &counter, sizeof(uint32_t)));
+        // stored inverted, so erased flash counts zero
+        return ~counter;
+    }
+    if (address >= ENA_STORAGE_EXPOSURE_INFORMATION_START_ADDRESS)
+    {
+        ena_storage_lock();
+        ena_storage_meta_load();
+        uint32_t erases = meta.data.fixed_erases[(address - ENA_STORAGE_EXPOSURE_INFORMATION_START_ADDRESS) / BLOCK_SIZE];
+        ena_storage_unlock();
+        return erases;
+    }
+    return 0;
+}
+
+/**
+ * @brief erase a sector and count the erase
+ *
+ * Sectors of the metadata pool and of the beacon log keep their erase count in the sector itself,
+ * the counts of the other sectors are kept in the metadata.
+ *
+ * @param[in] sector number of the sector in the partition
+ * @param[in] data content of the sector to program after erase, NULL to leave it erased
+ */
+void ena_storage_erase_sector(uint32_t sector, uint8_t *data)
+{
+    const esp_partition_t *partition = ena_storage_partition();
+    const size_t address = sector * BLOCK_SIZE;
+    int offset = ena_storage_erase_counter_offset(sector);
+    uint32_t erases = ena_storage_sector_erases(sector) + 1;
+    ESP_ERROR_CHECK(esp_partition_erase_range(partition, address, BLOCK_SIZE));
+    if (offset >= 0)
+    {
+        uint32_t counter = ~erases;
+        if (data != NULL)
+        {
+            memcpy(data + offset, &counter, sizeof(uint32_t));
+        }
+        else
+        {
+            ESP_ERROR_CHECK(esp_partition_write(partition, address + offset, &counter, sizeof(uint32_t)));
+        }
+    }
+    else if (address >= ENA_STORAGE_EXPOSURE_INFORMATION_START_ADDRESS)
+    {
+        meta.data.fixed_erases[(address - ENA_STORAGE_EXPOSURE_INFORMATION_START_ADDRESS) / BLOCK_SIZE] = erases;
+        meta_dirty = true;
+    }
+    if (data != NULL)
+    {
+        ESP_ERROR_CHECK(esp_partition_write(partition, address, data, BLOCK_SIZE));
+    }
+}
+
+void ena_storage_meta_commit(void)
+{
+    if (!meta_dirty)
+    {
+        return;
+    }
+
+    // continue in next pool sector, which holds the oldest records
+    if (meta_next >= META_SECTOR_RECORDS)
+    {
+        meta_sector = (meta_sector + 1) % ENA_STORAGE_META_SECTORS;
+        meta_next = 0;
+        ena_storage_erase_sector(ENA_STORAGE_META_START_ADDRESS / BLOCK_SIZE + meta_sector, NULL);
+    }
+    meta.sequence++;
+    meta.crc = ena_storage_meta_crc(&meta);
+    ESP_ERROR_CHECK(esp_partition_write(ena_storage_partition(), ena_storage_meta_address(meta_sector, meta_next), &meta, sizeof(ena_storage_meta_record_t)));
+    meta_next++;
+    meta_dirty = false;
+    exposure_histogram_pending = false;
+    temp_beacons_pending = false;
+    ESP_LOGD(ENA_STORAGE_LOG, "committed metadata %u to pool sector %u", meta.sequence, meta_sector);
+}
+
+void ena_storage_cache_write_back(ena_storage_cache_t *cache)
+{
+    if (cache->block_num < 0 || !cache->dirty)
+    {
+        return;
+    }
+
+    const esp_partition_t *partition = ena_storage_partition();
+    const size_t block_start = cache->block_num * BLOCK_SIZE;
+    if (cache->erase_required)
+    {
+        ESP_LOGD(ENA_STORAGE_LOG, "write back block %d with erase", cache->block_num);
+        ena_storage_erase_sector(cache->block_num, cache->data);
+    }
+    else
+    {
+        // only bits cleared, program modified range without erase
+        ESP_LOGD(ENA_STORAGE_LOG, "write back block %d from %zu to %zu", cache->block_num, cache->dirty_start, cache->dirty_end);
+        ESP_ERROR_CHECK(esp_partition_write(partition, block_start + cache->dirty_start, cache->data + cache->dirty_start, cache->dirty_end - cache->dirty_start));
+    }
+    cache->dirty = false;
+    cache->erase_required = false;
+}
+
+void ena_storage_cache_drop(bool write_back)
+{
+    for (int i = 0; i < ENA_STORAGE_CACHE_BLOCKS; i++)
+    {
+        if (write_back)
+        {
+            ena_storage_cache_write_back(&storage_cache[i]);
+        }
+        storage_cache[i].block_num = -1;
+        storage_cache[i].dirty = false;
+        storage_cache[i].erase_required = false;
+    }
+}
 
-const int ENA_STORAGE_LAST_EXPOSURE_DATE_ADDRESS = (ENA_STORAGE_START_ADDRESS);
-const int ENA_STORAGE_TEK_COUNT_ADDRESS = (ENA_STORAGE_LAST_EXPOSURE_DATE_ADDRESS + sizeof(uint32_t));
-const int ENA_STORAGE_TEK_START_ADDRESS = (ENA_STORAGE_TEK_COUNT_ADDRESS + sizeof(uint32_t));
-const int ENA_STORAGE_EXPOSURE_INFORMATION_COUNT_ADDRESS = (ENA_STORAGE_TEK_START_ADDRESS + sizeof(ena_tek_t) * ENA_STORAGE_TEK_MAX);
-const int ENA_STORAGE_EXPOSURE_INFORMATION_START_ADDRESS = (ENA_STORAGE_EXPOSURE_INFORMATION_COUNT_ADDRESS + sizeof(uint32_t));
-const int ENA_STORAGE_TEMP_BEACONS_COUNT_ADDRESS = (ENA_STORAGE_EXPOSURE_INFORMATION_COUNT_ADDRESS + sizeof(ena_exposure_information_t) * ENA_STORAGE_EXPOSURE_INFORMATION_MAX);
-const int ENA_STORAGE_TEMP_BEACONS_START_ADDRESS = (ENA_STORAGE_TEMP_BEACONS_COUNT_ADDRESS + sizeof(uint32_t));
-const int ENA_STORAGE_BEACONS_COUNT_ADDRESS = (ENA_STORAGE_TEMP_BEACONS_START_ADDRESS + sizeof(ena_beacon_t) * ENA_STORAGE_TEMP_BEACONS_MAX);
-const int ENA_STORAGE_BEACONS_START_ADDRESS = (ENA_STORAGE_BEACONS_COUNT_ADDRESS + sizeof(uint32_t));
+ena_storage_cache_t *ena_storage_cache_get(int block_num)
+{
+    ena_storage_cache_t *cache = NULL;
+    for (int i = 0; i < ENA_STORAGE_CACHE_BLOCKS; i++)
+    {
+        if (storage_cache[i].block_num == block_num)
+        {
+            cache = &storage_cache[i];
+            cache->last_used = ++storage_cache_counter;
+            return cache;
+        }
+        // prefer unused block, otherwise least recently used
+        if (cache == NULL || (cache->block_num >= 0 && (storage_cache[i].block_num < 0 || storage_cache[i].last_used < cache->last_used)))
+        {
+            cache = &storage_cache[i];
+        }
+    }
+
+    ena_storage_cache_write_back(cache);
+    cache->block_num = -1;
+
+    if (cache->data == NULL)
+    {
+        cache->data = malloc(BLOCK_SIZE);
+        if (cache->data == NULL)
+        {
+            ESP_LOGE(ENA_STORAGE_LOG, "Warning %s malloc low memory", "cache");
+            return NULL;
+        }
+    }
+
+    ESP_ERROR_CHECK(esp_partition_read(ena_storage_partition(), block_num * BLOCK_SIZE, cache->data, BLOCK_SIZE));
+    vTaskDelay(1);
+    cache->block_num = block_num;
+    cache->dirty = false;
+    cache->erase_required = false;
+    cache->last_used = ++storage_cache_counter;
+    ESP_LOGD(ENA_STORAGE_LOG, "cached block %d", block_num);
+    return cache;
+}
 
 void ena_storage_read(size_t address, void *data, size_t size)
 {
-    const esp_partition_t *partition = esp_partition_find_first(
-        ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, ENA_STORAGE_PARTITION_NAME);
-    assert(partition);
-    ESP_ERROR_CHECK(esp_partition_read(partition, address, data, size));
+    ena_storage_lock();
+    ESP_ERROR_CHECK(esp_partition_read(ena_storage_partition(), address, data, size));
     vTaskDelay(1);
-    ESP_LOGD(ENA_STORAGE_LOG, "read data at %u", address);
+    // cached blocks are more recent than flash
+    for (int i = 0; i < ENA_STORAGE_CACHE_BLOCKS; i++)
+    {
+        if (storage_cache[i].block_num < 0 || !storage_cache[i].dirty)
+        {
+            continue;
+        }
+        size_t block_start = storage_cache[i].block_num * BLOCK_SIZE;
+        size_t start = address > block_start ? address : block_start;
+        size_t end = (address + size) < (block_start + BLOCK_SIZE) ? (address + size) : (block_start + BLOCK_SIZE);
+        if (start < end)
+        {
+            memcpy(((uint8_t *)data) + (start - address), storage_cache[i].data + (start - block_start), end - start);
+        }
+    }
+    ena_storage_unlock();
+    ESP_LOGD(ENA_STORAGE_LOG, "read data at %zu", address);
     ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, data, size, ESP_LOG_DEBUG);
 }
 
@@ -49,325 +484,1195 @@ void ena_storage_write(size_t address, void *data, size_t size)
     // check for overflow
     if (address + size <= (block_num + 1) * BLOCK_SIZE)
     {
-        const esp_partition_t *partition = esp_partition_find_first(
-            ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, ENA_STORAGE_PARTITION_NAME);
-        assert(partition);
-        const int block_start = block_num * BLOCK_SIZE;
-        const int block_address = address - block_start;
-        void *buffer = malloc(BLOCK_SIZE);
-        if (buffer == NULL)
+        ena_storage_lock();
+        ena_storage_cache_t *cache = ena_storage_cache_get(block_num);
+        if (cache == NULL)
         {
-            ESP_LOGE(ENA_STORAGE_LOG, "Warning %s malloc low memory", "buffer");
+            ena_storage_unlock();
             return;
         }
-        ESP_LOGD(ENA_STORAGE_LOG, "read block %d buffer: start %d size %u", block_num, block_start, BLOCK_SIZE);
-        ESP_ERROR_CHECK(esp_partition_read(partition, block_start, buffer, BLOCK_SIZE));
-        vTaskDelay(1);
-        ESP_ERROR_CHECK(esp_partition_erase_range(partition, block_start, BLOCK_SIZE));
+        const size_t block_address = address - block_num * BLOCK_SIZE;
+        uint8_t *cached = cache->data + block_address;
+        uint8_t *bytes = data;
 
-        memcpy((buffer + block_address), data, size);
+        if (memcmp(cached, bytes, size) != 0)
+        {
+            // flash can only clear bits without erase
+            for (int i = 0; i < size && !cache->erase_required; i++)
+            {
+                cache->erase_required = (cached[i] & bytes[i]) != bytes[i];
+            }
+            memcpy(cached, bytes, size);
 
-        ESP_ERROR_CHECK(esp_partition_write(partition, block_start, buffer, BLOCK_SIZE));
-        free(buffer);
-        ESP_LOGD(ENA_STORAGE_LOG, "write data at %u", address);
+            if (!cache->dirty)
+            {
+                cache->dirty = true;
+                cache->dirty_start = block_address;
+                cache->dirty_end = block_address + size;
+            }
+            else
+            {
+                cache->dirty_start = block_address < cache->dirty_start ? block_address : cache->dirty_start;
+                cache->dirty_end = (block_address + size) > cache->dirty_end ? (block_address + size) : cache->dirty_end;
+            }
+        }
+        ena_storage_unlock();
+        ESP_LOGD(ENA_STORAGE_LOG, "write data at %zu", address);
         ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, data, size, ESP_LOG_DEBUG);
     }
     else
     {
-        ESP_LOGD(ENA_STORAGE_LOG, "overflow block at address %u with size %d (block %d)", address, size, block_num);
+        ESP_LOGD(ENA_STORAGE_LOG, "overflow block at address %zu with size %zu (block %d)", address, size, block_num);
         const size_t block2_address = (block_num + 1) * BLOCK_SIZE;
         const size_t data2_size = address + size - block2_address;
         const size_t data1_size = size - data2_size;
-        ESP_LOGD(ENA_STORAGE_LOG, "block1_address %d, block1_size %d (block %d)", address, data1_size, block_num);
-        ESP_LOGD(ENA_STORAGE_LOG, "block2_address %d, block2_size %d (block %d)", block2_address, data2_size, block_num + 1);
-        void *data1 = malloc(data1_size);
-        memcpy(data1, data, data1_size);
-        ena_storage_write(address, data1, data1_size);
-        free(data1);
+        ESP_LOGD(ENA_STORAGE_LOG, "block1_address %zu, block1_size %zu (block %d)", address, data1_size, block_num);
+        ESP_LOGD(ENA_STORAGE_LOG, "block2_address %zu, block2_size %zu (block %d)", block2_address, data2_size, block_num + 1);
+        ena_storage_write(address, data, data1_size);
+        ena_storage_write(block2_address, (data + data1_size), data2_size);
+    }
+}
 
-        void *data2 = malloc(data2_size);
-        memcpy(data2, (data + data1_size), data2_size);
-        ena_storage_write(block2_address, data2, data2_size);
-        free(data2);
+void ena_storage_flush(void)
+{
+    ena_storage_lock();
+    for (int i = 0; i < ENA_STORAGE_CACHE_BLOCKS; i++)
+    {
+        ena_storage_cache_write_back(&storage_cache[i]);
+    }
+    // metadata last, it never refers to data not written yet
+    ena_storage_meta_commit();
+    ena_storage_unlock();
+    ESP_LOGD(ENA_STORAGE_LOG, "flushed cache");
+}
+
+void ena_storage_erase_block(size_t address)
+{
+    const int block_num = address / BLOCK_SIZE;
+    ena_storage_lock();
+    // content is gone, no need to write back
+    for (int i = 0; i < ENA_STORAGE_CACHE_BLOCKS; i++)
+    {
+        if (storage_cache[i].block_num == block_num)
+        {
+            storage_cache[i].block_num = -1;
+            storage_cache[i].dirty = false;
+            storage_cache[i].erase_required = false;
+        }
+    }
+    ena_storage_erase_sector(block_num, NULL);
+    ena_storage_unlock();
+    ESP_LOGD(ENA_STORAGE_LOG, "erased block %d", block_num);
+}
+
+void ena_storage_erase(size_t address, size_t size)
+{
+    const int block_num = address / BLOCK_SIZE;
+    // check for overflow
+    if (address + size <= (block_num + 1) * BLOCK_SIZE)
+    {
+        uint8_t *zeros = calloc(size, sizeof(uint8_t));
+        ena_storage_write(address, zeros, size);
+        free(zeros);
+    }
+    else
+    {
+        const size_t block2_address = (block_num + 1) * BLOCK_SIZE;
+        const size_t data2_size = address + size - block2_address;
+        const size_t data1_size = size - data2_size;
+        uint8_t *zeros = calloc(data1_size, sizeof(uint8_t));
+        ena_storage_write(address, zeros, data1_size);
+        free(zeros);
+        ena_storage_erase(block2_address, data2_size);
+    }
+}
+
+uint32_t ena_storage_read_version(void)
+{
+    ena_storage_lock();
+    ena_storage_meta_load();
+    uint32_t version = meta.data.version;
+    ena_storage_unlock();
+    return version;
+}
+
+uint32_t ena_storage_read_last_exposure_date(void)
+{
+    ena_storage_lock();
+    ena_storage_meta_load();
+    uint32_t timestamp = meta.data.last_exposure_date;
+    ena_storage_unlock();
+    return timestamp;
+}
+
+void ena_storage_write_last_exposure_date(uint32_t timestamp)
+{
+    ena_storage_lock();
+    ena_storage_meta_load();
+    meta.data.last_exposure_date = timestamp;
+    meta_dirty = true;
+    ena_storage_unlock();
+}
+
+uint32_t ena_storage_tek_count(void)
+{
+    ena_storage_lock();
+    ena_storage_meta_load();
+    uint32_t count = meta.data.tek_count;
+    ena_storage_unlock();
+    ESP_LOGD(ENA_STORAGE_LOG, "read TEK count: %u", count);
+    return count;
+}
+
+uint32_t ena_storage_read_last_tek(ena_tek_t *tek)
+{
+    uint32_t tek_count = ena_storage_tek_count();
+    if (tek_count < 1)
+    {
+        return 0;
+    }
+    ena_storage_get_tek((tek_count - 1) % ENA_STORAGE_TEK_MAX, tek);
+
+    ESP_LOGD(ENA_STORAGE_LOG, "read last tek %u:", tek->enin);
+    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, tek->key_data, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
+    return tek_count;
+}
+
+void ena_storage_get_tek(uint32_t index, ena_tek_t *tek)
+{
+    ena_storage_lock();
+    ena_storage_meta_load();
+    *tek = meta.data.teks[index % ENA_STORAGE_TEK_MAX];
+    ena_storage_unlock();
+    ESP_LOGD(ENA_STORAGE_LOG, "read %d tek %u:", index, tek->enin);
+    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, tek->key_data, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
+}
+
+void ena_storage_write_tek(ena_tek_t *tek)
+{
+    ena_storage_lock();
+    ena_storage_meta_load();
+    meta.data.teks[meta.data.tek_count % ENA_STORAGE_TEK_MAX] = *tek;
+    meta.data.tek_count++;
+    meta_dirty = true;
+    ena_storage_unlock();
+
+    ESP_LOGD(ENA_STORAGE_LOG, "write tek: ENIN %u", tek->enin);
+    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, tek->key_data, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
+}
+
+uint32_t ena_storage_exposure_information_count(void)
+{
+    ena_storage_lock();
+    ena_storage_meta_load();
+    uint32_t count = meta.data.exposure_information_count;
+    ena_storage_unlock();
+    ESP_LOGD(ENA_STORAGE_LOG, "read exposure information count: %u", count);
+    return count;
+}
+
+void ena_storage_get_exposure_information(uint32_t index, ena_exposure_information_t *exposure_info)
+{
+    ena_storage_read(ENA_STORAGE_EXPOSURE_INFORMATION_START_ADDRESS + index * sizeof(ena_exposure_information_t), exposure_info, sizeof(ena_exposure_information_t));
+    ESP_LOGD(ENA_STORAGE_LOG, "read exporuse information: day %u, duration %d", exposure_info->day, exposure_info->duration_minutes);
+}
+
+void ena_storage_add_exposure_information(ena_exposure_information_t *exposure_info)
+{
+    ena_storage_lock();
+    ena_storage_meta_load();
+    ena_storage_write(ENA_STORAGE_EXPOSURE_INFORMATION_START_ADDRESS + meta.data.exposure_information_count * sizeof(ena_exposure_information_t), exposure_info, sizeof(ena_exposure_information_t));
+    meta.data.exposure_information_count++;
+    meta_dirty = true;
+    ena_storage_unlock();
+    ESP_LOGD(ENA_STORAGE_LOG, "write exposure info:  day %u, duration %d", exposure_info->day, exposure_info->duration_minutes);
+}
+
+void ena_storage_write_exposure_histogram(ena_storage_exposure_histogram_t *histogram)
+{
+    ena_storage_lock();
+    ena_storage_meta_load();
+    // the committed slot is kept until the next commit, an uncommitted one is just overwritten
+    if (!exposure_histogram_pending)
+    {
+        meta.data.exposure_histogram_slot = 1 - meta.data.exposure_histogram_slot;
+        exposure_histogram_pending = true;
+    }
+    size_t address = ENA_STORAGE_EXPOSURE_HISTOGRAM_START_ADDRESS + meta.data.exposure_histogram_slot * EXPOSURE_HISTOGRAM_BLOCKS * BLOCK_SIZE;
+    ena_storage_write(address, histogram, sizeof(ena_storage_exposure_histogram_t));
+    meta.data.exposure_histogram_crc = ena_storage_crc32(0, histogram, sizeof(ena_storage_exposure_histogram_t));
+    meta_dirty = true;
+    ena_storage_unlock();
+    ESP_LOGD(ENA_STORAGE_LOG, "write exposure histogram of %u exposure information to slot %u", histogram->count, meta.data.exposure_histogram_slot);
+}
+
+bool ena_storage_read_exposure_histogram(ena_storage_exposure_histogram_t *histogram)
+{
+    ena_storage_lock();
+    ena_storage_meta_load();
+    size_t address = ENA_STORAGE_EXPOSURE_HISTOGRAM_START_ADDRESS + meta.data.exposure_histogram_slot * EXPOSURE_HISTOGRAM_BLOCKS * BLOCK_SIZE;
+    ena_storage_read(address, histogram, sizeof(ena_storage_exposure_histogram_t));
+    uint32_t stored_crc = meta.data.exposure_histogram_crc;
+    ena_storage_unlock();
+    uint32_t crc = ena_storage_crc32(0, histogram, sizeof(ena_storage_exposure_histogram_t));
+    if (crc != stored_crc)
+    {
+        ESP_LOGD(ENA_STORAGE_LOG, "no valid exposure histogram stored");
+        return false;
+    }
+    return true;
+}
+
+uint32_t ena_storage_temp_beacons_count(void)
+{
+    ena_storage_lock();
+    ena_storage_meta_load();
+    uint32_t count = meta.data.temp_beacons_count;
+    ena_storage_unlock();
+    ESP_LOGD(ENA_STORAGE_LOG, "read temp beacons count: %u", count);
+    return count;
+}
+
+/**
+ * @brief get address of a temporary beacon in a slot
+ *
+ * @param[in] slot slot of the temporary beacons, 0 or 1
+ * @param[in] index index of the temporary beacon
+ */
+size_t ena_storage_temp_beacon_address(uint32_t slot, uint32_t index)
+{
+    return ENA_STORAGE_TEMP_BEACONS_START_ADDRESS + slot * TEMP_BEACONS_BLOCKS * BLOCK_SIZE + index * sizeof(ena_beacon_t);
+}
+
+void ena_storage_get_temp_beacon(uint32_t index, ena_beacon_t *beacon)
+{
+    ena_storage_lock();
+    ena_storage_meta_load();
+    ena_storage_read(ena_storage_temp_beacon_address(meta.data.temp_beacons_slot, index), beacon, sizeof(ena_beacon_t));
+    ena_storage_unlock();
+    ESP_LOGD(ENA_STORAGE_LOG, "read temp beacon: first %u, last %u and rssi %d", beacon->timestamp_first, beacon->timestamp_last, beacon->rssi);
+    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->rpi, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
+    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->aem, ENA_AEM_METADATA_LENGTH, ESP_LOG_DEBUG);
+}
+
+uint32_t ena_storage_add_temp_beacon(ena_beacon_t *beacon)
+{
+    ena_storage_lock();
+    uint32_t count = ena_storage_temp_beacons_count();
+    // overwrite older temporary beacons?!
+    uint32_t index = count % ENA_STORAGE_TEMP_BEACONS_MAX;
+    ena_storage_set_temp_beacon(index, beacon);
+    ESP_LOGD(ENA_STORAGE_LOG, "add temp beacon at %u: first %u, last %u  and rssi %d", index, beacon->timestamp_first, beacon->timestamp_last, beacon->rssi);
+    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->rpi, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
+    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->aem, ENA_AEM_METADATA_LENGTH, ESP_LOG_DEBUG);
+    count++;
+    meta.data.temp_beacons_count = count;
+    meta_dirty = true;
+    ena_storage_unlock();
+    return count - 1;
+}
+
+void ena_storage_set_temp_beacon(uint32_t index, ena_beacon_t *beacon)
+{
+    ena_storage_lock();
+    ena_storage_meta_load();
+    ena_storage_write(ena_storage_temp_beacon_address(meta.data.temp_beacons_slot, index), beacon, sizeof(ena_beacon_t));
+    ena_storage_unlock();
+    ESP_LOGD(ENA_STORAGE_LOG, "set temp beacon at %u: first %u, last %u  and rssi %d", index, beacon->timestamp_first, beacon->timestamp_last, beacon->rssi);
+    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->rpi, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
+    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->aem, ENA_AEM_METADATA_LENGTH, ESP_LOG_DEBUG);
+}
+
+void ena_storage_write_temp_beacons(ena_beacon_t *beacons, uint32_t count)
+{
+    // CRC of beacons followed by their count, so it can be calculated while beacons are written
+    uint32_t crc = ena_storage_crc32(0, beacons, count * sizeof(ena_beacon_t));
+    crc = ena_storage_crc32(crc, &count, sizeof(uint32_t));
+    ena_storage_lock();
+    ena_storage_meta_load();
+    // write to the other slot, the metadata switches to it on the next commit, an uncommitted one is just overwritten
+    if (!temp_beacons_pending)
+    {
+        meta.data.temp_beacons_slot = 1 - meta.data.temp_beacons_slot;
+        temp_beacons_pending = true;
+    }
+    uint32_t slot = meta.data.temp_beacons_slot;
+    if (count > 0)
+    {
+        ena_storage_write(ena_storage_temp_beacon_address(slot, 0), beacons, count * sizeof(ena_beacon_t));
+    }
+    meta.data.temp_beacons_count = count;
+    meta.data.temp_beacons_crc = crc;
+    meta_dirty = true;
+    ena_storage_unlock();
+    ESP_LOGD(ENA_STORAGE_LOG, "write %u temp beacons to slot %u with crc %08x", count, slot, crc);
+}
+
+uint32_t ena_storage_read_temp_beacons(ena_beacon_t *beacons, uint32_t max)
+{
+    ena_storage_lock();
+    ena_storage_meta_load();
+    uint32_t count = meta.data.temp_beacons_count;
+    uint32_t stored_crc = meta.data.temp_beacons_crc;
+    if (count == 0)
+    {
+        ena_storage_unlock();
+        return 0;
+    }
+    if (count > max)
+    {
+        ena_storage_unlock();
+        ESP_LOGW(ENA_STORAGE_LOG, "invalid temp beacons count %u, discard temp beacons", count);
+        return 0;
+    }
+    ena_storage_read(ena_storage_temp_beacon_address(meta.data.temp_beacons_slot, 0), beacons, count * sizeof(ena_beacon_t));
+    ena_storage_unlock();
+    uint32_t crc = ena_storage_crc32(0, beacons, count * sizeof(ena_beacon_t));
+    crc = ena_storage_crc32(crc, &count, sizeof(uint32_t));
+    if (crc != stored_crc)
+    {
+        ESP_LOGW(ENA_STORAGE_LOG, "invalid temp beacons crc %08x (expected %08x), discard temp beacons", crc, stored_crc);
+        return 0;
+    }
+    ESP_LOGD(ENA_STORAGE_LOG, "read %u temp beacons", count);
+    return count;
+}
+
+uint32_t ena_storage_retain_temp_beacons(ena_storage_temp_beacon_filter_t retain, void *context)
+{
+    ena_beacon_t beacons[TEMP_BEACONS_CHUNK];
+    ena_storage_lock();
+    ena_storage_meta_load();
+    uint32_t count = meta.data.temp_beacons_count < ENA_STORAGE_TEMP_BEACONS_MAX ? meta.data.temp_beacons_count : ENA_STORAGE_TEMP_BEACONS_MAX;
+    uint32_t source = meta.data.temp_beacons_slot;
+    // the committed slot is kept until the next commit, an uncommitted one is compacted in place
+    uint32_t slot = temp_beacons_pending ? source : 1 - source;
+    temp_beacons_pending = true;
+    uint32_t retained = 0;
+    uint32_t crc = 0;
+    // stream through the beacons and append the retained ones to the slot in order, never ahead of the read chunk
+    for (uint32_t index = 0; index < count; index += TEMP_BEACONS_CHUNK)
+    {
+        uint32_t chunk = (count - index) < TEMP_BEACONS_CHUNK ? (count - index) : TEMP_BEACONS_CHUNK;
+        ena_storage_read(ena_storage_temp_beacon_address(source, index), beacons, chunk * sizeof(ena_beacon_t));
+        uint32_t kept = 0;
+        for (uint32_t i = 0; i < chunk; i++)
+        {
+            if (retain(&beacons[i], context))
+            {
+                beacons[kept++] = beacons[i];
+            }
+        }
+        if (kept > 0)
+        {
+            ena_storage_write(ena_storage_temp_beacon_address(slot, retained), beacons, kept * sizeof(ena_beacon_t));
+            crc = ena_storage_crc32(crc, beacons, kept * sizeof(ena_beacon_t));
+            retained += kept;
+        }
+    }
+    meta.data.temp_beacons_slot = slot;
+    meta.data.temp_beacons_count = retained;
+    meta.data.temp_beacons_crc = ena_storage_crc32(crc, &retained, sizeof(uint32_t));
+    meta_dirty = true;
+    ena_storage_unlock();
+    ESP_LOGD(ENA_STORAGE_LOG, "retain %u of %u temp beacons in slot %u", retained, count, slot);
+    return retained;
+}
+
+uint32_t ena_storage_beacons_capacity(void)
+{
+    return (ena_storage_partition()->size - ENA_STORAGE_BEACONS_START_ADDRESS) / BLOCK_SIZE * BEACONS_PER_BLOCK;
+}
+
+size_t ena_storage_beacon_address(uint32_t slot)
+{
+    return ENA_STORAGE_BEACONS_START_ADDRESS + (slot / BEACONS_PER_BLOCK) * BLOCK_SIZE + (slot % BEACONS_PER_BLOCK) * sizeof(ena_storage_beacon_record_t);
+}
+
+uint32_t ena_storage_beacon_record_base(uint32_t day)
+{
+    return day > 0 ? (day - 1) * BEACONS_BUCKET_SECONDS : 0;
+}
+
+bool ena_storage_beacon_record_encode(uint32_t day, ena_beacon_t *beacon, ena_storage_beacon_record_t *record)
+{
+    uint32_t base = ena_storage_beacon_record_base(day);
+    if (beacon->timestamp_first < base || beacon->timestamp_first - base >= (1u << BEACON_RECORD_OFFSET_BITS))
+    {
+        ESP_LOGW(ENA_STORAGE_LOG, "beacon first seen at %u does not fit bucket day %u", beacon->timestamp_first, day);
+        return false;
+    }
+    if (beacon->timestamp_last < beacon->timestamp_first || beacon->timestamp_last - beacon->timestamp_first > BEACON_RECORD_DURATION_MAX)
+    {
+        ESP_LOGW(ENA_STORAGE_LOG, "beacon seen from %u to %u exceeds max. duration %u", beacon->timestamp_first, beacon->timestamp_last, BEACON_RECORD_DURATION_MAX);
+        return false;
+    }
+    memcpy(record->rpi, beacon->rpi, ENA_KEY_LENGTH);
+    memcpy(record->aem, beacon->aem, ENA_AEM_METADATA_LENGTH);
+    record->time = (beacon->timestamp_first - base) | ((beacon->timestamp_last - beacon->timestamp_first) << BEACON_RECORD_OFFSET_BITS);
+    record->rssi = beacon->rssi < INT8_MIN ? INT8_MIN : (beacon->rssi > INT8_MAX ? INT8_MAX : beacon->rssi);
+    return true;
+}
+
+void ena_storage_beacon_record_decode(uint32_t day, ena_storage_beacon_record_t *record, ena_beacon_t *beacon)
+{
+    // record may overlap beacon, see ena_storage_get_beacons
+    ena_storage_beacon_record_t copy = *record;
+    memcpy(beacon->rpi, copy.rpi, ENA_KEY_LENGTH);
+    memcpy(beacon->aem, copy.aem, ENA_AEM_METADATA_LENGTH);
+    beacon->timestamp_first = ena_storage_beacon_record_base(day) + (copy.time & ((1u << BEACON_RECORD_OFFSET_BITS) - 1));
+    beacon->timestamp_last = beacon->timestamp_first + (copy.time >> BEACON_RECORD_OFFSET_BITS);
+    beacon->rssi = copy.rssi;
+}
+
+void ena_storage_beacon_directory_read(ena_storage_beacon_directory_t *directory)
+{
+    ena_storage_lock();
+    ena_storage_meta_load();
+    *directory = meta.data.beacon_directory;
+    ena_storage_unlock();
+}
+
+void ena_storage_beacon_directory_write(ena_storage_beacon_directory_t *directory)
+{
+    ena_storage_lock();
+    ena_storage_meta_load();
+    meta.data.beacon_directory = *directory;
+    meta_dirty = true;
+    ena_storage_unlock();
+}
+
+ena_storage_beacon_bucket_t *ena_storage_beacon_bucket(ena_storage_beacon_directory_t *directory, uint32_t index)
+{
+    return &directory->buckets[(directory->head + index) % ENA_STORAGE_BEACON_BUCKETS_MAX];
+}
+
+uint32_t ena_storage_beacon_bucket_blocks(ena_storage_beacon_bucket_t *bucket)
+{
+    return ((bucket->first_slot % BEACONS_PER_BLOCK) + bucket->count + BEACONS_PER_BLOCK - 1) / BEACONS_PER_BLOCK;
+}
+
+/**
+ * @brief get the bucket and slot of the beacon at given index and the number of beacons from it to the end of its bucket
+ */
+ena_storage_beacon_bucket_t *ena_storage_beacon_slot(ena_storage_beacon_directory_t *directory, uint32_t index, uint32_t *slot, uint32_t *remaining)
+{
+    for (uint32_t i = 0; i < directory->used; i++)
+    {
+        ena_storage_beacon_bucket_t *bucket = ena_storage_beacon_bucket(directory, i);
+        if (index < bucket->count)
+        {
+            *slot = (bucket->first_slot + index) % ena_storage_beacons_capacity();
+            *remaining = bucket->count - index;
+            return bucket;
+        }
+        index -= bucket->count;
+    }
+    *slot = 0;
+    *remaining = 0;
+    return NULL;
+}
+
+uint32_t ena_storage_beacons_count(void)
+{
+    ena_storage_beacon_directory_t directory;
+    ena_storage_beacon_directory_read(&directory);
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < directory.used; i++)
+    {
+        count += ena_storage_beacon_bucket(&directory, i)->count;
+    }
+    ESP_LOGD(ENA_STORAGE_LOG, "read beacons count: %u in %u buckets", count, directory.used);
+    return count;
+}
+
+void ena_storage_get_beacon(uint32_t index, ena_beacon_t *beacon)
+{
+    ena_storage_beacon_directory_t directory;
+    ena_storage_beacon_record_t record;
+    uint32_t slot = 0;
+    uint32_t remaining = 0;
+    ena_storage_lock();
+    ena_storage_beacon_directory_read(&directory);
+    ena_storage_beacon_bucket_t *bucket = ena_storage_beacon_slot(&directory, index, &slot, &remaining);
+    ena_storage_read(ena_storage_beacon_address(slot), &record, sizeof(ena_storage_beacon_record_t));
+    ena_storage_beacon_record_decode(bucket != NULL ? bucket->day : 0, &record, beacon);
+    ena_storage_unlock();
+    ESP_LOGD(ENA_STORAGE_LOG, "read beacon: first %u, last %u and rssi %d", beacon->timestamp_first, beacon->timestamp_last, beacon->rssi);
+    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->rpi, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
+    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->aem, ENA_AEM_METADATA_LENGTH, ESP_LOG_DEBUG);
+}
+
+uint32_t ena_storage_beacons_sequence(void)
+{
+    ena_storage_lock();
+    uint32_t sequence = beacons_sequence;
+    ena_storage_unlock();
+    return sequence;
+}
+
+bool ena_storage_get_beacon_sequence(uint32_t sequence, ena_beacon_t *beacon)
+{
+    ena_storage_lock();
+    // removed beacons wrap around to large indices
+    uint32_t index = sequence - beacons_sequence;
+    bool stored = index < ena_storage_beacons_count();
+    if (stored)
+    {
+        ena_storage_get_beacon(index, beacon);
+    }
+    ena_storage_unlock();
+    return stored;
+}
+
+size_t ena_storage_get_beacons_sequence(uint32_t *sequence, ena_beacon_t *beacons, size_t count)
+{
+    ena_storage_lock();
+    if (*sequence < beacons_sequence)
+    {
+        *sequence = beacons_sequence;
+    }
+    uint32_t index = *sequence - beacons_sequence;
+    uint32_t stored = ena_storage_beacons_count();
+    size_t read = index < stored ? ((stored - index) < count ? (stored - index) : count) : 0;
+    ena_storage_get_beacons(index, beacons, read);
+    ena_storage_unlock();
+    return read;
+}
+
+void ena_storage_get_beacons(uint32_t index, ena_beacon_t *beacons, size_t count)
+{
+    ena_storage_beacon_directory_t directory;
+    ena_storage_lock();
+    ena_storage_beacon_directory_read(&directory);
+    size_t read = 0;
+    while (read < count)
+    {
+        uint32_t slot = 0;
+        uint32_t remaining = 0;
+        ena_storage_beacon_bucket_t *bucket = ena_storage_beacon_slot(&directory, index + read, &slot, &remaining);
+        if (bucket == NULL)
+        {
+            break;
+        }
+        // read up to end of block or bucket
+        size_t block_count = BEACONS_PER_BLOCK - (slot % BEACONS_PER_BLOCK);
+        if (block_count > remaining)
+        {
+            block_count = remaining;
+        }
+        if (block_count > count - read)
+        {
+            block_count = count - read;
+        }
+        // read records to the end of the buffer, so decoding in order never overwrites a record not decoded yet
+        ena_storage_beacon_record_t *records = (ena_storage_beacon_record_t *)((uint8_t *)&beacons[read + block_count] - block_count * sizeof(ena_storage_beacon_record_t));
+        ena_storage_read(ena_storage_beacon_address(slot), records, block_count * sizeof(ena_storage_beacon_record_t));
+        for (size_t i = 0; i < block_count; i++)
+        {
+            ena_storage_beacon_record_decode(bucket->day, &records[i], &beacons[read + i]);
+        }
+        read += block_count;
+    }
+    ena_storage_unlock();
+    ESP_LOGD(ENA_STORAGE_LOG, "read %zu beacons from %u", read, index);
+}
+
+bool ena_storage_beacons_fences_load(void)
+{
+    if (beacons_fences != NULL)
+    {
+        return true;
     }
-}
 
-void ena_storage_erase(size_t address, size_t size)
-{
-    const int block_num = address / BLOCK_SIZE;
-    // check for overflow
-    if (address + size <= (block_num + 1) * BLOCK_SIZE)
+    uint32_t blocks = ena_storage_beacons_capacity() / BEACONS_PER_BLOCK;
+    beacons_fences = calloc(blocks, sizeof(uint32_t));
+    if (beacons_fences == NULL)
     {
-        uint8_t *zeros = calloc(size, sizeof(uint8_t));
-        ena_storage_write(address, zeros, size);
-        free(zeros);
+        ESP_LOGE(ENA_STORAGE_LOG, "Warning %s malloc low memory", __func__);
+        return false;
     }
-    else
+
+    // first beacon of a block is the first written and the last removed, so it is valid for all used blocks
+    ena_storage_beacon_directory_t directory;
+    ena_storage_beacon_directory_read(&directory);
+    uint32_t used_blocks = 0;
+    ena_storage_beacon_record_t record;
+    ena_beacon_t beacon;
+    for (uint32_t i = 0; i < directory.used; i++)
     {
-        const size_t block2_address = (block_num + 1) * BLOCK_SIZE;
-        const size_t data2_size = address + size - block2_address;
-        const size_t data1_size = size - data2_size;
-        uint8_t *zeros = calloc(data1_size, sizeof(uint8_t));
-        ena_storage_write(address, zeros, data1_size);
-        free(zeros);
-        ena_storage_erase(block2_address, data2_size);
+        ena_storage_beacon_bucket_t *bucket = ena_storage_beacon_bucket(&directory, i);
+        for (uint32_t j = 0; j < ena_storage_beacon_bucket_blocks(bucket); j++)
+        {
+            uint32_t block = (bucket->first_slot / BEACONS_PER_BLOCK + j) % blocks;
+            ena_storage_read(ena_storage_beacon_address(block * BEACONS_PER_BLOCK), &record, sizeof(ena_storage_beacon_record_t));
+            ena_storage_beacon_record_decode(bucket->day, &record, &beacon);
+            beacons_fences[block] = beacon.timestamp_first;
+            used_blocks++;
+        }
     }
+    ESP_LOGD(ENA_STORAGE_LOG, "loaded fences of %u blocks", used_blocks);
+    return true;
 }
 
-void ena_storage_shift_delete(size_t address, size_t end_address, size_t size)
+/**
+ * @brief search the bound inside one bucket starting at beacon index, see ena_storage_beacons_bound
+ *
+ * @return
+ *      index of the bound relative to the start of the bucket, number of beacons of the bucket if it is behind
+ */
+uint32_t ena_storage_beacon_bucket_bound(ena_storage_beacon_bucket_t *bucket, uint32_t index, uint32_t timestamp, bool upper)
 {
-    int block_num_start = address / BLOCK_SIZE;
-    // check for overflow
-    if (address + size <= (block_num_start + 1) * BLOCK_SIZE)
+    uint32_t blocks = ena_storage_beacons_capacity() / BEACONS_PER_BLOCK;
+    uint32_t first_offset = bucket->first_slot % BEACONS_PER_BLOCK;
+    uint32_t used_blocks = ena_storage_beacon_bucket_blocks(bucket);
+
+    // search beacon range [min, max) of the block containing the bound, first block has no valid fence
+    uint32_t min = 0;
+    uint32_t max = bucket->count;
+    if (ena_storage_beacons_fences_load())
     {
-        const esp_partition_t *partition = esp_partition_find_first(
-            ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, ENA_STORAGE_PARTITION_NAME);
-        assert(partition);
-
-        int block_num_end = end_address / BLOCK_SIZE;
-        size_t block_start = address - block_num_start * BLOCK_SIZE;
-        while (block_num_end >= block_num_start)
+        uint32_t block_min = 1;
+        uint32_t block_max = used_blocks;
+        while (block_min < block_max)
         {
-
-            void *buffer = malloc(BLOCK_SIZE);
-            ESP_ERROR_CHECK(esp_partition_read(partition, block_num_start * BLOCK_SIZE, buffer, BLOCK_SIZE));
-            vTaskDelay(1);
-            // shift inside buffer
-            ESP_LOGD(ENA_STORAGE_LOG, "shift block %d from %u to %u with size %u", block_num_start, (block_start + size), block_start, (BLOCK_SIZE - block_start - size));
-            memcpy((buffer + block_start), (buffer + block_start + size), BLOCK_SIZE - block_start - size);
-            if (block_num_end > block_num_start)
+            uint32_t block_mid = block_min + (block_max - block_min) / 2;
+            uint32_t fence = beacons_fences[(bucket->first_slot / BEACONS_PER_BLOCK + block_mid) % blocks];
+            if (upper ? fence <= timestamp : fence < timestamp)
             {
-                void *buffer_next_block = malloc(BLOCK_SIZE);
-
-                ESP_ERROR_CHECK(esp_partition_read(partition, (block_num_start + 1) * BLOCK_SIZE, buffer_next_block, BLOCK_SIZE));
-                vTaskDelay(1);
-                // shift from next block
-                ESP_LOGD(ENA_STORAGE_LOG, "shift next block size %u", size);
-                memcpy((buffer + BLOCK_SIZE - size), buffer_next_block, size);
-                free(buffer_next_block);
+                block_min = block_mid + 1;
             }
-
-            ESP_ERROR_CHECK(esp_partition_erase_range(partition, block_num_start * BLOCK_SIZE, BLOCK_SIZE));
-            ESP_ERROR_CHECK(esp_partition_write(partition, block_num_start * BLOCK_SIZE, buffer, BLOCK_SIZE));
-            free(buffer);
-
-            block_num_start++;
-            block_start = 0;
+            else
+            {
+                block_max = block_mid;
+            }
+        }
+        min = block_min > 1 ? (block_min - 1) * BEACONS_PER_BLOCK - first_offset : 0;
+        max = block_min * BEACONS_PER_BLOCK - first_offset;
+        if (max > bucket->count)
+        {
+            max = bucket->count;
         }
     }
-    else
+
+    ena_beacon_t *beacons = (max - min) <= BEACONS_PER_BLOCK ? malloc((max - min) * sizeof(ena_beacon_t)) : NULL;
+    if (beacons != NULL)
     {
-        ESP_LOGD(ENA_STORAGE_LOG, "overflow block at address %u with size %d (block %d)", address, size, block_num_start);
-        const size_t block1_address = address;
-        const size_t block2_address = (block_num_start + 1) * BLOCK_SIZE;
-        const size_t data2_size = address + size - block2_address;
-        const size_t data1_size = size - data2_size;
-        ena_storage_shift_delete(block1_address, block2_address, data1_size);
-        ena_storage_shift_delete(block2_address, end_address - data1_size, data2_size);
+        ena_storage_get_beacons(index + min, beacons, max - min);
+    }
+
+    uint32_t offset = min;
+    while (min < max)
+    {
+        uint32_t mid = min + (max - min) / 2;
+        ena_beacon_t beacon;
+        if (beacons != NULL)
+        {
+            beacon = beacons[mid - offset];
+        }
+        else
+        {
+            ena_storage_get_beacon(index + mid, &beacon);
+        }
+        if (upper ? beacon.timestamp_first <= timestamp : beacon.timestamp_first < timestamp)
+        {
+            min = mid + 1;
+        }
+        else
+        {
+            max = mid;
+        }
     }
+    free(beacons);
+    return min;
 }
 
-uint32_t ena_storage_read_last_exposure_date(void)
+uint32_t ena_storage_beacons_bound(uint32_t timestamp, bool upper)
 {
-    uint32_t timestamp = 0;
-    ena_storage_read(ENA_STORAGE_LAST_EXPOSURE_DATE_ADDRESS, &timestamp, sizeof(uint32_t));
-    return timestamp;
+    ena_storage_lock();
+    ena_storage_beacon_directory_t directory;
+    ena_storage_beacon_directory_read(&directory);
+    uint32_t day = timestamp / BEACONS_BUCKET_SECONDS;
+    uint32_t index = 0;
+    for (uint32_t i = 0; i < directory.used; i++)
+    {
+        ena_storage_beacon_bucket_t *bucket = ena_storage_beacon_bucket(&directory, i);
+        // beacons of buckets of earlier days were all received before the day of timestamp
+        if (bucket->day < day)
+        {
+            index += bucket->count;
+            continue;
+        }
+        uint32_t bound = ena_storage_beacon_bucket_bound(bucket, index, timestamp, upper);
+        index += bound;
+        // later buckets only follow if the complete bucket is before the bound
+        if (bound < bucket->count)
+        {
+            break;
+        }
+    }
+    ena_storage_unlock();
+    return index;
 }
 
-void ena_storage_write_last_exposure_date(uint32_t timestamp)
+uint32_t ena_storage_beacons_lower_bound(uint32_t timestamp)
 {
-    ena_storage_write(ENA_STORAGE_LAST_EXPOSURE_DATE_ADDRESS, &timestamp, sizeof(uint32_t));
+    return ena_storage_beacons_bound(timestamp, false);
 }
 
-uint32_t ena_storage_tek_count(void)
+uint32_t ena_storage_beacons_upper_bound(uint32_t timestamp)
 {
-    uint32_t count = 0;
-    ena_storage_read(ENA_STORAGE_TEK_COUNT_ADDRESS, &count, sizeof(uint32_t));
-    ESP_LOGD(ENA_STORAGE_LOG, "read TEK count: %u", count);
-    return count;
+    return ena_storage_beacons_bound(timestamp, true);
 }
 
-uint32_t ena_storage_read_last_tek(ena_tek_t *tek)
+/**
+ * @brief set or test the bits of a RPI in a Bloom filter
+ *
+ * RPIs are AES output and therefore uniformly distributed, so two words of the RPI serve as hashes for double hashing.
+ * The first word is left to the RPI index of exposure checks.
+ */
+bool ena_storage_bloom_bits(uint32_t *filter, uint32_t size, uint8_t *rpi, bool set, uint32_t *probes)
 {
-    uint32_t tek_count = ena_storage_tek_count();
-    if (tek_count < 1)
+    uint32_t h1, h2;
+    memcpy(&h1, &rpi[4], sizeof(uint32_t));
+    memcpy(&h2, &rpi[8], sizeof(uint32_t));
+    h2 |= 1;
+    uint32_t bits = size * 8;
+    for (int i = 0; i < ENA_STORAGE_BLOOM_HASHES; i++)
     {
-        return 0;
+        uint32_t bit = (uint32_t)(((uint64_t)(h1 + i * h2) * bits) >> 32);
+        if (set)
+        {
+            filter[bit / 32] |= 1u << (bit % 32);
+        }
+        else
+        {
+            (*probes)++;
+            if (!(filter[bit / 32] & (1u << (bit % 32))))
+            {
+                return false;
+            }
+        }
     }
-    uint8_t index = (tek_count % ENA_STORAGE_TEK_MAX) - 1;
-    ena_storage_read(ENA_STORAGE_TEK_START_ADDRESS + index * sizeof(ena_tek_t), tek, sizeof(ena_tek_t));
+    return true;
+}
 
-    ESP_LOGD(ENA_STORAGE_LOG, "read last tek %u:", tek->enin);
-    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, tek->key_data, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
-    return tek_count;
+bool ena_storage_beacons_bloom_bits(uint8_t *rpi, bool set)
+{
+    return ena_storage_bloom_bits(beacons_bloom, beacons_bloom_stats.size, rpi, set, &beacons_bloom_stats.probes);
 }
 
-void ena_storage_get_tek(uint32_t index, ena_tek_t *tek)
+void ena_storage_beacons_bloom_free(void)
 {
-    ena_storage_read(ENA_STORAGE_TEK_START_ADDRESS + index * sizeof(ena_tek_t), tek, sizeof(ena_tek_t));
-    ESP_LOGD(ENA_STORAGE_LOG, "read %d tek %u:", index, tek->enin);
-    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, tek->key_data, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
+    free(beacons_bloom);
+    beacons_bloom = NULL;
+    beacons_bloom_stats.size = 0;
+    beacons_bloom_stats.beacons = 0;
+    beacons_bloom_stats.capacity = 0;
 }
 
-void ena_storage_write_tek(ena_tek_t *tek)
+bool ena_storage_beacons_bloom_load(void)
 {
-    uint32_t tek_count = 0;
-    ena_storage_read(ENA_STORAGE_TEK_COUNT_ADDRESS, &tek_count, sizeof(uint32_t));
-    uint8_t index = (tek_count % ENA_STORAGE_TEK_MAX);
-    ena_storage_write(ENA_STORAGE_TEK_START_ADDRESS + index * sizeof(ena_tek_t), tek, sizeof(ena_tek_t));
+    if (beacons_bloom != NULL)
+    {
+        return true;
+    }
+    if (ENA_STORAGE_BLOOM_BITS_PER_BEACON == 0)
+    {
+        return false;
+    }
 
-    tek_count++;
-    ena_storage_write(ENA_STORAGE_TEK_COUNT_ADDRESS, &tek_count, sizeof(uint32_t));
+    // room for the beacons added until the next cleanup
+    uint32_t count = ena_storage_beacons_count();
+    uint32_t capacity = count + count / 4 + BEACONS_PER_BLOCK;
+    uint32_t size = (capacity * ENA_STORAGE_BLOOM_BITS_PER_BEACON + 31) / 32 * sizeof(uint32_t);
+    if (size > ENA_STORAGE_BLOOM_MAX_SIZE)
+    {
+        size = ENA_STORAGE_BLOOM_MAX_SIZE / sizeof(uint32_t) * sizeof(uint32_t);
+    }
+    beacons_bloom = calloc(size / sizeof(uint32_t), sizeof(uint32_t));
+    if (beacons_bloom == NULL)
+    {
+        ESP_LOGE(ENA_STORAGE_LOG, "Warning %s malloc low memory", __func__);
+        return false;
+    }
+    beacons_bloom_stats.size = size;
+    beacons_bloom_stats.capacity = capacity;
+    beacons_bloom_stats.beacons = count;
+    beacons_bloom_stats.rebuilds++;
 
-    ESP_LOGD(ENA_STORAGE_LOG, "write tek: ENIN %u", tek->enin);
-    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, tek->key_data, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
+    ena_beacon_t beacons[BEACONS_PER_BLOCK / 4];
+    for (uint32_t i = 0; i < count; i += sizeof(beacons) / sizeof(ena_beacon_t))
+    {
+        size_t batch = (count - i) < sizeof(beacons) / sizeof(ena_beacon_t) ? (count - i) : sizeof(beacons) / sizeof(ena_beacon_t);
+        ena_storage_get_beacons(i, beacons, batch);
+        for (size_t j = 0; j < batch; j++)
+        {
+            ena_storage_beacons_bloom_bits(beacons[j].rpi, true);
+        }
+    }
+    ESP_LOGD(ENA_STORAGE_LOG, "built Bloom filter of %u bytes for %u of %u beacons", size, count, capacity);
+    return true;
 }
 
-uint32_t ena_storage_exposure_information_count(void)
+size_t ena_storage_beacons_bloom_check(uint8_t *rpis, size_t count, bool *candidates)
 {
-    uint32_t count = 0;
-    ena_storage_read(ENA_STORAGE_EXPOSURE_INFORMATION_COUNT_ADDRESS, &count, sizeof(uint32_t));
-    ESP_LOGD(ENA_STORAGE_LOG, "read exposure information count: %u", count);
-    return count;
+    size_t found = 0;
+    ena_storage_lock();
+    bool loaded = ena_storage_beacons_bloom_load();
+    for (size_t i = 0; i < count; i++)
+    {
+        candidates[i] = !loaded || ena_storage_beacons_bloom_bits(&rpis[i * ENA_KEY_LENGTH], false);
+        found += candidates[i];
+    }
+    if (loaded)
+    {
+        beacons_bloom_stats.lookups += count;
+        beacons_bloom_stats.rejects += count - found;
+    }
+    ena_storage_unlock();
+    return found;
 }
 
-void ena_storage_get_exposure_information(uint32_t index, ena_exposure_information_t *exposure_info)
+void ena_storage_beacons_bloom_copy(ena_storage_bloom_t *bloom)
 {
-    ena_storage_read(ENA_STORAGE_EXPOSURE_INFORMATION_START_ADDRESS + index * sizeof(ena_exposure_information_t), exposure_info, sizeof(ena_exposure_information_t));
-    ESP_LOGD(ENA_STORAGE_LOG, "read exporuse information: day %u, duration %d", exposure_info->day, exposure_info->duration_minutes);
+    memset(bloom, 0, sizeof(ena_storage_bloom_t));
+    ena_storage_lock();
+    if (ena_storage_beacons_bloom_load())
+    {
+        bloom->bits = malloc(beacons_bloom_stats.size);
+        if (bloom->bits == NULL)
+        {
+            ESP_LOGE(ENA_STORAGE_LOG, "Warning %s malloc low memory", __func__);
+        }
+        else
+        {
+            memcpy(bloom->bits, beacons_bloom, beacons_bloom_stats.size);
+            bloom->size = beacons_bloom_stats.size;
+        }
+    }
+    ena_storage_unlock();
 }
 
-void ena_storage_add_exposure_information(ena_exposure_information_t *exposure_info)
+size_t ena_storage_bloom_check(ena_storage_bloom_t *bloom, uint8_t *rpis, size_t count, bool *candidates)
 {
-    uint32_t count = ena_storage_exposure_information_count();
-    ena_storage_write(ENA_STORAGE_EXPOSURE_INFORMATION_START_ADDRESS + count * sizeof(ena_exposure_information_t), exposure_info, sizeof(ena_exposure_information_t));
-    count++;
-    ena_storage_write(ENA_STORAGE_EXPOSURE_INFORMATION_COUNT_ADDRESS, &count, sizeof(uint32_t));
-    ESP_LOGD(ENA_STORAGE_LOG, "write exposure info:  day %u, duration %d", exposure_info->day, exposure_info->duration_minutes);
+    size_t found = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        candidates[i] = bloom->bits == NULL || ena_storage_bloom_bits(bloom->bits, bloom->size, &rpis[i * ENA_KEY_LENGTH], false, &bloom->probes);
+        found += candidates[i];
+    }
+    if (bloom->bits != NULL)
+    {
+        bloom->lookups += count;
+        bloom->rejects += count - found;
+    }
+    return found;
 }
 
-uint32_t ena_storage_temp_beacons_count(void)
+void ena_storage_beacons_bloom_release(ena_storage_bloom_t *bloom)
 {
-    uint32_t count = 0;
-    ena_storage_read(ENA_STORAGE_TEMP_BEACONS_COUNT_ADDRESS, &count, sizeof(uint32_t));
-    ESP_LOGD(ENA_STORAGE_LOG, "read temp beacons count: %u", count);
-    return count;
+    ena_storage_lock();
+    beacons_bloom_stats.lookups += bloom->lookups;
+    beacons_bloom_stats.rejects += bloom->rejects;
+    beacons_bloom_stats.probes += bloom->probes;
+    ena_storage_unlock();
+    free(bloom->bits);
+    memset(bloom, 0, sizeof(ena_storage_bloom_t));
 }
 
-void ena_storage_get_temp_beacon(uint32_t index, ena_beacon_t *beacon)
+void ena_storage_beacons_bloom_stats(ena_storage_bloom_stats_t *stats)
 {
-    ena_storage_read(ENA_STORAGE_TEMP_BEACONS_START_ADDRESS + index * sizeof(ena_beacon_t), beacon, sizeof(ena_beacon_t));
-    ESP_LOGD(ENA_STORAGE_LOG, "read temp beacon: first %u, last %u and rssi %d", beacon->timestamp_first, beacon->timestamp_last, beacon->rssi);
-    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->rpi, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
-    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->aem, ENA_AEM_METADATA_LENGTH, ESP_LOG_DEBUG);
+    ena_storage_lock();
+    *stats = beacons_bloom_stats;
+    // probability of all probed bits being set
+    uint32_t bits_set = 0;
+    for (uint32_t i = 0; beacons_bloom != NULL && i < beacons_bloom_stats.size / sizeof(uint32_t); i++)
+    {
+        bits_set += __builtin_popcount(beacons_bloom[i]);
+    }
+    float fill = stats->size > 0 ? (float)bits_set / (stats->size * 8) : 1;
+    stats->false_positive_rate = 1;
+    for (int i = 0; i < ENA_STORAGE_BLOOM_HASHES; i++)
+    {
+        stats->false_positive_rate *= fill;
+    }
+    ena_storage_unlock();
 }
 
-uint32_t ena_storage_add_temp_beacon(ena_beacon_t *beacon)
+void ena_storage_stats(ena_storage_stats_t *stats)
 {
-    uint32_t count = ena_storage_temp_beacons_count();
-    // overwrite older temporary beacons?!
-    uint8_t index = count % ENA_STORAGE_TEMP_BEACONS_MAX;
-    ena_storage_set_temp_beacon(index, beacon);
-    ESP_LOGD(ENA_STORAGE_LOG, "add temp beacon at %u: first %u, last %u  and rssi %d", index, beacon->timestamp_first, beacon->timestamp_last, beacon->rssi);
-    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->rpi, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
-    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->aem, ENA_AEM_METADATA_LENGTH, ESP_LOG_DEBUG);
-    count++;
-    ena_storage_write(ENA_STORAGE_TEMP_BEACONS_COUNT_ADDRESS, &count, sizeof(uint32_t));
-    return count - 1;
+    memset(stats, 0, sizeof(ena_storage_stats_t));
+    ena_storage_lock();
+    ena_storage_meta_load();
+    for (uint32_t sector = ENA_STORAGE_META_START_ADDRESS / BLOCK_SIZE; sector < ena_storage_partition()->size / BLOCK_SIZE; sector++)
+    {
+        uint32_t erases = ena_storage_sector_erases(sector);
+        uint32_t *region_max = &stats->log_erases_max;
+        if (sector * BLOCK_SIZE < ENA_STORAGE_EXPOSURE_INFORMATION_START_ADDRESS)
+        {
+            region_max = &stats->meta_erases_max;
+        }
+        else if (sector * BLOCK_SIZE < ENA_STORAGE_BEACONS_START_ADDRESS)
+        {
+            region_max = &stats->fixed_erases_max;
+        }
+        if (erases > *region_max)
+        {
+            *region_max = erases;
+        }
+        if (erases > stats->erases_max)
+        {
+            stats->erases_max = erases;
+            stats->erases_max_sector = sector;
+        }
+        stats->erases += erases;
+        stats->sectors++;
+    }
+    stats->meta_sectors = ENA_STORAGE_META_SECTORS;
+    stats->meta_commits = meta.sequence;
+    ena_storage_unlock();
 }
 
-void ena_storage_set_temp_beacon(uint32_t index, ena_beacon_t *beacon)
+uint32_t ena_storage_beacon_directory_blocks(ena_storage_beacon_directory_t *directory)
 {
-    ena_storage_write(ENA_STORAGE_TEMP_BEACONS_START_ADDRESS + index * sizeof(ena_beacon_t), beacon, sizeof(ena_beacon_t));
-    ESP_LOGD(ENA_STORAGE_LOG, "set temp beacon at %u: first %u, last %u  and rssi %d", index, beacon->timestamp_first, beacon->timestamp_last, beacon->rssi);
-    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->rpi, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
-    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->aem, ENA_AEM_METADATA_LENGTH, ESP_LOG_DEBUG);
+    uint32_t blocks = 0;
+    for (uint32_t i = 0; i < directory->used; i++)
+    {
+        blocks += ena_storage_beacon_bucket_blocks(ena_storage_beacon_bucket(directory, i));
+    }
+    return blocks;
 }
 
-void ena_storage_remove_temp_beacon(uint32_t index)
+void ena_storage_add_beacons(ena_beacon_t *beacons, size_t count)
 {
-    uint32_t count = ena_storage_temp_beacons_count();
-    size_t address_from = ENA_STORAGE_TEMP_BEACONS_START_ADDRESS + index * sizeof(ena_beacon_t);
-    size_t address_to = ENA_STORAGE_TEMP_BEACONS_START_ADDRESS + count * sizeof(ena_beacon_t);
+    ena_storage_lock();
+    ena_storage_beacon_directory_t directory;
+    ena_storage_beacon_directory_read(&directory);
+    uint32_t capacity = ena_storage_beacons_capacity();
 
-    ena_storage_shift_delete(address_from, address_to, sizeof(ena_beacon_t));
+    for (size_t i = 0; i < count; i++)
+    {
+        ena_beacon_t *beacon = &beacons[i];
+        uint32_t day = beacon->timestamp_first / BEACONS_BUCKET_SECONDS;
+        bool new_bucket = directory.used == 0 || day > ena_storage_beacon_bucket(&directory, directory.used - 1)->day;
 
-    count--;
-    ena_storage_write(ENA_STORAGE_TEMP_BEACONS_COUNT_ADDRESS, &count, sizeof(uint32_t));
-    ESP_LOGD(ENA_STORAGE_LOG, "remove temp beacon: %u", index);
-}
+        // record has to fit its bucket, a RPI changes every 10 to 20 minutes and is never valid that long
+        ena_storage_beacon_record_t record;
+        if (!ena_storage_beacon_record_encode(new_bucket ? day : ena_storage_beacon_bucket(&directory, directory.used - 1)->day, beacon, &record))
+        {
+            continue;
+        }
 
-uint32_t ena_storage_beacons_count(void)
-{
-    uint32_t count = 0;
-    ena_storage_read(ENA_STORAGE_BEACONS_COUNT_ADDRESS, &count, sizeof(uint32_t));
-    ESP_LOGD(ENA_STORAGE_LOG, "read contancts count: %u", count);
-    return count;
-}
+        // a new day starts a new bucket at next block, late beacons of an earlier day stay in the latest bucket to keep order
+        if (new_bucket)
+        {
+            if (directory.used == ENA_STORAGE_BEACON_BUCKETS_MAX)
+            {
+                ESP_LOGW(ENA_STORAGE_LOG, "no free day bucket, drop beacons of oldest day");
+                ena_storage_beacon_directory_write(&directory);
+                ena_storage_remove_beacons(ena_storage_beacon_bucket(&directory, 0)->count);
+                ena_storage_beacon_directory_read(&directory);
+            }
+            uint32_t slot = directory.next_slot;
+            if (directory.used > 0)
+            {
+                ena_storage_beacon_bucket_t *latest = ena_storage_beacon_bucket(&directory, directory.used - 1);
+                slot = ((latest->first_slot + latest->count + BEACONS_PER_BLOCK - 1) / BEACONS_PER_BLOCK * BEACONS_PER_BLOCK) % capacity;
+            }
+            ena_storage_beacon_bucket_t *bucket = ena_storage_beacon_bucket(&directory, directory.used);
+            bucket->day = day;
+            bucket->first_slot = slot;
+            bucket->count = 0;
+            directory.used++;
+        }
 
-void ena_storage_get_beacon(uint32_t index, ena_beacon_t *beacon)
-{
-    ena_storage_read(ENA_STORAGE_BEACONS_START_ADDRESS + index * sizeof(ena_beacon_t), beacon, sizeof(ena_beacon_t));
-    ESP_LOGD(ENA_STORAGE_LOG, "read beacon: first %u, last %u and rssi %d", beacon->timestamp_first, beacon->timestamp_last, beacon->rssi);
-    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->rpi, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
-    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->aem, ENA_AEM_METADATA_LENGTH, ESP_LOG_DEBUG);
+        ena_storage_beacon_bucket_t *bucket = ena_storage_beacon_bucket(&directory, directory.used - 1);
+        uint32_t slot = (bucket->first_slot + bucket->count) % capacity;
+
+        // log is full, drop block with oldest beacons
+        if (slot % BEACONS_PER_BLOCK == 0 && ena_storage_beacon_directory_blocks(&directory) == capacity / BEACONS_PER_BLOCK)
+        {
+            ESP_LOGW(ENA_STORAGE_LOG, "beacon storage full, drop oldest beacons");
+            ena_storage_beacon_directory_write(&directory);
+            ena_storage_remove_beacons(BEACONS_PER_BLOCK - (ena_storage_beacon_bucket(&directory, 0)->first_slot % BEACONS_PER_BLOCK));
+            ena_storage_beacon_directory_read(&directory);
+            bucket = ena_storage_beacon_bucket(&directory, directory.used - 1);
+        }
+
+        // a new block may hold records programmed before a power loss but never committed, erase it while nothing refers to it
+        if (slot % BEACONS_PER_BLOCK == 0)
+        {
+            ena_storage_beacon_record_t programmed;
+            ena_storage_read(ena_storage_beacon_address(slot), &programmed, sizeof(ena_storage_beacon_record_t));
+            if (!ena_storage_is_erased(&programmed, sizeof(ena_storage_beacon_record_t)))
+            {
+                ESP_LOGW(ENA_STORAGE_LOG, "erase uncommitted beacons at slot %u", slot);
+                ena_storage_erase_block(ena_storage_beacon_address(slot));
+            }
+        }
+        // records of a batch are appended to the same cached block, which is programmed once
+        ena_storage_write(ena_storage_beacon_address(slot), &record, sizeof(ena_storage_beacon_record_t));
+        if (beacons_fences != NULL && slot % BEACONS_PER_BLOCK == 0)
+        {
+            beacons_fences[slot / BEACONS_PER_BLOCK] = beacon->timestamp_first;
+        }
+        bucket->count++;
+        if (beacons_bloom != NULL)
+        {
+            ena_storage_beacons_bloom_bits(beacon->rpi, true);
+            beacons_bloom_stats.beacons++;
+            // too full for its false positive rate, rebuild larger on next check
+            if (beacons_bloom_stats.beacons > beacons_bloom_stats.capacity && beacons_bloom_stats.size < ENA_STORAGE_BLOOM_MAX_SIZE / sizeof(uint32_t) * sizeof(uint32_t))
+            {
+                ena_storage_beacons_bloom_free();
+            }
+        }
+        ESP_LOGD(ENA_STORAGE_LOG, "write beacon: first %u, last %u  and rssi %d", beacon->timestamp_first, beacon->timestamp_last, beacon->rssi);
+        ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->rpi, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
+        ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->aem, ENA_AEM_METADATA_LENGTH, ESP_LOG_DEBUG);
+    }
+    ena_storage_beacon_directory_write(&directory);
+    ena_storage_unlock();
 }
 
 void ena_storage_add_beacon(ena_beacon_t *beacon)
 {
-    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->rpi, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
-    uint32_t count = ena_storage_beacons_count();
-    ena_storage_write(ENA_STORAGE_BEACONS_START_ADDRESS + count * sizeof(ena_beacon_t), beacon, sizeof(ena_beacon_t));
-    count++;
-    ena_storage_write(ENA_STORAGE_BEACONS_COUNT_ADDRESS, &count, sizeof(uint32_t));
-    ESP_LOGD(ENA_STORAGE_LOG, "write beacon: first %u, last %u  and rssi %d", beacon->timestamp_first, beacon->timestamp_last, beacon->rssi);
-    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->rpi, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
-    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->aem, ENA_AEM_METADATA_LENGTH, ESP_LOG_DEBUG);
+    ena_storage_add_beacons(beacon, 1);
 }
 
-void ena_storage_remove_beacon(uint32_t index)
+void ena_storage_remove_beacons(uint32_t count)
 {
-    uint32_t count = ena_storage_beacons_count();
-    size_t address_from = ENA_STORAGE_BEACONS_START_ADDRESS + index * sizeof(ena_beacon_t);
-    size_t address_to = ENA_STORAGE_BEACONS_START_ADDRESS + count * sizeof(ena_beacon_t);
-
-    ena_storage_shift_delete(address_from, address_to, sizeof(ena_beacon_t));
-
-    count--;
-    ena_storage_write(ENA_STORAGE_BEACONS_COUNT_ADDRESS, &count, sizeof(uint32_t));
-    ESP_LOGD(ENA_STORAGE_LOG, "remove beacon: %u", index);
+    ena_storage_lock();
+    ena_storage_beacon_directory_t directory;
+    ena_storage_beacon_directory_read(&directory);
+    uint32_t capacity = ena_storage_beacons_capacity();
+    uint32_t blocks = capacity / BEACONS_PER_BLOCK;
+    uint32_t removed = 0;
+    uint32_t freed_blocks = 0;
+    uint32_t freed_start[ENA_STORAGE_BEACON_BUCKETS_MAX]; // first freed block of each bucket
+    uint32_t freed_count[ENA_STORAGE_BEACON_BUCKETS_MAX]; // number of freed blocks of each bucket
+    uint32_t freed = 0;
+    while (removed < count && directory.used > 0)
+    {
+        ena_storage_beacon_bucket_t *bucket = ena_storage_beacon_bucket(&directory, 0);
+        uint32_t bucket_removed = (count - removed) < bucket->count ? (count - removed) : bucket->count;
+        bool drop = bucket_removed == bucket->count;
+
+        // blocks without remaining beacons are erased, so new beacons can be appended without erase
+        freed_start[freed] = bucket->first_slot / BEACONS_PER_BLOCK;
+        freed_count[freed] = drop ? ena_storage_beacon_bucket_blocks(bucket) : ((bucket->first_slot % BEACONS_PER_BLOCK) + bucket_removed) / BEACONS_PER_BLOCK;
+        freed_blocks += freed_count[freed];
+        freed++;
+        removed += bucket_removed;
+
+        if (drop)
+        {
+            // no block is shared with the next bucket, a new bucket starts after the dropped one if none is left
+            directory.next_slot = ((bucket->first_slot + bucket->count + BEACONS_PER_BLOCK - 1) / BEACONS_PER_BLOCK * BEACONS_PER_BLOCK) % capacity;
+            directory.head = (directory.head + 1) % ENA_STORAGE_BEACON_BUCKETS_MAX;
+            directory.used--;
+        }
+        else
+        {
+            bucket->first_slot = (bucket->first_slot + bucket_removed) % capacity;
+            bucket->count -= bucket_removed;
+        }
+    }
+    ena_storage_beacon_directory_write(&directory);
+    beacons_sequence += removed;
+    // commit before erase, the metadata never refers to erased blocks
+    ena_storage_flush();
+    for (uint32_t i = 0; i < freed; i++)
+    {
+        for (uint32_t j = 0; j < freed_count[i]; j++)
+        {
+            ena_storage_erase_block(ENA_STORAGE_BEACONS_START_ADDRESS + ((freed_start[i] + j) % blocks) * BLOCK_SIZE);
+        }
+    }
+    // bits of removed beacons can not be cleared, rebuild on next check
+    ena_storage_beacons_bloom_free();
+    ena_storage_unlock();
+    ESP_LOGD(ENA_STORAGE_LOG, "remove %u beacons, erased %u blocks", removed, freed_blocks);
 }
 
-void ena_storage_erase_all(void)
+uint32_t ena_storage_remove_beacons_before(uint32_t timestamp)
 {
-    const esp_partition_t *partition = esp_partition_find_first(
-        ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, ENA_STORAGE_PARTITION_NAME);
-    assert(partition);
-    ESP_ERROR_CHECK(esp_partition_erase_range(partition, 0, partition->size));
-    ESP_LOGI(ENA_STORAGE_LOG, "erased partition %s!", ENA_STORAGE_PARTITION_NAME);
-
+    ena_storage_lock();
+    ena_storage_beacon_directory_t directory;
+    ena_storage_beacon_directory_read(&directory);
     uint32_t count = 0;
-    ena_storage_write(ENA_STORAGE_LAST_EXPOSURE_DATE_ADDRESS, &count, sizeof(uint32_t));
-    ena_storage_write(ENA_STORAGE_TEK_COUNT_ADDRESS, &count, sizeof(uint32_t));
-    ena_storage_write(ENA_STORAGE_EXPOSURE_INFORMATION_COUNT_ADDRESS, &count, sizeof(uint32_t));
-    ena_storage_write(ENA_STORAGE_TEMP_BEACONS_COUNT_ADDRESS, &count, sizeof(uint32_t));
-    ena_storage_write(ENA_STORAGE_BEACONS_COUNT_ADDRESS, &count, sizeof(uint32_t));
+    for (uint32_t i = 0; i < directory.used; i++)
+    {
+        ena_storage_beacon_bucket_t *bucket = ena_storage_beacon_bucket(&directory, i);
+        if (bucket->day >= timestamp / BEACONS_BUCKET_SECONDS)
+        {
+            break;
+        }
+        count += bucket->count;
+    }
+    if (count > 0)
+    {
+        ena_storage_remove_beacons(count);
+    }
+    ena_storage_unlock();
+    return count;
 }
 
-void ena_storage_erase_tek(void)
+void ena_storage_erase_all(void)
 {
-    uint32_t count = 0;
-    ena_storage_read(ENA_STORAGE_TEK_COUNT_ADDRESS, &count, sizeof(uint32_t));
-    uint32_t stored = ENA_STORAGE_TEK_MAX;
+    const esp_partition_t *partition = ena_storage_partition();
+    ena_storage_lock();
+    ena_storage_cache_drop(false);
+    ena_storage_meta_load();
+
+    // erase counters of another layout are not valid
+    bool counted = meta.data.version == ENA_STORAGE_VERSION;
+    uint32_t fixed_erases[FIXED_SECTORS] = {0};
+    if (counted)
+    {
+        memcpy(fixed_erases, meta.data.fixed_erases, sizeof(fixed_erases));
+    }
+    for (uint32_t i = 0; counted && i < meta.data.beacon_directory.used; i++)
+    {
+        beacons_sequence += ena_storage_beacon_bucket(&meta.data.beacon_directory, i)->count;
+    }
+    memset(&meta.data, 0, sizeof(ena_storage_meta_t));
+    memcpy(meta.data.fixed_erases, fixed_erases, sizeof(fixed_erases));
 
-    if (count < ENA_STORAGE_TEK_MAX)
+    for (uint32_t sector = 0; sector < partition->size / BLOCK_SIZE; sector++)
     {
-        stored = count;
+        if (counted && sector * BLOCK_SIZE >= ENA_STORAGE_META_START_ADDRESS)
+        {
+            ena_storage_erase_sector(sector, NULL);
+        }
+        else
+        {
+            ESP_ERROR_CHECK(esp_partition_erase_range(partition, sector * BLOCK_SIZE, BLOCK_SIZE));
+        }
     }
+    ESP_LOGI(ENA_STORAGE_LOG, "erased partition %s!", ENA_STORAGE_PARTITION_NAME);
+
+    // first commit starts at first pool sector, which is erased already
+    meta_sector = 0;
+    meta_next = 0;
+    meta.data.version = ENA_STORAGE_VERSION;
+    meta_dirty = true;
+    ena_storage_flush();
+    ena_storage_beacons_bloom_free();
+    ena_storage_unlock();
+}
 
-    size_t size = sizeof(uint32_t) + stored * sizeof(ena_tek_t);
-    ena_storage_erase(ENA_STORAGE_TEK_COUNT_ADDRESS, size);
-    ESP_LOGI(ENA_STORAGE_LOG, "erased %d teks (size %u at %u)", stored, size, ENA_STORAGE_TEK_COUNT_ADDRESS);
+void ena_storage_erase_tek(void)
+{
+    ena_storage_lock();
+    ena_storage_meta_load();
+    uint32_t stored = meta.data.tek_count < ENA_STORAGE_TEK_MAX ? meta.data.tek_count : ENA_STORAGE_TEK_MAX;
+    meta.data.tek_count = 0;
+    memset(meta.data.teks, 0, sizeof(meta.data.teks));
+    meta_dirty = true;
+    ena_storage_unlock();
+    ESP_LOGI(ENA_STORAGE_LOG, "erased %d teks", stored);
 }
 
 void ena_storage_erase_exposure_information(void)
@@ -380,15 +1685,22 @@ void ena_storage_erase_exposure_information(void)
         stored = count;
     }
 
-    size_t size = sizeof(uint32_t) + stored * sizeof(ena_exposure_information_t);
-    ena_storage_erase(ENA_STORAGE_EXPOSURE_INFORMATION_COUNT_ADDRESS, size);
-    ESP_LOGI(ENA_STORAGE_LOG, "erased %d exposure information (size %u at %u)", stored, size, ENA_STORAGE_EXPOSURE_INFORMATION_COUNT_ADDRESS);
+    size_t size = stored * sizeof(ena_exposure_information_t);
+    ena_storage_lock();
+    if (size > 0)
+    {
+        ena_storage_erase(ENA_STORAGE_EXPOSURE_INFORMATION_START_ADDRESS, size);
+    }
+    meta.data.exposure_information_count = 0;
+    meta_dirty = true;
+    ena_storage_unlock();
+    ESP_LOGI(ENA_STORAGE_LOG, "erased %d exposure information (size %zu at %u)", stored, size, ENA_STORAGE_EXPOSURE_INFORMATION_START_ADDRESS);
 }
 
 void ena_storage_erase_temporary_beacon(void)
 {
-    uint32_t beacon_count = 0;
-    ena_storage_read(ENA_STORAGE_TEMP_BEACONS_COUNT_ADDRESS, &beacon_count, sizeof(uint32_t));
+    ena_storage_lock();
+    uint32_t beacon_count = ena_storage_temp_beacons_count();
     uint32_t stored = ENA_STORAGE_TEMP_BEACONS_MAX;
 
     if (beacon_count < ENA_STORAGE_TEMP_BEACONS_MAX)
@@ -396,20 +1708,48 @@ void ena_storage_erase_temporary_beacon(void)
         stored = beacon_count;
     }
 
-    size_t size = sizeof(uint32_t) + stored * sizeof(ena_beacon_t);
-    ena_storage_erase(ENA_STORAGE_TEMP_BEACONS_COUNT_ADDRESS, size);
+    size_t size = stored * sizeof(ena_beacon_t);
+    size_t address = ena_storage_temp_beacon_address(meta.data.temp_beacons_slot, 0);
+    if (size > 0)
+    {
+        ena_storage_erase(address, size);
+    }
+    meta.data.temp_beacons_count = 0;
+    meta.data.temp_beacons_crc = 0;
+    meta_dirty = true;
+    ena_storage_unlock();
 
-    ESP_LOGI(ENA_STORAGE_LOG, "erased %d temporary beacons (size %u at %u)", stored, size, ENA_STORAGE_TEMP_BEACONS_COUNT_ADDRESS);
+    ESP_LOGI(ENA_STORAGE_LOG, "erased %u temporary beacons (size %zu at %zu)", stored, size, address);
 }
 
 void ena_storage_erase_beacon(void)
 {
+    ena_storage_lock();
+    ena_storage_beacon_directory_t directory;
+    ena_storage_beacon_directory_read(&directory);
+    uint32_t blocks = ena_storage_beacons_capacity() / BEACONS_PER_BLOCK;
     uint32_t beacon_count = 0;
-    ena_storage_read(ENA_STORAGE_BEACONS_COUNT_ADDRESS, &beacon_count, sizeof(uint32_t));
+    uint32_t used_blocks = 0;
 
-    size_t size = sizeof(uint32_t) + beacon_count * sizeof(ena_beacon_t);
-    ena_storage_erase(ENA_STORAGE_BEACONS_COUNT_ADDRESS, size);
-    ESP_LOGI(ENA_STORAGE_LOG, "erased %d beacons (size %u at %u)", beacon_count, size, ENA_STORAGE_BEACONS_COUNT_ADDRESS);
+    // commit empty directory before erase, the metadata never refers to erased blocks
+    ena_storage_beacon_directory_t empty = {0};
+    ena_storage_beacon_directory_write(&empty);
+    ena_storage_flush();
+    for (uint32_t i = 0; i < directory.used; i++)
+    {
+        ena_storage_beacon_bucket_t *bucket = ena_storage_beacon_bucket(&directory, i);
+        for (uint32_t j = 0; j < ena_storage_beacon_bucket_blocks(bucket) && used_blocks < blocks; j++)
+        {
+            uint32_t block = (bucket->first_slot / BEACONS_PER_BLOCK + j) % blocks;
+            ena_storage_erase_block(ENA_STORAGE_BEACONS_START_ADDRESS + block * BLOCK_SIZE);
+            used_blocks++;
+        }
+        beacon_count += bucket->count;
+    }
+    beacons_sequence += beacon_count;
+    ena_storage_beacons_bloom_free();
+    ena_storage_unlock();
+    ESP_LOGI(ENA_STORAGE_LOG, "erased %d beacons (%u blocks)", beacon_count, used_blocks);
 }
 
 void ena_storage_dump_hash_array(uint8_t *data, size_t size)
@@ -430,8 +1770,7 @@ void ena_storage_dump_hash_array(uint8_t *data, size_t size)
 void ena_storage_dump_teks(void)
 {
     ena_tek_t tek;
-    uint32_t tek_count = 0;
-    ena_storage_read(ENA_STORAGE_TEK_COUNT_ADDRESS, &tek_count, sizeof(uint32_t));
+    uint32_t tek_count = ena_storage_tek_count();
     uint32_t stored = ENA_STORAGE_TEK_MAX;
 
     if (tek_count < ENA_STORAGE_TEK_MAX)
@@ -443,9 +1782,7 @@ void ena_storage_dump_teks(void)
     printf("#,enin,tek,rolling_period\n");
     for (int i = 0; i < stored; i++)
     {
-
-        size_t address = ENA_STORAGE_TEK_START_ADDRESS + i * sizeof(ena_tek_t);
-        ena_storage_read(address, &tek, sizeof(ena_tek_t));
+        ena_storage_get_tek(i, &tek);
         printf("%d,%u,", i, tek.enin);
         ena_storage_dump_hash_array(tek.key_data, ENA_KEY_LENGTH);
         printf(",%u\n", tek.rolling_period);
@@ -477,8 +1814,7 @@ void ena_storage_dump_exposure_information(void)
 void ena_storage_dump_temp_beacons(void)
 {
     ena_beacon_t beacon;
-    uint32_t beacon_count = 0;
-    ena_storage_read(ENA_STORAGE_TEMP_BEACONS_COUNT_ADDRESS, &beacon_count, sizeof(uint32_t));
+    uint32_t beacon_count = ena_storage_temp_beacons_count();
     uint32_t stored = ENA_STORAGE_TEMP_BEACONS_MAX;
 
     if (beacon_count < ENA_STORAGE_TEMP_BEACONS_MAX)
@@ -502,8 +1838,7 @@ void ena_storage_dump_beacons(void)
 {
 
     ena_beacon_t beacon;
-    uint32_t beacon_count = 0;
-    ena_storage_read(ENA_STORAGE_BEACONS_COUNT_ADDRESS, &beacon_count, sizeof(uint32_t));
+    uint32_t beacon_count = ena_storage_beacons_count();
     ESP_LOGD(ENA_STORAGE_LOG, "%u beacons\n", beacon_count);
     printf("#,timestamp_first,timestamp_last,rpi,aem,rssi\n");
     for (int i = 0; i < beacon_count; i++)
@@ -16,6 +16,8 @@
 
 #include "esp_system.h"
 #include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "esp_bt.h"
 #include "esp_bt_main.h"
 #include "esp_gap_ble_api.h"
@@ -27,11 +29,16 @@
 #include "ena-bluetooth-scan.h"
 #include "ena-bluetooth-advertise.h"
 #include "ena-beacons.h"
+#include "ena-exposure.h"
 
 #include "ena.h"
 
-static ena_tek_t last_tek;          // last ENIN
-static uint32_t next_rpi_timestamp; // next rpi
+static ena_tek_t last_tek;                 // last ENIN
+static uint32_t next_rpi_timestamp;        // next rpi
+static uint32_t last_flush_timestamp;      // last write back of storage
+static uint32_t last_checkpoint_timestamp; // last checkpoint of temporary beacons
+static TaskHandle_t storage_task_handle;   // task writing back storage
+static volatile bool cleanup_requested;    // clean up of old beacons requested on new TEK
 
 void ena_next_rpi_timestamp(uint32_t timestamp)
 {
@@ -58,7 +65,11 @@ void ena_run(void)
         last_tek.rolling_period = ENA_TEK_ROLLING_PERIOD - (last_tek.enin % ENA_TEK_ROLLING_PERIOD);
         ena_storage_write_tek(&last_tek);
         // clean up old beacons
-        ena_beacons_cleanup(unix_timestamp);
+        cleanup_requested = true;
+        if (storage_task_handle != NULL)
+        {
+            xTaskNotifyGive(storage_task_handle);
+        }
     }
 
     // change RPI
@@ -85,6 +96,52 @@ void ena_run(void)
     }
 }
 
+void ena_storage_run(void)
+{
+    uint32_t unix_timestamp = (uint32_t)time(NULL);
+    // beacons of the oldest day may still match keys of a running download, clean up after it
+    if (cleanup_requested && !ena_exposure_check_stream_active())
+    {
+        cleanup_requested = false;
+        ena_beacons_cleanup(unix_timestamp);
+    }
+
+    // store temporary beacons kept in RAM
+    if (ENA_BEACONS_TEMP_CHECKPOINT_INTERVAL > 0 && unix_timestamp - last_checkpoint_timestamp >= ENA_BEACONS_TEMP_CHECKPOINT_INTERVAL)
+    {
+        ena_beacons_temp_checkpoint();
+        ena_storage_flush();
+        last_checkpoint_timestamp = unix_timestamp;
+    }
+
+    // write back cached storage
+    if (unix_timestamp - last_flush_timestamp >= ENA_STORAGE_FLUSH_INTERVAL)
+    {
+        ena_storage_flush();
+        last_flush_timestamp = unix_timestamp;
+    }
+}
+
+void ena_storage_task(void *pvParameter)
+{
+    while (1)
+    {
+        // woken up by clean-up request or every second
+        ulTaskNotifyTake(pdTRUE, 1000 / portTICK_PERIOD_MS);
+        ena_storage_run();
+    }
+}
+
+void ena_task(void *pvParameter)
+{
+    TickType_t last_wake_time = xTaskGetTickCount();
+    while (1)
+    {
+        ena_run();
+        vTaskDelayUntil(&last_wake_time, 1000 / portTICK_PERIOD_MS);
+    }
+}
+
 void ena_start(void)
 {
 #if (CONFIG_ENA_STORAGE_ERASE)
@@ -95,7 +152,8 @@ void ena_start(void)
     ena_storage_write_last_exposure_date(0);
 #endif
 
-    if (ena_storage_read_last_exposure_date() == 0xFFFFFFFF)
+    // a power loss falls back to the last committed metadata, only a missing or outdated layout is erased
+    if (ena_storage_read_version() != ENA_STORAGE_VERSION)
     {
         ena_storage_erase_all();
     }
@@ -165,6 +223,11 @@ void ena_start(void)
         ena_storage_write_tek(&last_tek);
     }
 
+    // handle received beacons, storage and exposure checks in own tasks
+    ena_beacons_start();
+    ena_exposure_worker_start();
+    xTaskCreate(&ena_storage_task, "ena_storage_task", 4096, NULL, 3, &storage_task_handle);
+
     // init scan
     ena_bluetooth_scan_init();
 
@@ -174,12 +237,14 @@ void ena_start(void)
     // initial scan on every start
     ena_bluetooth_scan_start(ENA_SCANNING_TIME);
 
-    // what is a good stack size here?
-    // xTaskCreate(&ena_run, "ena_run", ENA_RAM, NULL, 5, NULL);
+    // timing of advertising and scanning
+    xTaskCreate(&ena_task, "ena_task", 4096, NULL, 5, NULL);
 }
 
 void ena_stop(void)
 {
+    ena_beacons_temp_checkpoint();
+    ena_storage_flush();
     ena_bluetooth_advertise_stop();
     ena_bluetooth_scan_stop();
     esp_bluedroid_disable();
@@ -23,6 +23,73 @@
 #define ENA_BEACON_LOG "ESP-ENA-beacon"                                  // TAG for Logging
 #define ENA_BEACON_TRESHOLD (CONFIG_ENA_BEACON_TRESHOLD)                 // meet for longer than 5 minutes
 #define ENA_BEACON_CLEANUP_TRESHOLD (CONFIG_ENA_BEACON_CLEANUP_TRESHOLD) // threshold (in days) for stored beacons to be removed
+#define ENA_BEACONS_QUEUE_SIZE (32)                                      // received beacons waiting for the beacon task
+#ifdef CONFIG_ENA_BEACONS_TEMP_CHECKPOINT_INTERVAL
+#define ENA_BEACONS_TEMP_CHECKPOINT_INTERVAL (CONFIG_ENA_BEACONS_TEMP_CHECKPOINT_INTERVAL) // interval in seconds to store temporary beacons kept in RAM
+#else
+#define ENA_BEACONS_TEMP_CHECKPOINT_INTERVAL (0)
+#endif
+
+/**
+ * @brief statistics of the temporary beacon hash table
+ */
+typedef struct
+{
+    uint32_t count;      // number of temporary beacons
+    uint32_t capacity;   // maximum number of temporary beacons
+    uint32_t table_size; // number of slots in hash table
+    uint32_t max_probe;  // longest probe sequence of a stored beacon
+    uint32_t lookups;    // total number of lookups
+    uint32_t probes;     // total number of probed slots on lookups
+    uint32_t dropped;    // total number of received beacons dropped on full queue
+} ena_beacons_temp_stats_t;
+
+/**
+ * @brief       start the beacon task
+ * 
+ * Received beacons are queued and handled by this task, so the BLE stack is never blocked by storage.
+ * Without the task, beacons are handled directly.
+ */
+void ena_beacons_start(void);
+
+/**
+ * @brief       queue a beacon received from a BLE scan
+ * 
+ * This never blocks, if the queue is full the beacon is dropped and counted.
+ * 
+ * @param[in]   unix_timestamp  UNIX timestamp when beacon was made
+ * @param[in]   rpi             received RPI from scanned payload
+ * @param[in]   aem             received AEM from scanned payload
+ * @param[in]   rssi            measured RSSI on scan
+ */
+void ena_beacons_receive(uint32_t unix_timestamp, uint8_t *rpi, uint8_t *aem, int rssi);
+
+/**
+ * @brief       queue refresh of temporary beacons after a BLE scan finished
+ * 
+ * @param[in]   unix_timestamp  current time as UNIX timestamp
+ */
+void ena_beacons_scan_finished(uint32_t unix_timestamp);
+
+/**
+ * @brief       get statistics of the temporary beacon hash table
+ * 
+ * @param[out]  stats   pointer to write statistics to
+ */
+void ena_beacons_temp_stats(ena_beacons_temp_stats_t *stats);
+
+/**
+ * @brief       store temporary beacons kept in RAM
+ * 
+ * With CONFIG_ENA_BEACONS_TEMP_RAM_ONLY temporary beacons are only kept in RAM and stored
+ * with one batched write by this function if changed. Otherwise this does nothing.
+ */
+void ena_beacons_temp_checkpoint(void);
+
+/**
+ * @brief       erase all temporary beacons in RAM and storage
+ */
+void ena_beacons_temp_erase(void);
 
 /**
  * @brief       check temporary beacon for threshold or expiring
@@ -38,7 +105,8 @@ void ena_beacons_temp_refresh(uint32_t unix_timestamp);
 /**
  * @brief       check stored beacons to expire
  * 
- * This function checks for all stored beacons if the last timestamp is over a threshold to remove the beacon.
+ * This function removes the stored beacons of all days older than the threshold. Beacons are kept in buckets per day,
+ * so expired days are dropped as a whole without reading any beacon.
  * 
  * @param[in]   unix_timestamp  current time as UNIX timestamp to compate
  * 
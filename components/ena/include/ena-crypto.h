@@ -26,6 +26,23 @@
 #define ENA_TEK_ROLLING_PERIOD (CONFIG_ENA_TEK_ROLLING_PERIOD) // TEKRollingPeriod
 
 #include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "mbedtls/aes.h"
+
+/**
+ * @brief keys derived from one TEK, kept to encrypt many RPIs and AEMs without deriving again
+ *
+ * The contexts hold the expanded AES key schedules of RPIK and AEMK, so they must not be copied by value.
+ */
+typedef struct
+{
+    uint8_t rpik[ENA_KEY_LENGTH];  // Rolling Proximity Identifier Key
+    uint8_t aemk[ENA_KEY_LENGTH];  // Associated Encrypted Metadata Key
+    mbedtls_aes_context rpik_aes;  // expanded RPIK
+    mbedtls_aes_context aemk_aes;  // expanded AEMK
+} ena_crypto_key_ctx_t;
 
 /**
  * @brief initialize cryptography 
@@ -123,4 +140,51 @@ void ena_crypto_aemk(uint8_t *aemk, uint8_t *tek);
  */
 void ena_crypto_aem(uint8_t *aem, uint8_t *aemk, uint8_t *rpi, uint8_t power_level);
 
+/**
+ * @brief derive RPIK and AEMK of a TEK and expand their AES keys
+ *
+ * Both keys share one HKDF extract of the TEK. The context has to be released with ena_crypto_key_ctx_free.
+ *
+ * @param[out] ctx context to initialize
+ * @param[in] tek TEK to derive keys from
+ */
+void ena_crypto_key_ctx_init(ena_crypto_key_ctx_t *ctx, uint8_t *tek);
+
+/**
+ * @brief release a context initialized by ena_crypto_key_ctx_init
+ *
+ * @param[in] ctx context to release
+ */
+void ena_crypto_key_ctx_free(ena_crypto_key_ctx_t *ctx);
+
+/**
+ * @brief calculate the RPIs of consecutive ENINs, e.g. all RPIs of a rolling period
+ *
+ * @param[in] ctx context of the TEK
+ * @param[in] enin_start ENIN of the first RPI
+ * @param[in] count number of RPIs to calculate
+ * @param[out] rpis pointer to count * ENA_KEY_LENGTH bytes for the RPIs
+ */
+void ena_crypto_rpi_range(ena_crypto_key_ctx_t *ctx, uint32_t enin_start, size_t count, uint8_t *rpis);
+
+/**
+ * @brief create AEM along the RPI with the AEMK of a context
+ *
+ * @param[in] ctx context of the TEK
+ * @param[out] aem pointer to the new AEM
+ * @param[in] rpi RPI for encrypting AEM
+ * @param[in] power_level BLE power level to encrypt in AEM
+ */
+void ena_crypto_key_ctx_aem(ena_crypto_key_ctx_t *ctx, uint8_t *aem, uint8_t *rpi, uint8_t power_level);
+
+/**
+ * @brief check key derivation, RPIs and AEM against the test vectors of the specification
+ *
+ * Also compares a batch of ena_crypto_rpi_range with single RPIs, so an accelerated backend has to be bit-exact.
+ *
+ * @return
+ *      true if all outputs match
+ */
+bool ena_crypto_self_test(void);
+
 #endif
\ No newline at end of file
@@ -21,11 +21,14 @@
 #define _ena_EXPOSURE_H_
 
 #include <stdio.h>
+#include <stdbool.h>
 #include "esp_err.h"
 #include "ena-storage.h"
 #include "ena-crypto.h"
 
 #define ENA_EXPOSURE_LOG "ESP-ENA-exposure" // TAG for Logging
+#define ENA_EXPOSURE_WORKER_BATCH (32)      // number of keys in one job of the matching worker
+#define ENA_EXPOSURE_WORKER_QUEUE_SIZE (2)  // jobs waiting for the matching worker
 
 /**
  * @brief report type
@@ -158,6 +161,55 @@ typedef struct __attribute__((__packed__))
     uint32_t days_since_onset_of_symptoms;
 } ena_temporary_exposure_key_t;
 
+/**
+ * @brief get duration risk level
+ * 
+ * @param[in] duration duration of the exposure in minutes
+ * 
+ * @return
+ *      ena_duration_risk_t level of the duration
+ */
+int ena_exposure_duration_level(int duration);
+
+/**
+ * @brief get days risk level
+ * 
+ * @param[in] days days since the exposure
+ * 
+ * @return
+ *      ena_day_risk_t level of the days
+ */
+int ena_exposure_days_level(int days);
+
+/**
+ * @brief get attenuation risk level
+ * 
+ * @param[in] attenuation attenuation of the exposure in dB
+ * 
+ * @return
+ *      ena_attenuation_risk_t level of the attenuation
+ */
+int ena_exposure_attenuation_level(int attenuation);
+
+/**
+ * @brief get risk class of exposure information
+ * 
+ * Exposure information of the same risk class and day have the same risk score for every exposure configuration.
+ * 
+ * @param[in] exposure_info the exposure information
+ * 
+ * @return
+ *      report type in bits 0-2, duration level in bits 3-5 and attenuation level in bits 6-8
+ */
+uint16_t ena_exposure_risk_class(ena_exposure_information_t *exposure_info);
+
+/**
+ * @brief store exposure information and count it in the exposure histogram
+ * 
+ * @param[in] exposure_info the exposure information to store
+ */
+void ena_exposure_add_exposure_information(ena_exposure_information_t *exposure_info);
+
 /**
  * @brief calculate transmission risk score
  * 
@@ -201,6 +253,9 @@ int ena_exposure_attenuation_risk_score(ena_exposure_config_t *config, ena_expos
 /**
  * @brief calculate overall risk score
  * 
+ * The risk values are looked up per attenuation, duration and days in tables built from the configuration, which
+ * are built again only when the configuration changed. Results equal the product of the single risk scores.
+ * 
  * @param[in] config the exposure configuration used for calculating score
  * @param[in] params the exposure parameter to calculate with
  * 
@@ -211,6 +266,9 @@ int ena_exposure_risk_score(ena_exposure_config_t *config, ena_exposure_paramete
 /**
  * @brief returns the current exposure summary
  * 
+ * The exposure information is counted per day and risk class when stored, so the summary is calculated from at most
+ * 15 days of the exposure histogram without reading exposure information.
+ * 
  * @param[in] config the exposure configuration used for calculating scores
  */
 void ena_exposure_summary(ena_exposure_config_t *config);
@@ -243,6 +301,9 @@ void ena_exposure_check(ena_beacon_t beacon, ena_temporary_exposure_key_t tempor
  * @brief find minimal key index of beacons for a certain timestamp
  * 
  * @param[in] timestamp              the timestamp to check against
+ * 
+ * @return
+ *          index of first beacon received at or after timestamp, number of beacons if there is none
  */
 int ena_expore_check_find_min(uint32_t timestamp);
 
@@ -250,6 +311,9 @@ int ena_expore_check_find_min(uint32_t timestamp);
  * @brief find maximum key index of beacons for a certain timestamp
  * 
  * @param[in] timestamp              the timestamp to check against
+ * 
+ * @return
+ *          index of last beacon received at or before timestamp, -1 if there is none
  */
 int ena_expore_check_find_max(uint32_t timestamp);
 
@@ -260,4 +324,115 @@ int ena_expore_check_find_max(uint32_t timestamp);
  */
 void ena_exposure_check_temporary_exposure_key(ena_temporary_exposure_key_t temporary_exposure_key);
 
+/**
+ * @brief check a batch of Temporary Exposure Keys for exposures with all beacons
+ * 
+ * The RPIK of every key is derived once and its RPIs are expanded once. Those RPIs are probed against 
+ * an in-RAM index of the stored beacon RPIs, so the costs grow with keys + beacons instead of keys * beacons.
+ * If the index does not fit into memory, beacons are indexed in chunks. One exposure information is stored 
+ * for every key with matching beacons.
+ * 
+ * On two cores, a helper task checks keys of the batch as well. Both probe a copy of the Bloom filter and the index
+ * without locking the storage, beacons are only read for RPIs with the prefix of an indexed beacon afterwards.
+ * 
+ * @param[in] temporary_exposure_keys   the temporary exposure keys to check
+ * @param[in] count                     number of temporary exposure keys
+ */
+void ena_exposure_check_temporary_exposure_keys(ena_temporary_exposure_key_t *temporary_exposure_keys, size_t count);
+
+/**
+ * @brief check keys on both cores, e.g. disable to compare the check time on one core
+ * 
+ * @param[in] enable    false to check keys on the calling core only, enabled by default
+ */
+void ena_exposure_helper_enable(bool enable);
+
+
+/**
+ * @brief begin checking a stream of Temporary Exposure Keys
+ * 
+ * The RPI index over all stored beacons is built once and used by every following call of 
+ * ena_exposure_check_temporary_exposure_keys, so keys can be checked in small batches while they are received.
+ * Beacons stored meanwhile are added to the index before each batch.
+ * Exposure information of matching keys is collected until ena_exposure_check_stream_end.
+ */
+void ena_exposure_check_stream_begin(void);
+
+/**
+ * @brief check if a stream of Temporary Exposure Keys is being checked
+ * 
+ * Beacons should not be cleaned up meanwhile, they might still match keys of the stream.
+ * 
+ * @return
+ *          true between ena_exposure_check_stream_begin and ena_exposure_check_stream_end
+ */
+bool ena_exposure_check_stream_active(void);
+
+/**
+ * @brief end checking a stream of Temporary Exposure Keys
+ * 
+ * @param[in] store     store the collected exposure information, false to discard them (e.g. on incomplete download)
+ * 
+ * @return
+ *          number of keys with matching beacons in the stream
+ */
+size_t ena_exposure_check_stream_end(bool store);
+
+
+/**
+ * @brief start the matching worker
+ * 
+ * The worker runs as task on the last core and handles queued jobs in order, so long running checks 
+ * never delay advertising and scanning. Without the worker, jobs are handled directly by the caller.
+ * Jobs may be sent by several tasks, the keys of one call are queued in order.
+ */
+void ena_exposure_worker_start(void);
+
+/**
+ * @brief queue begin of a stream of Temporary Exposure Keys, see ena_exposure_check_stream_begin
+ */
+void ena_exposure_worker_begin(void);
+
+/**
+ * @brief queue check of Temporary Exposure Keys
+ * 
+ * Keys are copied in jobs of ENA_EXPOSURE_WORKER_BATCH keys. This blocks while the queue is full.
+ * 
+ * @param[in] temporary_exposure_keys   the temporary exposure keys to check
+ * @param[in] count                     number of temporary exposure keys
+ */
+void ena_exposure_worker_check(ena_temporary_exposure_key_t *temporary_exposure_keys, size_t count);
+
+/**
+ * @brief queue end of a stream of Temporary Exposure Keys, see ena_exposure_check_stream_end
+ * 
+ * @param[in] store     store the collected exposure information, false to discard them
+ */
+void ena_exposure_worker_end(bool store);
+
+/**
+ * @brief queue update of the exposure summary
+ * 
+ * @param[in] config the exposure configuration used for calculating scores
+ */
+void ena_exposure_worker_summary(ena_exposure_config_t *config);
+
+/**
+ * @brief queue storing the date of the last check
+ * 
+ * The date is written after all queued streams ended and their exposure information is stored, so a power loss never
+ * commits the date without the exposures found until then.
+ * 
+ * @param[in] timestamp the date of the last check, see ena_storage_write_last_exposure_date
+ */
+void ena_exposure_worker_last_check(uint32_t timestamp);
+
+/**
+ * @brief get the date of the last check, including a date still queued
+ * 
+ * @return
+ *      the last queued date of the last check or the stored one, see ena_storage_read_last_exposure_date
+ */
+uint32_t ena_exposure_worker_last_check_date(void);
+
 #endif
\ No newline at end of file
@@ -28,6 +28,16 @@
 #define ENA_STORAGE_TEK_MAX (CONFIG_ENA_STORAGE_TEK_MAX)                                   // Period of storing TEKs                                                                            // length of a stored beacon -> RPI keysize + AEM size + 4 Bytes for ENIN + 4 Bytes for RSSI
 #define ENA_STORAGE_TEMP_BEACONS_MAX (CONFIG_ENA_STORAGE_TEMP_BEACONS_MAX)                 // Maximum number of temporary stored beacons                                                    // length of a stored beacon -> RPI keysize + AEM size + 4 Bytes for ENIN + 4 Bytes for RSSI
 #define ENA_STORAGE_EXPOSURE_INFORMATION_MAX (CONFIG_ENA_STORAGE_EXPOSURE_INFORMATION_MAX) // Maximum number of stored exposure information
+#define ENA_STORAGE_VERSION (7)                                                            // Version of storage layout, storage is erased on mismatch
+#define ENA_STORAGE_CACHE_BLOCKS (CONFIG_ENA_STORAGE_CACHE_BLOCKS)                         // Number of flash blocks cached in RAM for write-back
+#define ENA_STORAGE_FLUSH_INTERVAL (CONFIG_ENA_STORAGE_FLUSH_INTERVAL)                     // Interval in seconds to write back cached blocks
+#define ENA_STORAGE_BLOOM_BITS_PER_BEACON (CONFIG_ENA_STORAGE_BLOOM_BITS_PER_BEACON)       // Bloom filter bits per stored beacon, 0 disables the filter
+#define ENA_STORAGE_BLOOM_HASHES (CONFIG_ENA_STORAGE_BLOOM_HASHES)                         // Bloom filter bits probed per RPI
+#define ENA_STORAGE_BLOOM_MAX_SIZE (CONFIG_ENA_STORAGE_BLOOM_MAX_SIZE)                     // Maximum size of Bloom filter in bytes
+#define ENA_STORAGE_META_SECTORS (CONFIG_ENA_STORAGE_META_SECTORS)                         // Number of sectors the metadata rotates over
+#define ENA_STORAGE_BEACON_BUCKETS_MAX (CONFIG_ENA_BEACON_CLEANUP_TRESHOLD + 4)            // Maximum number of days in beacon log, days kept on cleanup plus current and spare days
+#define ENA_STORAGE_EXPOSURE_DAYS (14)                                                     // Number of latest days with own bucket in the exposure histogram
+#define ENA_STORAGE_EXPOSURE_CLASSES (16)                                                  // Maximum number of risk classes per day in the exposure histogram
 
 /**
  * @brief structure for TEK
@@ -51,6 +61,65 @@ typedef struct __attribute__((__packed__))
     int rssi;                             // average measured RSSI
 } ena_beacon_t;
 
+/**
+ * @brief filter for temporary beacons, returns true to keep the beacon
+ */
+typedef bool (*ena_storage_temp_beacon_filter_t)(ena_beacon_t *beacon, void *context);
+
+/**
+ * @brief header of the beacons of one UTC day in the beacon log
+ */
+typedef struct __attribute__((__packed__))
+{
+    uint32_t day;        // UTC day (unix timestamp / 86400) the beacons were first received on
+    uint32_t first_slot; // slot of the oldest beacon in the beacon log
+    uint32_t count;      // number of beacons
+} ena_storage_beacon_bucket_t;
+
+/**
+ * @brief statistics of the Bloom filter over stored beacon RPIs
+ */
+typedef struct
+{
+    uint32_t size;             // size of the filter in bytes, 0 if not loaded
+    uint32_t hashes;           // bits probed per RPI
+    uint32_t beacons;          // beacons in the filter
+    uint32_t capacity;         // beacons the filter is sized for, it is rebuilt larger when exceeded
+    float false_positive_rate; // estimated from the bits set
+    uint32_t lookups;          // RPIs checked
+    uint32_t rejects;          // RPIs rejected without reading beacons
+    uint32_t probes;           // bits probed
+    uint32_t rebuilds;         // filter built from stored beacons
+} ena_storage_bloom_stats_t;
+
+/**
+ * @brief copy of the Bloom filter over stored beacon RPIs, checked without locking the storage
+ */
+typedef struct
+{
+    uint32_t *bits;   // filter bits, NULL if there is no filter and every RPI is a candidate
+    uint32_t size;    // size of the filter in bytes
+    uint32_t lookups; // RPIs checked with this copy
+    uint32_t rejects; // RPIs rejected by this copy
+    uint32_t probes;  // bits probed in this copy
+} ena_storage_bloom_t;
+
+/**
+ * @brief erase statistics of the storage sectors
+ */
+typedef struct
+{
+    uint32_t sectors;           // sectors used by storage
+    uint32_t erases;            // erases of all sectors
+    uint32_t erases_max;        // erases of the most erased sector
+    uint32_t erases_max_sector; // number of the most erased sector in the partition
+    uint32_t meta_sectors;      // sectors of the metadata pool
+    uint32_t meta_erases_max;   // erases of the most erased sector of the metadata pool
+    uint32_t meta_commits;      // metadata records written
+    uint32_t fixed_erases_max;  // erases of the most erased sector of exposure information and temporary beacons
+    uint32_t log_erases_max;    // erases of the most erased sector of the beacon log
+} ena_storage_stats_t;
+
 /**
  * @brief structure for storing a Exposure Information (combined ExposureInformation, ExposureWindow and ScanInstance from Google API >= 1.5)
  */
@@ -63,6 +132,33 @@ typedef struct __attribute__((__packed__))
     int report_type;         // Type of diagnosis associated with a key.
 } ena_exposure_information_t;
 
+/**
+ * @brief number of exposure information of one risk class in the exposure histogram
+ */
+typedef struct __attribute__((__packed__))
+{
+    uint16_t risk_class; // risk class of the exposure information, see ena_exposure_risk_class
+    uint16_t count;      // number of exposure information, 0 if unused
+} ena_storage_exposure_class_t;
+
+/**
+ * @brief exposure information of one day in the exposure histogram
+ */
+typedef struct __attribute__((__packed__))
+{
+    uint32_t day;                                                        // day of the exposure information, latest day for the bucket of older days
+    ena_storage_exposure_class_t classes[ENA_STORAGE_EXPOSURE_CLASSES]; // number of exposure information per risk class
+} ena_storage_exposure_day_t;
+
+/**
+ * @brief stored exposure information counted per day and risk class, to calculate the exposure summary without reading them
+ */
+typedef struct __attribute__((__packed__))
+{
+    uint32_t count;                                                  // number of counted exposure information
+    ena_storage_exposure_day_t days[ENA_STORAGE_EXPOSURE_DAYS + 1]; // latest days with exposure information, last one for all older days
+} ena_storage_exposure_histogram_t;
+
 /**
  * @brief       read bytes at given address
  * 
@@ -81,6 +177,40 @@ void ena_storage_read(size_t address, void *data, size_t size);
  */
 void ena_storage_write(size_t address, void *data, size_t size);
 
+/**
+ * @brief       write back all modified cached blocks to flash
+ * 
+ * Writes are collected in a small block cache and only written to flash on flush or
+ * when a cached block has to be evicted. A block is only erased if written data
+ * requires to set bits, appending to erased space just programs the changed range.
+ * 
+ * Counts, last exposure date, TEKs and the beacon day buckets are kept in RAM and committed last as a new record to a
+ * pool of sectors, a pool sector is only erased when it is full and the records move on to the next one.
+ * The record is written with a CRC in one program operation, so all changes since the last flush take effect at once.
+ * After a power loss the previous record is used, data written since is not referred to.
+ */
+void ena_storage_flush(void);
+
+/**
+ * @brief       get the erase statistics of the storage sectors
+ * 
+ * Sectors of the metadata pool and of the beacon log keep their erase count in the sector, the other sectors in the
+ * metadata. The counts survive ena_storage_erase_all.
+ * 
+ * @param[out]  stats       pointer to write the statistics to
+ */
+void ena_storage_stats(ena_storage_stats_t *stats);
+
+/**
+ * @brief       get the erase count of a sector
+ * 
+ * @param[in]   sector      number of the sector in the partition
+ * 
+ * @return
+ *              number of erases of the sector since it is counted
+ */
+uint32_t ena_storage_sector_erases(uint32_t sector);
+
 /**
  * @brief       erase storage at given address
  * 
@@ -90,13 +220,12 @@ void ena_storage_write(size_t address, void *data, size_t size);
 void ena_storage_erase(size_t address, size_t size);
 
 /**
- * @brief       deletes bytes at given address and shift other data back
+ * @brief       get version of stored data layout
  * 
- * @param[in] address       the address to delete from
- * @param[in] end_address   the address to mark end of shift
- * @param[in] size          how many bytes to delete
+ * @return 
+ *              version of layout, storage has to be erased if not ENA_STORAGE_VERSION
  */
-void ena_storage_shift_delete(size_t address, size_t end_address, size_t size);
+uint32_t ena_storage_read_version(void);
 
 /**
  * @brief       get timestamp of most recent exposure data
@@ -168,10 +297,33 @@ void ena_storage_get_exposure_information(uint32_t index, ena_exposure_informati
 /**
  * @brief       store exposure information
  * 
+ * The exposure histogram is not updated, it is counted again on next load. Use ena_exposure_add_exposure_information
+ * to count it in the exposure histogram right away.
+ * 
  * @param[in]   exposure_info   new exposure information to store 
  */
 void ena_storage_add_exposure_information(ena_exposure_information_t *exposure_info);
 
+/**
+ * @brief       store the exposure histogram
+ * 
+ * The histogram is written to the other of two slots and takes effect with the next ena_storage_flush, together with
+ * the exposure information added in the meantime.
+ * 
+ * @param[in]   histogram   the exposure histogram to store
+ */
+void ena_storage_write_exposure_histogram(ena_storage_exposure_histogram_t *histogram);
+
+/**
+ * @brief       read the exposure histogram
+ * 
+ * @param[out]  histogram   pointer to exposure histogram to write to
+ * 
+ * @return
+ *              false if no valid exposure histogram is stored
+ */
+bool ena_storage_read_exposure_histogram(ena_storage_exposure_histogram_t *histogram);
+
 /**
  * @brief       get number of stored temporary beacons
  * 
@@ -207,41 +359,244 @@ uint32_t ena_storage_add_temp_beacon(ena_beacon_t *beacon);
 void ena_storage_set_temp_beacon(uint32_t index, ena_beacon_t *beacon);
 
 /**
- * @brief       remove temporary beacon at given index
+ * @brief       store all temporary beacons at once
+ * 
+ * The temporary beacons are written to the other of two slots and take effect with the next ena_storage_flush,
+ * together with beacons added to the log in the meantime. Until then, further calls overwrite the same slot and the
+ * committed one is kept.
+ * 
+ * @param[in]   beacons     array of temporary beacons to store
+ * @param[in]   count       number of temporary beacons
+ */
+void ena_storage_write_temp_beacons(ena_beacon_t *beacons, uint32_t count);
+
+/**
+ * @brief       read all temporary beacons stored with ena_storage_write_temp_beacons
  * 
- * @param[in]   index       the index of the temporary beacon to remove
+ * @param[out]  beacons     array to write temporary beacons to
+ * @param[in]   max         maximum number of temporary beacons to read
+ * 
+ * @return
+ *              number of read temporary beacons, 0 if stored data is invalid
+ */
+uint32_t ena_storage_read_temp_beacons(ena_beacon_t *beacons, uint32_t max);
+
+/**
+ * @brief       keep only the temporary beacons accepted by a filter
+ * 
+ * The accepted temporary beacons are copied in order to the other slot with one sequential write, which takes effect
+ * with the next ena_storage_flush. A slot not committed yet is compacted in place instead. The cost does not depend
+ * on the number of removed temporary beacons.
+ * 
+ * @param[in]   retain      function returning true for a temporary beacon to keep
+ * @param[in]   context     passed to retain
+ * 
+ * @return
+ *              number of kept temporary beacons
  */
-void ena_storage_remove_temp_beacon(uint32_t index);
+uint32_t ena_storage_retain_temp_beacons(ena_storage_temp_beacon_filter_t retain, void *context);
 
 /**
  * @brief       get number of permanently stored beacons
  * 
+ * This is the sum of the counts of all day buckets.
+ * 
  * @return
  *              total number of beacons stored
  */
 uint32_t ena_storage_beacons_count(void);
 
+/**
+ * @brief       get maximum number of permanently stored beacons
+ * 
+ * Beacons are stored in a log of flash blocks, each holding a fixed number of beacons. Every day starts at a new block,
+ * so some slots of the last block of a day stay unused. In the log, a beacon is a compact record of 25 bytes with
+ * timestamps relative to its day, an int8 RSSI and a duration up to about 4.5 hours.
+ * 
+ * @return
+ *              number of beacons fitting in storage
+ */
+uint32_t ena_storage_beacons_capacity(void);
+
 /**
  * @brief       get permanently stored beacon at given index
  * 
+ * Beacons are indexed in order of storing, index 0 is the oldest beacon. The compact record is decoded to a beacon.
+ * 
  * @param[in]   index       the index of the beacon to read
  * @param[out] beacon    pointer to to write to
  */
 void ena_storage_get_beacon(uint32_t index, ena_beacon_t *beacon);
 
+/**
+ * @brief       get consecutive permanently stored beacons starting at given index
+ *
+ * This reads all requested beacons with one storage read per flash block.
+ *
+ * @param[in]   index       the index of the first beacon to read
+ * @param[out]  beacons     pointer to an array of at least count beacons to write to
+ * @param[in]   count       number of beacons to read
+ */
+void ena_storage_get_beacons(uint32_t index, ena_beacon_t *beacons, size_t count);
+
+/**
+ * @brief       get sequence number of the oldest permanently stored beacon
+ *
+ * Beacons are numbered in order of storing. Unlike its index, the sequence number of a beacon does not change when
+ * older beacons are removed, so it stays valid while other tasks add and remove beacons. Numbers start at 0 on every
+ * start and are only kept in RAM.
+ *
+ * @return
+ *              sequence number of the oldest beacon, the sequence number of the beacon at index i is this plus i
+ */
+uint32_t ena_storage_beacons_sequence(void);
+
+/**
+ * @brief       get permanently stored beacon by its sequence number
+ *
+ * @param[in]   sequence    the sequence number of the beacon to read, see ena_storage_beacons_sequence
+ * @param[out]  beacon      pointer to write to
+ *
+ * @return
+ *              false if the beacon was removed meanwhile or is not stored yet
+ */
+bool ena_storage_get_beacon_sequence(uint32_t sequence, ena_beacon_t *beacon);
+
+/**
+ * @brief       get consecutive permanently stored beacons starting at given sequence number
+ *
+ * If the beacon with the sequence number was removed meanwhile, reading starts at the oldest beacon.
+ *
+ * @param[in,out] sequence  the sequence number of the first beacon to read, set to the sequence number of the first beacon read
+ * @param[out]  beacons     pointer to an array of at least count beacons to write to
+ * @param[in]   count       maximum number of beacons to read
+ *
+ * @return
+ *              number of beacons read, less than count at the end of the log
+ */
+size_t ena_storage_get_beacons_sequence(uint32_t *sequence, ena_beacon_t *beacons, size_t count);
+
+/**
+ * @brief       permanently store beacons
+ * 
+ * Same as ena_storage_add_beacon for every beacon, but the day buckets are only updated once and consecutive beacons
+ * are collected in the same cached block, so storing many beacons costs one program per block.
+ * 
+ * @param[in]   beacons     array of new beacons to permanently store
+ * @param[in]   count       number of beacons
+ */
+void ena_storage_add_beacons(ena_beacon_t *beacons, size_t count);
+
 /**
  * @brief       permanently store beacon
  * 
+ * The beacon is appended to the bucket of the day it was first received on, the first beacon of a new day starts a
+ * new bucket. A late beacon of an earlier day is appended to the latest bucket. If the log is full, the block with the
+ * oldest beacons is dropped, if all buckets are in use, the oldest day is dropped.
+ * 
  * @param[in]   beacon   new beacon to permanently store 
  */
 void ena_storage_add_beacon(ena_beacon_t *beacon);
 
 /**
- * @brief       remove beacon at given index
+ * @brief       find first permanently stored beacon not received before given timestamp
+ * 
+ * Beacons are stored in order of time. Buckets of days before the timestamp are skipped by their header, a fence
+ * index in RAM with the first timestamp of every flash block narrows the search to one block of the day, which is then
+ * searched with one storage read.
  * 
- * @param[in]   index       the index of the beacon to remove
+ * @param[in]   timestamp   the timestamp to search for
+ * 
+ * @return
+ *              index of first beacon with timestamp_first >= timestamp, number of beacons if there is none
+ */
+uint32_t ena_storage_beacons_lower_bound(uint32_t timestamp);
+
+/**
+ * @brief       find first permanently stored beacon received after given timestamp
+ * 
+ * @param[in]   timestamp   the timestamp to search for
+ * 
+ * @return
+ *              index of first beacon with timestamp_first > timestamp, number of beacons if there is none
+ */
+uint32_t ena_storage_beacons_upper_bound(uint32_t timestamp);
+
+/**
+ * @brief       check RPIs against the Bloom filter of stored beacons
+ * 
+ * The filter is built from the stored beacons on first use and after beacons were removed, then kept up to date by
+ * ena_storage_add_beacon. A rejected RPI is not stored, a candidate might be.
+ * 
+ * @param[in]   rpis        RPIs to check, count * ENA_KEY_LENGTH bytes
+ * @param[in]   count       number of RPIs
+ * @param[out]  candidates  for every RPI false if it is not stored, true if it might be
+ * 
+ * @return
+ *              number of candidates
+ */
+size_t ena_storage_beacons_bloom_check(uint8_t *rpis, size_t count, bool *candidates);
+
+/**
+ * @brief       copy the Bloom filter of stored beacons
+ * 
+ * The copy is not updated by storing beacons, it is meant for checking a batch of RPIs on several cores without
+ * taking the storage lock for every check. Without filter or memory for the copy, every RPI is a candidate.
+ * 
+ * @param[out]  bloom       pointer to write the copy to, free it with ena_storage_beacons_bloom_release
+ */
+void ena_storage_beacons_bloom_copy(ena_storage_bloom_t *bloom);
+
+/**
+ * @brief       check RPIs against a copy of the Bloom filter
+ * 
+ * Same as ena_storage_beacons_bloom_check, but without the storage lock. Checks of a copy are counted in the copy,
+ * several tasks may check the same bits with their own copy of the structure.
+ * 
+ * @param[in,out] bloom     the copy to check against, see ena_storage_beacons_bloom_copy
+ * @param[in]   rpis        RPIs to check, count * ENA_KEY_LENGTH bytes
+ * @param[in]   count       number of RPIs
+ * @param[out]  candidates  for every RPI false if it is not stored, true if it might be
+ * 
+ * @return
+ *              number of candidates
+ */
+size_t ena_storage_bloom_check(ena_storage_bloom_t *bloom, uint8_t *rpis, size_t count, bool *candidates);
+
+/**
+ * @brief       add the checks of a copy of the Bloom filter to the statistics and free the copy
+ * 
+ * @param[in]   bloom       the copy to release
+ */
+void ena_storage_beacons_bloom_release(ena_storage_bloom_t *bloom);
+
+/**
+ * @brief       get statistics of the Bloom filter over stored beacon RPIs
+ * 
+ * @param[out]  stats       pointer to write the statistics to
+ */
+void ena_storage_beacons_bloom_stats(ena_storage_bloom_stats_t *stats);
+
+/**
+ * @brief       remove the oldest beacons
+ * 
+ * Blocks without any remaining beacon are erased, no other data is rewritten.
+ * 
+ * @param[in]   count       number of oldest beacons to remove
+ */
+void ena_storage_remove_beacons(uint32_t count);
+
+/**
+ * @brief       remove the buckets of all days before the day of given timestamp
+ * 
+ * Whole days are dropped by their header and blocks, no beacon is read.
+ * 
+ * @param[in]   timestamp   timestamp of the first day to keep
+ * 
+ * @return
+ *              number of removed beacons
  */
-void ena_storage_remove_beacon(uint32_t index);
+uint32_t ena_storage_remove_beacons_before(uint32_t timestamp);
 
 /**
  * @brief       erase the storage
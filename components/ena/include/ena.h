@@ -27,7 +27,7 @@
 /**
  * @brief       Run Exposure Notification API
  * 
- * This runs the complete BLE logic
+ * This runs the timing of TEK rotation, advertising and scanning. It is called every second by the ENA task.
  * 
  */
 void ena_run(void);
@@ -35,8 +35,8 @@ void ena_run(void);
 /**
  * @brief       Start Exposure Notification API
  * 
- * This initializes the complete stack of ESP_ENA. It will initialize BLE module and 
- * starting a task for managing advertising and scanning processes.
+ * This initializes the complete stack of ESP_ENA. It will initialize BLE module and start tasks for
+ * timing of advertising and scanning, handling received beacons, writing back storage and checking exposures.
  * 
  */
 void ena_start(void);
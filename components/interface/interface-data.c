@@ -23,6 +23,7 @@
 #include "display-gfx.h"
 
 #include "ena-storage.h"
+#include "ena-beacons.h"
 
 #include "interface.h"
 
@@ -72,7 +73,7 @@ void interface_data_rst(void)
             ena_storage_erase_exposure_information();
             break;
         case INTERFACE_DATA_DEL_TEMP_RPI:
-            ena_storage_erase_temporary_beacon();
+            ena_beacons_temp_erase();
             break;
         case INTERFACE_DATA_DEL_RPI:
             ena_storage_erase_beacon();
@@ -82,6 +83,7 @@ void interface_data_rst(void)
             break;
         case INTERFACE_DATA_DEL_ALL:
             ena_storage_erase_all();
+            ena_beacons_temp_erase();
             break;
         }
 
@@ -58,6 +58,7 @@ void interface_set_display_function(interface_display_function display_function)
     {
         (*current_display_function)();
     }
+    display_flush();
     busy = false;
 }
 
@@ -69,6 +70,7 @@ void interface_set_display_refresh_function(interface_display_function display_f
     {
         (*current_display_function)();
     }
+    display_flush();
     busy = false;
 }
 
@@ -85,6 +87,7 @@ void interface_execute_command(interface_command_t command)
             {
                 (*current_display_function)();
             }
+            display_flush();
             busy = false;
         }
     }
@@ -113,10 +116,16 @@ void interface_display_task(void *pvParameter)
         if (!interface_idle && !busy && current_display_refresh_function != NULL)
         {
             (*current_display_refresh_function)();
+            display_flush();
             vTaskDelay(500 / portTICK_PERIOD_MS);
         }
         else
         {
+            // changes drawn outside of display functions
+            if (!busy)
+            {
+                display_flush();
+            }
             vTaskDelay(100 / portTICK_PERIOD_MS);
         }
     }
@@ -143,6 +152,7 @@ void interface_start(void)
 
     display_start();
     display_clear();
+    display_flush();
 
     xTaskCreate(&interface_display_task, "interface_display_task", 4096, NULL, 5, NULL);
     
@@ -159,5 +169,6 @@ void interface_flipped(bool flipped)
     {
         (*current_display_function)();
     }
+    display_flush();
     busy = false;
 }
\ No newline at end of file
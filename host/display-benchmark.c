@@ -0,0 +1,177 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+
+#include "display.h"
+#include "display-gfx.h"
+#include "display-framebuffer.h"
+
+#include "host-display.h"
+
+/**
+ * @brief snapshot of time and panel statistics at start of an operation
+ */
+typedef struct
+{
+    struct timespec start;
+    host_display_stats_t stats;
+} benchmark_measure_t;
+
+static void benchmark_start(benchmark_measure_t *measure)
+{
+    host_display_stats(&measure->stats);
+    clock_gettime(CLOCK_MONOTONIC, &measure->start);
+}
+
+static void benchmark_report(const char *operation, size_t ops, benchmark_measure_t *measure)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    host_display_stats_t stats;
+    host_display_stats(&stats);
+
+    double seconds = (end.tv_sec - measure->start.tv_sec) + (end.tv_nsec - measure->start.tv_nsec) / 1e9;
+    double per_op = ops > 0 ? 1.0 / ops : 0;
+    printf("%-18s %8zu %12.1f %12.1f %12.1f %12.1f\n",
+           operation, ops,
+           seconds * 1e6 * per_op,
+           (stats.transactions - measure->stats.transactions) * per_op,
+           (stats.bytes - measure->stats.bytes) * per_op,
+           (stats.windows - measure->stats.windows) * per_op);
+}
+
+/**
+ * @brief draw a screen like the interface does on interface_set_display_function
+ */
+static void benchmark_screen(void)
+{
+    display_clear();
+    display_menu_headline("Status", true, 0);
+    display_text_line_column("01.01.2021", 2, 3, false);
+    display_text_line_column("12:00:00", 3, 4, false);
+    display_data(display_gfx_wifi, 8, 2, 15 * 8, false);
+    display_text_line("No exposure", 4, false);
+    display_set_button("Back", false, false);
+    display_set_button("OK", true, true);
+}
+
+static void benchmark_usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-r refreshes] [-v]\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    size_t refreshes = 120;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r:v")) != -1)
+    {
+        switch (opt)
+        {
+        case 'r':
+            refreshes = strtoul(optarg, NULL, 10);
+            break;
+        case 'v':
+            host_log_level++;
+            break;
+        default:
+            benchmark_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    display_start();
+
+    printf("%-18s %8s %12s %12s %12s %12s\n", "operation", "ops", "us/op", "trans/op", "bytes/op", "windows/op");
+
+    benchmark_measure_t measure;
+
+    benchmark_start(&measure);
+    display_clear();
+    display_flush();
+    benchmark_report("clear", 1, &measure);
+
+    benchmark_start(&measure);
+    benchmark_screen();
+    display_flush();
+    benchmark_report("screen", 1, &measure);
+
+    // refresh twice a second, like interface_main_display_refresh: wifi icon, date and time
+    char time_text[9];
+    benchmark_start(&measure);
+    for (size_t i = 0; i < refreshes; i++)
+    {
+        snprintf(time_text, sizeof(time_text), "12:%02zu:%02zu", (i / 120) % 60, (i / 2) % 60);
+        display_data(display_gfx_wifi, 8, 2, 15 * 8, false);
+        display_text_line_column("01.01.2021", 2, 3, false);
+        display_text_line_column(time_text, 3, 4, false);
+        display_flush();
+    }
+    benchmark_report("clock refresh", refreshes, &measure);
+
+    benchmark_start(&measure);
+    display_clear_line(5, true);
+    display_text_line_column("selected", 5, 4, true);
+    display_flush();
+    benchmark_report("inverted line", 1, &measure);
+
+    // the panel must look the same as after sending the complete framebuffer
+    uint16_t *panel = malloc(HOST_DISPLAY_WIDTH * HOST_DISPLAY_HEIGHT * sizeof(uint16_t));
+    if (panel == NULL)
+    {
+        fprintf(stderr, "not enough memory for panel copy\n");
+        return EXIT_FAILURE;
+    }
+    for (uint16_t y = 0; y < HOST_DISPLAY_HEIGHT; y++)
+    {
+        for (uint16_t x = 0; x < HOST_DISPLAY_WIDTH; x++)
+        {
+            panel[y * HOST_DISPLAY_WIDTH + x] = host_display_pixel(x, y);
+        }
+    }
+
+    benchmark_start(&measure);
+    display_framebuffer_invalidate();
+    display_flush();
+    benchmark_report("full frame", 1, &measure);
+
+    size_t differences = 0;
+    for (uint16_t y = 0; y < HOST_DISPLAY_HEIGHT; y++)
+    {
+        for (uint16_t x = 0; x < HOST_DISPLAY_WIDTH; x++)
+        {
+            if (panel[y * HOST_DISPLAY_WIDTH + x] != host_display_pixel(x, y))
+            {
+                differences++;
+            }
+        }
+    }
+    display_framebuffer_stats_t display_stats;
+    display_framebuffer_stats(&display_stats);
+    printf("\n%u frames, %u windows, %u transfers, %u bytes of pixel data\n",
+           display_stats.frames, display_stats.windows, display_stats.transfers, display_stats.bytes);
+    printf("%u glyphs from cache, %u rendered, %u unchanged\n", display_stats.glyph_hits, display_stats.glyph_misses, display_stats.glyph_skips);
+    printf("%zu of %d pixels differ from full frame\n", differences, HOST_DISPLAY_WIDTH * HOST_DISPLAY_HEIGHT);
+
+    free(panel);
+
+    return differences == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,439 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "host-crypto.h"
+
+#include "ena-crypto.h"
+#include "ena-storage.h"
+#include "ena-beacons.h"
+#include "ena-exposure.h"
+
+#define BENCHMARK_DAY (60 * 60 * 24)  // seconds of a day
+#define BENCHMARK_DAYS (14)           // days of synthetic beacon history
+#define BENCHMARK_STREAM_BATCH (32)  // keys checked at once while streaming, see ENA_EKE_PROXY_KEY_BATCH
+#define BENCHMARK_META_FLUSHES (1000) // metadata updates written back one by one
+#define BENCHMARK_RISK_PARAMS (4096)  // random exposure parameters scored
+#define BENCHMARK_RISK_ROUNDS (256)   // rounds of scoring all random exposure parameters
+
+/**
+ * @brief options of a benchmark run
+ */
+typedef struct
+{
+    size_t beacons;      // number of stored beacons
+    size_t keys;         // number of downloaded diagnosis keys
+    size_t matches;      // number of diagnosis keys with a stored beacon
+    size_t scans;        // number of distinct beacons received during scan
+    unsigned int seed;   // seed for synthetic data
+    const char *file;    // file backing the partition, NULL for RAM
+} benchmark_options_t;
+
+/**
+ * @brief snapshot of time and flash statistics at start of an operation
+ */
+typedef struct
+{
+    struct timespec start;
+    host_partition_stats_t stats;
+} benchmark_measure_t;
+
+static void benchmark_start(benchmark_measure_t *measure)
+{
+    host_partition_stats(&measure->stats);
+    clock_gettime(CLOCK_MONOTONIC, &measure->start);
+}
+
+static void benchmark_report(const char *operation, size_t ops, benchmark_measure_t *measure)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    host_partition_stats_t stats;
+    host_partition_stats(&stats);
+
+    double seconds = (end.tv_sec - measure->start.tv_sec) + (end.tv_nsec - measure->start.tv_nsec) / 1e9;
+    double per_op = ops > 0 ? 1.0 / ops : 0;
+    printf("%-18s %8zu %12.1f %12.1f %12.1f %10.3f %10.3f\n",
+           operation, ops,
+           seconds > 0 ? ops / seconds : 0,
+           seconds * 1e6 * per_op,
+           (stats.bytes_read - measure->stats.bytes_read) * per_op,
+           (stats.bytes_written - measure->stats.bytes_written) * per_op,
+           (stats.erase_count - measure->stats.erase_count) * per_op);
+}
+
+static void benchmark_random(void *buf, size_t len)
+{
+    uint8_t *bytes = buf;
+    for (size_t i = 0; i < len; i++)
+    {
+        bytes[i] = (uint8_t)rand();
+    }
+}
+
+static int benchmark_beacon_compare(const void *a, const void *b)
+{
+    const ena_beacon_t *beacon_a = a;
+    const ena_beacon_t *beacon_b = b;
+    if (beacon_a->timestamp_first < beacon_b->timestamp_first)
+    {
+        return -1;
+    }
+    return beacon_a->timestamp_first > beacon_b->timestamp_first;
+}
+
+/**
+ * @brief create a synthetic beacon history with keys of which some have been met
+ */
+static void benchmark_generate(benchmark_options_t *options, uint32_t now, ena_beacon_t *beacons, ena_temporary_exposure_key_t *keys)
+{
+    uint32_t today_enin = ena_crypto_enin(now) / ENA_TEK_ROLLING_PERIOD * ENA_TEK_ROLLING_PERIOD;
+    ena_crypto_key_ctx_t key_ctx;
+
+    for (size_t i = 0; i < options->keys; i++)
+    {
+        ena_temporary_exposure_key_t *key = &keys[i];
+        benchmark_random(key->key_data, ENA_KEY_LENGTH);
+        key->transmission_risk_level = rand() % 8;
+        key->rolling_start_interval_number = today_enin - (1 + rand() % (BENCHMARK_DAYS - 1)) * ENA_TEK_ROLLING_PERIOD;
+        key->rolling_period = ENA_TEK_ROLLING_PERIOD;
+        key->report_type = CONFIRMED_TEST_STANDARD;
+        key->days_since_onset_of_symptoms = 0;
+
+        // the first keys have been met, one beacon per key
+        if (i < options->matches && i < options->beacons)
+        {
+            uint32_t enin = key->rolling_start_interval_number + rand() % (ENA_TEK_ROLLING_PERIOD - 4);
+            ena_crypto_key_ctx_init(&key_ctx, key->key_data);
+            ena_crypto_rpi_range(&key_ctx, enin, 1, beacons[i].rpi);
+            ena_crypto_key_ctx_free(&key_ctx);
+            beacons[i].timestamp_first = enin * ENA_TIME_WINDOW + rand() % ENA_TIME_WINDOW;
+            beacons[i].timestamp_last = beacons[i].timestamp_first + ENA_BEACON_TRESHOLD + rand() % (3 * ENA_TIME_WINDOW);
+            benchmark_random(beacons[i].aem, ENA_AEM_METADATA_LENGTH);
+            beacons[i].rssi = -40 - rand() % 60;
+        }
+    }
+
+    for (size_t i = options->matches < options->beacons ? options->matches : options->beacons; i < options->beacons; i++)
+    {
+        benchmark_random(beacons[i].rpi, ENA_KEY_LENGTH);
+        benchmark_random(beacons[i].aem, ENA_AEM_METADATA_LENGTH);
+        beacons[i].timestamp_first = now - BENCHMARK_DAYS * BENCHMARK_DAY + rand() % ((BENCHMARK_DAYS - 1) * BENCHMARK_DAY);
+        beacons[i].timestamp_last = beacons[i].timestamp_first + ENA_BEACON_TRESHOLD + rand() % (3 * ENA_TIME_WINDOW);
+        beacons[i].rssi = -40 - rand() % 60;
+    }
+
+    // beacons are stored in order of appearance
+    qsort(beacons, options->beacons, sizeof(ena_beacon_t), benchmark_beacon_compare);
+
+    // mix matching keys into the download
+    for (size_t i = 0; i < options->keys; i++)
+    {
+        size_t j = rand() % options->keys;
+        ena_temporary_exposure_key_t tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+}
+
+static void benchmark_usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-b beacons] [-k keys] [-m matching keys] [-t scanned beacons] [-s seed] [-f partition file] [-v]\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    benchmark_options_t options = {
+        .beacons = 5000,
+        .keys = 1000,
+        .matches = 10,
+        .scans = 200,
+        .seed = 1,
+        .file = NULL,
+    };
+
+    int opt;
+    while ((opt = getopt(argc, argv, "b:k:m:t:s:f:v")) != -1)
+    {
+        switch (opt)
+        {
+        case 'b':
+            options.beacons = strtoul(optarg, NULL, 10);
+            break;
+        case 'k':
+            options.keys = strtoul(optarg, NULL, 10);
+            break;
+        case 'm':
+            options.matches = strtoul(optarg, NULL, 10);
+            break;
+        case 't':
+            options.scans = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            options.seed = strtoul(optarg, NULL, 10);
+            break;
+        case 'f':
+            options.file = optarg;
+            break;
+        case 'v':
+            host_log_level++;
+            break;
+        default:
+            benchmark_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (options.matches > options.keys)
+    {
+        options.matches = options.keys;
+    }
+    if (options.scans > ENA_STORAGE_TEMP_BEACONS_MAX)
+    {
+        options.scans = ENA_STORAGE_TEMP_BEACONS_MAX;
+    }
+
+    srand(options.seed);
+    ESP_ERROR_CHECK(host_partition_init(options.file));
+    ena_crypto_init();
+    ena_storage_erase_all();
+
+    uint32_t now = (uint32_t)time(NULL);
+    ena_beacon_t *beacons = calloc(options.beacons > 0 ? options.beacons : 1, sizeof(ena_beacon_t));
+    ena_temporary_exposure_key_t *keys = calloc(options.keys > 0 ? options.keys : 1, sizeof(ena_temporary_exposure_key_t));
+    if (beacons == NULL || keys == NULL)
+    {
+        fprintf(stderr, "not enough memory for %zu beacons and %zu keys\n", options.beacons, options.keys);
+        return EXIT_FAILURE;
+    }
+    benchmark_generate(&options, now, beacons, keys);
+
+    printf("%-18s %8s %12s %12s %12s %10s %10s\n", "operation", "ops", "ops/s", "us/op", "read B/op", "write B/op", "erases/op");
+
+    benchmark_measure_t measure;
+
+    // store beacon history
+    benchmark_start(&measure);
+    for (size_t i = 0; i < options.beacons; i++)
+    {
+        ena_storage_add_beacon(&beacons[i]);
+    }
+    ena_storage_flush();
+    benchmark_report("add beacon", options.beacons, &measure);
+
+    // scan: every beacon received twice, long enough apart to be stored permanently on refresh
+    uint8_t rpi[ENA_KEY_LENGTH];
+    uint8_t aem[ENA_AEM_METADATA_LENGTH];
+    unsigned int scan_seed = rand();
+    benchmark_start(&measure);
+    for (int round = 0; round < 2; round++)
+    {
+        srand(scan_seed);
+        for (size_t i = 0; i < options.scans; i++)
+        {
+            benchmark_random(rpi, ENA_KEY_LENGTH);
+            benchmark_random(aem, ENA_AEM_METADATA_LENGTH);
+            ena_beacon(now + round * ENA_BEACON_TRESHOLD, rpi, aem, -40 - (int)(i % 60));
+        }
+    }
+    ena_storage_flush();
+    benchmark_report("scan beacon", options.scans * 2, &measure);
+
+    ena_beacons_temp_stats_t temp_stats;
+    ena_beacons_temp_stats(&temp_stats);
+
+    benchmark_start(&measure);
+    ena_beacons_temp_refresh(now + ENA_BEACON_TRESHOLD);
+    benchmark_report("temp refresh", 1, &measure);
+
+    // all RPIs of the downloaded keys, with mbedTLS one block and key schedule at a time and with every batch backend
+    uint8_t rpik[ENA_KEY_LENGTH];
+    uint8_t range_rpis[ENA_TEK_ROLLING_PERIOD * ENA_KEY_LENGTH];
+    size_t rpi_mismatches = 0;
+    benchmark_start(&measure);
+    for (size_t i = 0; i < options.keys; i++)
+    {
+        ena_crypto_rpik(rpik, keys[i].key_data);
+        for (int j = 0; j < ENA_TEK_ROLLING_PERIOD; j++)
+        {
+            ena_crypto_rpi(rpi, rpik, keys[i].rolling_start_interval_number + j);
+        }
+    }
+    benchmark_report("rpi mbedTLS", options.keys * ENA_TEK_ROLLING_PERIOD, &measure);
+
+    host_crypto_backend_t detected_backend = host_crypto_backend();
+    ena_crypto_key_ctx_t key_ctx;
+    bool test_vectors = true;
+    for (host_crypto_backend_t backend = HOST_CRYPTO_BITSLICE; backend <= HOST_CRYPTO_AESNI; backend++)
+    {
+        if (!host_crypto_backend_select(backend))
+        {
+            continue;
+        }
+
+        char operation[32];
+        snprintf(operation, sizeof(operation), "rpi %s", host_crypto_backend_name(backend));
+        benchmark_start(&measure);
+        for (size_t i = 0; i < options.keys; i++)
+        {
+            ena_crypto_key_ctx_init(&key_ctx, keys[i].key_data);
+            ena_crypto_rpi_range(&key_ctx, keys[i].rolling_start_interval_number, ENA_TEK_ROLLING_PERIOD, range_rpis);
+            ena_crypto_key_ctx_free(&key_ctx);
+        }
+        benchmark_report(operation, options.keys * ENA_TEK_ROLLING_PERIOD, &measure);
+
+        // every backend has to match the test vectors of the specification and derive the same RPIs as mbedTLS
+        test_vectors &= ena_crypto_self_test();
+        for (size_t i = 0; i < options.keys; i++)
+        {
+            ena_crypto_rpik(rpik, keys[i].key_data);
+            ena_crypto_key_ctx_init(&key_ctx, keys[i].key_data);
+            ena_crypto_rpi_range(&key_ctx, keys[i].rolling_start_interval_number, ENA_TEK_ROLLING_PERIOD, range_rpis);
+            ena_crypto_key_ctx_free(&key_ctx);
+            for (int j = 0; j < ENA_TEK_ROLLING_PERIOD; j++)
+            {
+                ena_crypto_rpi(rpi, rpik, keys[i].rolling_start_interval_number + j);
+                rpi_mismatches += memcmp(rpi, &range_rpis[j * ENA_KEY_LENGTH], ENA_KEY_LENGTH) != 0;
+            }
+        }
+    }
+    host_crypto_backend_select(detected_backend);
+
+    // check downloaded diagnosis keys
+    benchmark_start(&measure);
+    ena_exposure_check_temporary_exposure_keys(keys, options.keys);
+    ena_storage_flush();
+    benchmark_report("check key", options.keys, &measure);
+
+    uint32_t exposures = ena_storage_exposure_information_count();
+    ena_storage_bloom_stats_t bloom_stats;
+
+    // check the same keys in download sized batches, like received from the key export proxy
+    benchmark_start(&measure);
+    ena_exposure_check_stream_begin();
+    for (size_t i = 0; i < options.keys; i += BENCHMARK_STREAM_BATCH)
+    {
+        size_t batch = (options.keys - i) < BENCHMARK_STREAM_BATCH ? (options.keys - i) : BENCHMARK_STREAM_BATCH;
+        ena_exposure_check_temporary_exposure_keys(&keys[i], batch);
+    }
+    size_t stream_matches = ena_exposure_check_stream_end(false);
+    benchmark_report("stream check key", options.keys, &measure);
+    ena_storage_beacons_bloom_stats(&bloom_stats);
+
+    // the same on one core, to compare with the helper task on the other core
+    ena_exposure_helper_enable(false);
+    benchmark_start(&measure);
+    ena_exposure_check_stream_begin();
+    for (size_t i = 0; i < options.keys; i += BENCHMARK_STREAM_BATCH)
+    {
+        size_t batch = (options.keys - i) < BENCHMARK_STREAM_BATCH ? (options.keys - i) : BENCHMARK_STREAM_BATCH;
+        ena_exposure_check_temporary_exposure_keys(&keys[i], batch);
+    }
+    size_t single_core_matches = ena_exposure_check_stream_end(false);
+    benchmark_report("stream 1 core", options.keys, &measure);
+    ena_exposure_helper_enable(true);
+
+    benchmark_start(&measure);
+    ena_exposure_summary(ena_exposure_default_config());
+    benchmark_report("summary", 1, &measure);
+
+    // score random exposure parameters, like a replay of many exposure information
+    ena_exposure_parameter_t *risk_params = calloc(BENCHMARK_RISK_PARAMS, sizeof(ena_exposure_parameter_t));
+    for (size_t i = 0; i < BENCHMARK_RISK_PARAMS; i++)
+    {
+        risk_params[i].report_type = rand() % 8;
+        risk_params[i].days = rand() % 20;
+        risk_params[i].duration = rand() % 90 - 5;
+        risk_params[i].attenuation = rand() % 140 - 40;
+    }
+    ena_exposure_config_t *config = ena_exposure_default_config();
+    int risk_score_sum = 0;
+    benchmark_start(&measure);
+    for (size_t round = 0; round < BENCHMARK_RISK_ROUNDS; round++)
+    {
+        for (size_t i = 0; i < BENCHMARK_RISK_PARAMS; i++)
+        {
+            risk_score_sum += ena_exposure_risk_score(config, risk_params[i]);
+        }
+    }
+    benchmark_report("risk score", BENCHMARK_RISK_PARAMS * BENCHMARK_RISK_ROUNDS, &measure);
+
+    // every score has to match the product of the single risk scores
+    size_t risk_mismatches = 0;
+    for (size_t i = 0; i < BENCHMARK_RISK_PARAMS; i++)
+    {
+        int score = ena_exposure_transmission_risk_score(config, risk_params[i]) *
+                    ena_exposure_duration_risk_score(config, risk_params[i]) *
+                    ena_exposure_days_risk_score(config, risk_params[i]) *
+                    ena_exposure_attenuation_risk_score(config, risk_params[i]);
+        risk_mismatches += ena_exposure_risk_score(config, risk_params[i]) != (score > 255 ? 255 : score);
+    }
+    free(risk_params);
+
+    // expire the oldest days of beacons
+    uint32_t beacons_before = ena_storage_beacons_count();
+    benchmark_start(&measure);
+    ena_beacons_cleanup(now + 3 * BENCHMARK_DAY);
+    ena_storage_flush();
+    uint32_t removed = beacons_before - ena_storage_beacons_count();
+    benchmark_report("cleanup beacon", removed, &measure);
+
+    // metadata updates with a flush each, like the periodic write back on the device
+    benchmark_start(&measure);
+    for (size_t i = 0; i < BENCHMARK_META_FLUSHES; i++)
+    {
+        ena_storage_write_last_exposure_date(now + i);
+        ena_storage_flush();
+    }
+    benchmark_report("flush metadata", BENCHMARK_META_FLUSHES, &measure);
+
+    printf("\nmatched %u of %zu keys (%zu streamed, %zu on one core), %u of %zu beacons stored after cleanup\n",
+           exposures, options.matches, stream_matches, single_core_matches, ena_storage_beacons_count(), options.beacons + options.scans);
+
+    size_t max_sector_erases = 0;
+    for (size_t i = 0; i < HOST_PARTITION_SIZE / HOST_PARTITION_SECTOR_SIZE; i++)
+    {
+        if (host_partition_sector_erase_count(i) > max_sector_erases)
+        {
+            max_sector_erases = host_partition_sector_erase_count(i);
+        }
+    }
+    ena_storage_stats_t storage_stats;
+    ena_storage_stats(&storage_stats);
+    printf("max. erases of a single sector: %zu\n", max_sector_erases);
+    printf("storage erases: %u of %u sectors, max. %u (sector %u), metadata pool max. %u for %u commits in %u sectors, fixed max. %u, beacon log max. %u\n",
+           storage_stats.erases, storage_stats.sectors, storage_stats.erases_max, storage_stats.erases_max_sector,
+           storage_stats.meta_erases_max, storage_stats.meta_commits, storage_stats.meta_sectors, storage_stats.fixed_erases_max, storage_stats.log_erases_max);
+    printf("RPI backend: %s, RPIs differing from mbedTLS: %zu, test vectors %s\n",
+           host_crypto_backend_name(detected_backend), rpi_mismatches, test_vectors ? "passed" : "failed");
+    printf("Bloom filter: %u bytes for %u of %u beacons, %u hashes, est. false positive rate %.5f, %u of %u RPIs rejected, %.2f probes/lookup, %u builds\n",
+           bloom_stats.size, bloom_stats.beacons, bloom_stats.capacity, bloom_stats.hashes, bloom_stats.false_positive_rate,
+           bloom_stats.rejects, bloom_stats.lookups, bloom_stats.lookups > 0 ? (double)bloom_stats.probes / bloom_stats.lookups : 0, bloom_stats.rebuilds);
+    printf("risk scores: sum %d, differing from single risk scores: %zu\n", risk_score_sum, risk_mismatches);
+    printf("temporary beacons: %u of %u in %u slots, max. probe %u, %.2f probes/lookup\n",
+           temp_stats.count, temp_stats.capacity, temp_stats.table_size, temp_stats.max_probe,
+           temp_stats.lookups > 0 ? (double)temp_stats.probes / temp_stats.lookups : 0);
+
+    free(beacons);
+    free(keys);
+    host_partition_deinit();
+
+    return exposures == options.matches && stream_matches == options.matches && single_core_matches == options.matches && rpi_mismatches == 0 && test_vectors && risk_mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,496 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <string.h>
+
+#include "host-crypto.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <wmmintrin.h>
+#define HOST_CRYPTO_AESNI_AVAILABLE
+#endif
+
+#define HOST_CRYPTO_ROUNDS (10)        // rounds of AES-128
+#define HOST_CRYPTO_BLOCK_SIZE (16)    // AES block size, also RPI length
+#define HOST_CRYPTO_BITSLICE_LANES (64) // blocks encrypted at once by the bitsliced AES, one per bit of a word
+#define HOST_CRYPTO_AESNI_LANES (8)     // blocks interleaved by AES-NI to hide the latency of AESENC
+
+static bool backend_detected = false;
+static host_crypto_backend_t backend = HOST_CRYPTO_BITSLICE;
+
+// padded data of a RPI, ENIN is added in bytes 12 to 15
+static const uint8_t padded_prefix[HOST_CRYPTO_BLOCK_SIZE] = {'E', 'N', '-', 'R', 'P', 'I'};
+
+bool host_crypto_aesni_supported(void)
+{
+#ifdef HOST_CRYPTO_AESNI_AVAILABLE
+    unsigned int eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_AES);
+#else
+    return false;
+#endif
+}
+
+host_crypto_backend_t host_crypto_backend(void)
+{
+    if (!backend_detected)
+    {
+        backend = host_crypto_aesni_supported() ? HOST_CRYPTO_AESNI : HOST_CRYPTO_BITSLICE;
+        backend_detected = true;
+    }
+    return backend;
+}
+
+bool host_crypto_backend_select(host_crypto_backend_t selected)
+{
+    if (selected == HOST_CRYPTO_AESNI && !host_crypto_aesni_supported())
+    {
+        return false;
+    }
+    backend = selected;
+    backend_detected = true;
+    return true;
+}
+
+const char *host_crypto_backend_name(host_crypto_backend_t selected)
+{
+    return selected == HOST_CRYPTO_AESNI ? "AES-NI" : "bitslice";
+}
+
+/**
+ * @brief bitsliced AES S-box on 8 words, q[0] holds the least significant bit of every lane
+ *
+ * Circuit of Boyar and Peralta, "A new combinational logic minimization technique with applications to cryptology",
+ * https://eprint.iacr.org/2009/191.pdf. Inputs x and outputs s are numbered from the most significant bit.
+ */
+void host_crypto_bitslice_sbox(uint64_t *q)
+{
+    uint64_t x0, x1, x2, x3, x4, x5, x6, x7;
+    uint64_t y1, y2, y3, y4, y5, y6, y7, y8, y9, y10, y11, y12, y13, y14, y15, y16, y17, y18, y19, y20, y21;
+    uint64_t z0, z1, z2, z3, z4, z5, z6, z7, z8, z9, z10, z11, z12, z13, z14, z15, z16, z17;
+    uint64_t t0, t1, t2, t3, t4, t5, t6, t7, t8, t9, t10, t11, t12, t13, t14, t15, t16, t17, t18, t19;
+    uint64_t t20, t21, t22, t23, t24, t25, t26, t27, t28, t29, t30, t31, t32, t33, t34, t35, t36, t37, t38, t39;
+    uint64_t t40, t41, t42, t43, t44, t45, t46, t47, t48, t49, t50, t51, t52, t53, t54, t55, t56, t57, t58, t59;
+    uint64_t t60, t61, t62, t63, t64, t65, t66, t67;
+    uint64_t s0, s1, s2, s3, s4, s5, s6, s7;
+
+    x0 = q[7];
+    x1 = q[6];
+    x2 = q[5];
+    x3 = q[4];
+    x4 = q[3];
+    x5 = q[2];
+    x6 = q[1];
+    x7 = q[0];
+
+    // top linear transformation
+    y14 = x3 ^ x5;
+    y13 = x0 ^ x6;
+    y9 = x0 ^ x3;
+    y8 = x0 ^ x5;
+    t0 = x1 ^ x2;
+    y1 = t0 ^ x7;
+    y4 = y1 ^ x3;
+    y12 = y13 ^ y14;
+    y2 = y1 ^ x0;
+    y5 = y1 ^ x6;
+    y3 = y5 ^ y8;
+    t1 = x4 ^ y12;
+    y15 = t1 ^ x5;
+    y20 = t1 ^ x1;
+    y6 = y15 ^ x7;
+    y10 = y15 ^ t0;
+    y11 = y20 ^ y9;
+    y7 = x7 ^ y11;
+    y17 = y10 ^ y11;
+    y19 = y10 ^ y8;
+    y16 = t0 ^ y11;
+    y21 = y13 ^ y16;
+    y18 = x0 ^ y16;
+
+    // non-linear section
+    t2 = y12 & y15;
+    t3 = y3 & y6;
+    t4 = t3 ^ t2;
+    t5 = y4 & x7;
+    t6 = t5 ^ t2;
+    t7 = y13 & y16;
+    t8 = y5 & y1;
+    t9 = t8 ^ t7;
+    t10 = y2 & y7;
+    t11 = t10 ^ t7;
+    t12 = y9 & y11;
+    t13 = y14 & y17;
+    t14 = t13 ^ t12;
+    t15 = y8 & y10;
+    t16 = t15 ^ t12;
+    t17 = t4 ^ t14;
+    t18 = t6 ^ t16;
+    t19 = t9 ^ t14;
+    t20 = t11 ^ t16;
+    t21 = t17 ^ y20;
+    t22 = t18 ^ y19;
+    t23 = t19 ^ y21;
+    t24 = t20 ^ y18;
+
+    t25 = t21 ^ t22;
+    t26 = t21 & t23;
+    t27 = t24 ^ t26;
+    t28 = t25 & t27;
+    t29 = t28 ^ t22;
+    t30 = t23 ^ t24;
+    t31 = t22 ^ t26;
+    t32 = t31 & t30;
+    t33 = t32 ^ t24;
+    t34 = t23 ^ t33;
+    t35 = t27 ^ t33;
+    t36 = t24 & t35;
+    t37 = t36 ^ t34;
+    t38 = t27 ^ t36;
+    t39 = t29 & t38;
+    t40 = t25 ^ t39;
+
+    t41 = t40 ^ t37;
+    t42 = t29 ^ t33;
+    t43 = t29 ^ t40;
+    t44 = t33 ^ t37;
+    t45 = t42 ^ t41;
+    z0 = t44 & y15;
+    z1 = t37 & y6;
+    z2 = t33 & x7;
+    z3 = t43 & y16;
+    z4 = t40 & y1;
+    z5 = t29 & y7;
+    z6 = t42 & y11;
+    z7 = t45 & y17;
+    z8 = t41 & y10;
+    z9 = t44 & y12;
+    z10 = t37 & y3;
+    z11 = t33 & y4;
+    z12 = t43 & y13;
+    z13 = t40 & y5;
+    z14 = t29 & y2;
+    z15 = t42 & y9;
+    z16 = t45 & y14;
+    z17 = t41 & y8;
+
+    // bottom linear transformation
+    t46 = z15 ^ z16;
+    t47 = z10 ^ z11;
+    t48 = z5 ^ z13;
+    t49 = z9 ^ z10;
+    t50 = z2 ^ z12;
+    t51 = z2 ^ z5;
+    t52 = z7 ^ z8;
+    t53 = z0 ^ z3;
+    t54 = z6 ^ z7;
+    t55 = z16 ^ z17;
+    t56 = z12 ^ t48;
+    t57 = t50 ^ t53;
+    t58 = z4 ^ t46;
+    t59 = z3 ^ t54;
+    t60 = t46 ^ t57;
+    t61 = z14 ^ t57;
+    t62 = t52 ^ t58;
+    t63 = t49 ^ t58;
+    t64 = z4 ^ t59;
+    t65 = t61 ^ t62;
+    t66 = z1 ^ t63;
+    s0 = t59 ^ t63;
+    s6 = t56 ^ ~t62;
+    s7 = t48 ^ ~t60;
+    t67 = t64 ^ t65;
+    s3 = t53 ^ t66;
+    s4 = t51 ^ t66;
+    s5 = t47 ^ t65;
+    s1 = t64 ^ ~s3;
+    s2 = t55 ^ ~t67;
+
+    q[7] = s0;
+    q[6] = s1;
+    q[5] = s2;
+    q[4] = s3;
+    q[3] = s4;
+    q[2] = s5;
+    q[1] = s6;
+    q[0] = s7;
+}
+
+/**
+ * @brief S-box of the 4 bytes of a key schedule word, by the bitsliced circuit to avoid secret dependent lookups
+ */
+void host_crypto_sub_word(uint8_t *word)
+{
+    uint64_t q[8] = {0};
+    for (int k = 0; k < 8; k++)
+    {
+        for (int lane = 0; lane < 4; lane++)
+        {
+            q[k] |= (uint64_t)((word[lane] >> k) & 1) << lane;
+        }
+    }
+    host_crypto_bitslice_sbox(q);
+    for (int lane = 0; lane < 4; lane++)
+    {
+        word[lane] = 0;
+        for (int k = 0; k < 8; k++)
+        {
+            word[lane] |= ((q[k] >> lane) & 1) << k;
+        }
+    }
+}
+
+/**
+ * @brief AES-128 key expansion to the round keys in byte order, as used by both backends
+ */
+void host_crypto_expand_key(const uint8_t *key, uint8_t *round_keys)
+{
+    uint8_t rcon = 0x01;
+    memcpy(round_keys, key, HOST_CRYPTO_BLOCK_SIZE);
+    for (int i = 4; i < 4 * (HOST_CRYPTO_ROUNDS + 1); i++)
+    {
+        uint8_t word[4];
+        memcpy(word, &round_keys[(i - 1) * 4], sizeof(word));
+        if (i % 4 == 0)
+        {
+            // RotWord, SubWord and round constant
+            uint8_t first = word[0];
+            word[0] = word[1];
+            word[1] = word[2];
+            word[2] = word[3];
+            word[3] = first;
+            host_crypto_sub_word(word);
+            word[0] ^= rcon;
+            rcon = (rcon << 1) ^ ((rcon >> 7) * 0x1b);
+        }
+        for (int j = 0; j < 4; j++)
+        {
+            round_keys[i * 4 + j] = round_keys[(i - 4) * 4 + j] ^ word[j];
+        }
+    }
+}
+
+/**
+ * @brief add a round key to a bitsliced state, the key is the same for all lanes
+ *
+ * The state holds bit k of byte p of every lane in state[p * 8 + k].
+ */
+void host_crypto_bitslice_add_round_key(uint64_t *state, const uint8_t *round_key)
+{
+    for (int p = 0; p < HOST_CRYPTO_BLOCK_SIZE; p++)
+    {
+        for (int k = 0; k < 8; k++)
+        {
+            state[p * 8 + k] ^= -(uint64_t)((round_key[p] >> k) & 1);
+        }
+    }
+}
+
+void host_crypto_bitslice_sub_bytes(uint64_t *state)
+{
+    for (int p = 0; p < HOST_CRYPTO_BLOCK_SIZE; p++)
+    {
+        host_crypto_bitslice_sbox(&state[p * 8]);
+    }
+}
+
+void host_crypto_bitslice_shift_rows(uint64_t *state)
+{
+    uint64_t shifted[HOST_CRYPTO_BLOCK_SIZE * 8];
+    for (int row = 0; row < 4; row++)
+    {
+        for (int column = 0; column < 4; column++)
+        {
+            memcpy(&shifted[(row + 4 * column) * 8], &state[(row + 4 * ((column + row) % 4)) * 8], 8 * sizeof(uint64_t));
+        }
+    }
+    memcpy(state, shifted, sizeof(shifted));
+}
+
+/**
+ * @brief multiply a bitsliced byte by x in GF(2^8)
+ */
+void host_crypto_bitslice_xtime(const uint64_t *in, uint64_t *out)
+{
+    uint64_t high = in[7];
+    out[7] = in[6];
+    out[6] = in[5];
+    out[5] = in[4];
+    out[4] = in[3] ^ high;
+    out[3] = in[2] ^ high;
+    out[2] = in[1];
+    out[1] = in[0] ^ high;
+    out[0] = high;
+}
+
+void host_crypto_bitslice_mix_columns(uint64_t *state)
+{
+    for (int column = 0; column < 4; column++)
+    {
+        uint64_t *a = &state[column * 4 * 8];
+        uint64_t sum[8], mixed[4 * 8];
+        for (int k = 0; k < 8; k++)
+        {
+            sum[k] = a[k] ^ a[8 + k] ^ a[16 + k] ^ a[24 + k];
+        }
+        // b_i = a_i ^ (a_0 ^ a_1 ^ a_2 ^ a_3) ^ 2 * (a_i ^ a_i+1)
+        for (int i = 0; i < 4; i++)
+        {
+            uint64_t pair[8], doubled[8];
+            for (int k = 0; k < 8; k++)
+            {
+                pair[k] = a[i * 8 + k] ^ a[((i + 1) % 4) * 8 + k];
+            }
+            host_crypto_bitslice_xtime(pair, doubled);
+            for (int k = 0; k < 8; k++)
+            {
+                mixed[i * 8 + k] = a[i * 8 + k] ^ sum[k] ^ doubled[k];
+            }
+        }
+        memcpy(a, mixed, sizeof(mixed));
+    }
+}
+
+/**
+ * @brief transpose a 8x8 bit matrix, bit c of byte r moves to bit r of byte c
+ */
+uint64_t host_crypto_transpose8(uint64_t matrix)
+{
+    uint64_t t;
+    t = (matrix ^ (matrix >> 7)) & 0x00AA00AA00AA00AAULL;
+    matrix ^= t ^ (t << 7);
+    t = (matrix ^ (matrix >> 14)) & 0x0000CCCC0000CCCCULL;
+    matrix ^= t ^ (t << 14);
+    t = (matrix ^ (matrix >> 28)) & 0x00000000F0F0F0F0ULL;
+    matrix ^= t ^ (t << 28);
+    return matrix;
+}
+
+/**
+ * @brief encrypt up to 64 RPI blocks with the bitsliced AES
+ */
+void host_crypto_bitslice_rpi_lanes(const uint8_t *round_keys, uint32_t enin_start, size_t lanes, uint8_t *rpis)
+{
+    uint64_t state[HOST_CRYPTO_BLOCK_SIZE * 8];
+
+    // bytes 0 to 11 are the same for all lanes, ENIN in bytes 12 to 15 differs
+    for (int p = 0; p < 12; p++)
+    {
+        for (int k = 0; k < 8; k++)
+        {
+            state[p * 8 + k] = -(uint64_t)((padded_prefix[p] >> k) & 1);
+        }
+    }
+    memset(&state[12 * 8], 0, 4 * 8 * sizeof(uint64_t));
+    for (size_t lane = 0; lane < lanes; lane++)
+    {
+        uint32_t enin = enin_start + lane;
+        for (int bit = 0; bit < 32; bit++)
+        {
+            state[12 * 8 + bit] |= (uint64_t)((enin >> bit) & 1) << lane;
+        }
+    }
+
+    host_crypto_bitslice_add_round_key(state, round_keys);
+    for (int round = 1; round < HOST_CRYPTO_ROUNDS; round++)
+    {
+        host_crypto_bitslice_sub_bytes(state);
+        host_crypto_bitslice_shift_rows(state);
+        host_crypto_bitslice_mix_columns(state);
+        host_crypto_bitslice_add_round_key(state, &round_keys[round * HOST_CRYPTO_BLOCK_SIZE]);
+    }
+    host_crypto_bitslice_sub_bytes(state);
+    host_crypto_bitslice_shift_rows(state);
+    host_crypto_bitslice_add_round_key(state, &round_keys[HOST_CRYPTO_ROUNDS * HOST_CRYPTO_BLOCK_SIZE]);
+
+    // 8 lanes of a byte position at once, byte k of the matrix holds bit k of the lanes
+    for (size_t group = 0; group * 8 < lanes; group++)
+    {
+        for (int p = 0; p < HOST_CRYPTO_BLOCK_SIZE; p++)
+        {
+            uint64_t matrix = 0;
+            for (int k = 0; k < 8; k++)
+            {
+                matrix |= ((state[p * 8 + k] >> (group * 8)) & 0xff) << (k * 8);
+            }
+            matrix = host_crypto_transpose8(matrix);
+            for (size_t lane = group * 8; lane < lanes && lane < group * 8 + 8; lane++)
+            {
+                rpis[lane * HOST_CRYPTO_BLOCK_SIZE + p] = (uint8_t)(matrix >> ((lane - group * 8) * 8));
+            }
+        }
+    }
+}
+
+#ifdef HOST_CRYPTO_AESNI_AVAILABLE
+/**
+ * @brief encrypt RPI blocks with AES-NI, the round keys in byte order are the ones AESENC expects
+ */
+__attribute__((target("aes,sse2"))) void host_crypto_aesni_rpi_range(const uint8_t *round_keys, uint32_t enin_start, size_t count, uint8_t *rpis)
+{
+    __m128i keys[HOST_CRYPTO_ROUNDS + 1];
+    for (int round = 0; round <= HOST_CRYPTO_ROUNDS; round++)
+    {
+        keys[round] = _mm_loadu_si128((const __m128i *)&round_keys[round * HOST_CRYPTO_BLOCK_SIZE]);
+    }
+    // ENIN is little endian in bytes 12 to 15, the last 32 bit lane
+    __m128i prefix = _mm_loadu_si128((const __m128i *)padded_prefix);
+
+    size_t i = 0;
+    while (i < count)
+    {
+        size_t lanes = (count - i) < HOST_CRYPTO_AESNI_LANES ? (count - i) : HOST_CRYPTO_AESNI_LANES;
+        __m128i blocks[HOST_CRYPTO_AESNI_LANES];
+        for (size_t lane = 0; lane < lanes; lane++)
+        {
+            blocks[lane] = _mm_xor_si128(_mm_or_si128(prefix, _mm_set_epi32((int)(enin_start + i + lane), 0, 0, 0)), keys[0]);
+        }
+        for (int round = 1; round < HOST_CRYPTO_ROUNDS; round++)
+        {
+            for (size_t lane = 0; lane < lanes; lane++)
+            {
+                blocks[lane] = _mm_aesenc_si128(blocks[lane], keys[round]);
+            }
+        }
+        for (size_t lane = 0; lane < lanes; lane++)
+        {
+            blocks[lane] = _mm_aesenclast_si128(blocks[lane], keys[HOST_CRYPTO_ROUNDS]);
+            _mm_storeu_si128((__m128i *)&rpis[(i + lane) * HOST_CRYPTO_BLOCK_SIZE], blocks[lane]);
+        }
+        i += lanes;
+    }
+}
+#endif
+
+void host_crypto_rpi_range(const uint8_t *rpik, uint32_t enin_start, size_t count, uint8_t *rpis)
+{
+    uint8_t round_keys[(HOST_CRYPTO_ROUNDS + 1) * HOST_CRYPTO_BLOCK_SIZE];
+    host_crypto_expand_key(rpik, round_keys);
+
+#ifdef HOST_CRYPTO_AESNI_AVAILABLE
+    if (host_crypto_backend() == HOST_CRYPTO_AESNI)
+    {
+        host_crypto_aesni_rpi_range(round_keys, enin_start, count, rpis);
+        memset(round_keys, 0, sizeof(round_keys));
+        return;
+    }
+#endif
+
+    for (size_t i = 0; i < count; i += HOST_CRYPTO_BITSLICE_LANES)
+    {
+        size_t lanes = (count - i) < HOST_CRYPTO_BITSLICE_LANES ? (count - i) : HOST_CRYPTO_BITSLICE_LANES;
+        host_crypto_bitslice_rpi_lanes(round_keys, enin_start + i, lanes, &rpis[i * HOST_CRYPTO_BLOCK_SIZE]);
+    }
+    memset(round_keys, 0, sizeof(round_keys));
+}
@@ -0,0 +1,158 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <string.h>
+
+#include "display.h"
+#include "display-framebuffer.h"
+
+#include "host-display.h"
+
+#define HOST_DISPLAY_WINDOW_TRANSACTIONS (5) // column set, address, row set, address, memory write
+#define HOST_DISPLAY_WINDOW_BYTES (11)       // 3 commands and 2 addresses of 4 bytes
+#define HOST_DISPLAY_QUEUE_SIZE (7)          // transactions queued like the SPI device of the drivers
+
+/**
+ * @brief queued transaction, either an address window or pixel data
+ */
+typedef struct
+{
+    uint8_t *data;
+    size_t length;
+    uint16_t x1, y1, x2, y2;
+} host_display_transaction_t;
+
+static uint16_t panel[HOST_DISPLAY_WIDTH * HOST_DISPLAY_HEIGHT];
+static host_display_stats_t panel_stats;
+
+static host_display_transaction_t queue[HOST_DISPLAY_QUEUE_SIZE];
+static size_t queue_start = 0;
+static size_t queue_count = 0;
+static size_t queue_data = 0;
+
+static uint16_t window_x1, window_y1, window_x2, window_y2;
+static uint16_t cursor_x, cursor_y;
+static int pending_byte = -1;
+
+void display_start(void)
+{
+    memset(panel, 0, sizeof(panel));
+    memset(&panel_stats, 0, sizeof(panel_stats));
+    display_framebuffer_start(HOST_DISPLAY_WIDTH, HOST_DISPLAY_HEIGHT, HOST_DISPLAY_INTERFACE_OFFSETX, HOST_DISPLAY_INTERFACE_OFFSETY);
+}
+
+void display_on(bool on)
+{
+}
+
+void display_flipped(bool flipped)
+{
+    panel_stats.transactions += 2;
+    panel_stats.bytes += 2;
+    display_framebuffer_invalidate();
+}
+
+/**
+ * @brief finish the oldest queued transaction, pixel data is read from the buffer only now like DMA would
+ */
+void host_display_complete(void)
+{
+    host_display_transaction_t *transaction = &queue[queue_start];
+    queue_start = (queue_start + 1) % HOST_DISPLAY_QUEUE_SIZE;
+    queue_count--;
+
+    if (transaction->data == NULL)
+    {
+        window_x1 = transaction->x1;
+        window_y1 = transaction->y1;
+        window_x2 = transaction->x2;
+        window_y2 = transaction->y2;
+        cursor_x = window_x1;
+        cursor_y = window_y1;
+        pending_byte = -1;
+        return;
+    }
+
+    queue_data--;
+    // like the controller, write pixels row by row into the window and wrap around at its end
+    for (size_t i = 0; i < transaction->length; i++)
+    {
+        if (pending_byte < 0)
+        {
+            pending_byte = transaction->data[i];
+            continue;
+        }
+        if (cursor_x < HOST_DISPLAY_WIDTH && cursor_y < HOST_DISPLAY_HEIGHT)
+        {
+            panel[cursor_y * HOST_DISPLAY_WIDTH + cursor_x] = (uint16_t)(pending_byte << 8) | transaction->data[i];
+        }
+        pending_byte = -1;
+        if (++cursor_x > window_x2)
+        {
+            cursor_x = window_x1;
+            if (++cursor_y > window_y2)
+            {
+                cursor_y = window_y1;
+            }
+        }
+    }
+}
+
+void host_display_queue(host_display_transaction_t *transaction)
+{
+    if (queue_count == HOST_DISPLAY_QUEUE_SIZE)
+    {
+        host_display_complete();
+    }
+    queue[(queue_start + queue_count) % HOST_DISPLAY_QUEUE_SIZE] = *transaction;
+    queue_count++;
+}
+
+void display_panel_window(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2)
+{
+    panel_stats.transactions += HOST_DISPLAY_WINDOW_TRANSACTIONS;
+    panel_stats.bytes += HOST_DISPLAY_WINDOW_BYTES;
+    panel_stats.windows++;
+
+    host_display_transaction_t transaction = {NULL, 0, x1, y1, x2, y2};
+    host_display_queue(&transaction);
+}
+
+void display_panel_data(uint8_t *data, size_t length)
+{
+    panel_stats.transactions++;
+    panel_stats.bytes += length;
+
+    host_display_transaction_t transaction = {data, length, 0, 0, 0, 0};
+    host_display_queue(&transaction);
+    queue_data++;
+}
+
+void display_panel_wait(size_t pending)
+{
+    while (queue_data > pending)
+    {
+        host_display_complete();
+    }
+}
+
+void host_display_stats(host_display_stats_t *stats)
+{
+    *stats = panel_stats;
+}
+
+uint16_t host_display_pixel(uint16_t x, uint16_t y)
+{
+    display_panel_wait(0);
+    return panel[y * HOST_DISPLAY_WIDTH + x];
+}
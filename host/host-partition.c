@@ -0,0 +1,191 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "esp_log.h"
+#include "esp_partition.h"
+
+#define HOST_PARTITION_LOG "host-partition" // TAG for Logging
+#define HOST_PARTITION_SECTORS (HOST_PARTITION_SIZE / HOST_PARTITION_SECTOR_SIZE)
+
+static const esp_partition_t host_partition = {
+    .type = ESP_PARTITION_TYPE_DATA,
+    .subtype = ESP_PARTITION_SUBTYPE_ANY,
+    .address = 0,
+    .size = HOST_PARTITION_SIZE,
+    .label = CONFIG_ENA_STORAGE_PARTITION_NAME,
+    .encrypted = false,
+};
+
+static uint8_t *host_partition_data = NULL;
+static int host_partition_fd = -1;
+static host_partition_stats_t host_partition_access_stats;
+static size_t host_partition_sector_erases[HOST_PARTITION_SECTORS];
+
+esp_err_t host_partition_init(const char *file)
+{
+    memset(&host_partition_access_stats, 0, sizeof(host_partition_stats_t));
+    memset(host_partition_sector_erases, 0, sizeof(host_partition_sector_erases));
+
+    if (file == NULL)
+    {
+        host_partition_data = malloc(HOST_PARTITION_SIZE);
+        if (host_partition_data == NULL)
+        {
+            ESP_LOGE(HOST_PARTITION_LOG, "Warning %s malloc low memory", __func__);
+            return ESP_ERR_NO_MEM;
+        }
+        // fresh flash is erased
+        memset(host_partition_data, 0xFF, HOST_PARTITION_SIZE);
+        return ESP_OK;
+    }
+
+    host_partition_fd = open(file, O_RDWR | O_CREAT, 0644);
+    if (host_partition_fd < 0)
+    {
+        ESP_LOGE(HOST_PARTITION_LOG, "cannot open %s", file);
+        return ESP_FAIL;
+    }
+
+    off_t file_size = lseek(host_partition_fd, 0, SEEK_END);
+    if (file_size != HOST_PARTITION_SIZE)
+    {
+        // new or mismatching file, initialize as erased flash
+        uint8_t erased[HOST_PARTITION_SECTOR_SIZE];
+        memset(erased, 0xFF, sizeof(erased));
+        if (ftruncate(host_partition_fd, 0) != 0 || lseek(host_partition_fd, 0, SEEK_SET) != 0)
+        {
+            close(host_partition_fd);
+            host_partition_fd = -1;
+            return ESP_FAIL;
+        }
+        for (int i = 0; i < HOST_PARTITION_SECTORS; i++)
+        {
+            if (write(host_partition_fd, erased, sizeof(erased)) != sizeof(erased))
+            {
+                close(host_partition_fd);
+                host_partition_fd = -1;
+                return ESP_FAIL;
+            }
+        }
+    }
+
+    host_partition_data = mmap(NULL, HOST_PARTITION_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, host_partition_fd, 0);
+    if (host_partition_data == MAP_FAILED)
+    {
+        host_partition_data = NULL;
+        close(host_partition_fd);
+        host_partition_fd = -1;
+        ESP_LOGE(HOST_PARTITION_LOG, "cannot map %s", file);
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+void host_partition_deinit(void)
+{
+    if (host_partition_data == NULL)
+    {
+        return;
+    }
+
+    if (host_partition_fd >= 0)
+    {
+        msync(host_partition_data, HOST_PARTITION_SIZE, MS_SYNC);
+        munmap(host_partition_data, HOST_PARTITION_SIZE);
+        close(host_partition_fd);
+        host_partition_fd = -1;
+    }
+    else
+    {
+        free(host_partition_data);
+    }
+    host_partition_data = NULL;
+}
+
+void host_partition_stats(host_partition_stats_t *stats)
+{
+    memcpy(stats, &host_partition_access_stats, sizeof(host_partition_stats_t));
+}
+
+size_t host_partition_sector_erase_count(size_t sector)
+{
+    if (sector >= HOST_PARTITION_SECTORS)
+    {
+        return 0;
+    }
+    return host_partition_sector_erases[sector];
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label)
+{
+    if (host_partition_data == NULL || type != host_partition.type || (label != NULL && strcmp(label, host_partition.label) != 0))
+    {
+        return NULL;
+    }
+    return &host_partition;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    if (partition != &host_partition || src_offset + size > partition->size)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(dst, host_partition_data + src_offset, size);
+    host_partition_access_stats.read_count++;
+    host_partition_access_stats.bytes_read += size;
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size)
+{
+    if (partition != &host_partition || dst_offset + size > partition->size)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    const uint8_t *bytes = src;
+    for (size_t i = 0; i < size; i++)
+    {
+        // NOR flash can only clear bits, writing to a not erased byte corrupts it like real flash would
+        host_partition_data[dst_offset + i] &= bytes[i];
+    }
+    host_partition_access_stats.write_count++;
+    host_partition_access_stats.bytes_written += size;
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    if (partition != &host_partition || offset + size > partition->size)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (offset % HOST_PARTITION_SECTOR_SIZE != 0 || size % HOST_PARTITION_SECTOR_SIZE != 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(host_partition_data + offset, 0xFF, size);
+    for (size_t sector = offset / HOST_PARTITION_SECTOR_SIZE; sector < (offset + size) / HOST_PARTITION_SECTOR_SIZE; sector++)
+    {
+        host_partition_sector_erases[sector]++;
+        host_partition_access_stats.erase_count++;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,316 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdlib.h>
+#include <pthread.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_log.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+
+/**
+ * @brief semaphore on pthreads, mutexes are locked by owner, binary semaphores signal via condition
+ */
+struct host_semaphore
+{
+    bool binary;
+    bool available;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+/**
+ * @brief ring buffer of fixed size items, senders and receivers wait on one condition
+ */
+struct host_queue
+{
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t count;
+    UBaseType_t head;
+    uint8_t *items;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+/**
+ * @brief task on a detached pthread
+ */
+struct host_task
+{
+    pthread_t thread;
+    TaskFunction_t function;
+    void *parameters;
+};
+
+esp_log_level_t host_log_level = ESP_LOG_WARN;
+
+void esp_log_buffer_hex_host(const char *tag, const void *buffer, size_t buff_len)
+{
+    const uint8_t *bytes = buffer;
+    fprintf(stderr, "%s: ", tag);
+    for (size_t i = 0; i < buff_len; i++)
+    {
+        fprintf(stderr, "%02x ", bytes[i]);
+    }
+    fprintf(stderr, "\n");
+}
+
+uint32_t esp_random(void)
+{
+    return ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+}
+
+void esp_fill_random(void *buf, size_t len)
+{
+    uint8_t *bytes = buf;
+    for (size_t i = 0; i < len; i++)
+    {
+        bytes[i] = (uint8_t)rand();
+    }
+}
+
+size_t xPortGetFreeHeapSize(void)
+{
+    return 0;
+}
+
+void vTaskDelay(const TickType_t ticks)
+{
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    static struct timespec start = {0, 0};
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (start.tv_sec == 0 && start.tv_nsec == 0)
+    {
+        start = now;
+    }
+    return (TickType_t)((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000);
+}
+
+static void *host_task_run(void *arg)
+{
+    struct host_task *task = arg;
+    task->function(task->parameters);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, const uint32_t stack_depth, void *parameters,
+                                   UBaseType_t priority, TaskHandle_t *created_task, const BaseType_t core_id)
+{
+    struct host_task *task = calloc(1, sizeof(struct host_task));
+    if (task == NULL)
+    {
+        return pdFAIL;
+    }
+    task->function = function;
+    task->parameters = parameters;
+    if (pthread_create(&task->thread, NULL, host_task_run, task) != 0)
+    {
+        free(task);
+        return pdFAIL;
+    }
+    pthread_detach(task->thread);
+    if (created_task != NULL)
+    {
+        *created_task = task;
+    }
+    return pdPASS;
+}
+
+static void host_deadline(struct timespec *deadline, TickType_t ticks)
+{
+    clock_gettime(CLOCK_REALTIME, deadline);
+    deadline->tv_sec += ticks / 1000;
+    deadline->tv_nsec += (ticks % 1000) * 1000000L;
+    if (deadline->tv_nsec >= 1000000000L)
+    {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+/**
+ * @brief wait on condition until woken up or timed out, returns false on timeout
+ */
+static bool host_wait(pthread_cond_t *cond, pthread_mutex_t *mutex, TickType_t ticks, struct timespec *deadline)
+{
+    if (ticks == 0)
+    {
+        return false;
+    }
+    int ret = ticks == portMAX_DELAY ? pthread_cond_wait(cond, mutex) : pthread_cond_timedwait(cond, mutex, deadline);
+    return ret != ETIMEDOUT;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    QueueHandle_t queue = calloc(1, sizeof(struct host_queue));
+    if (queue == NULL)
+    {
+        return NULL;
+    }
+    queue->items = malloc(length * item_size);
+    if (queue->items == NULL)
+    {
+        free(queue);
+        return NULL;
+    }
+    queue->length = length;
+    queue->item_size = item_size;
+    pthread_mutex_init(&queue->mutex, NULL);
+    pthread_cond_init(&queue->cond, NULL);
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    struct timespec deadline;
+    host_deadline(&deadline, ticks);
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->count == queue->length)
+    {
+        if (!host_wait(&queue->cond, &queue->mutex, ticks, &deadline))
+        {
+            pthread_mutex_unlock(&queue->mutex);
+            return errQUEUE_FULL;
+        }
+    }
+    memcpy(&queue->items[((queue->head + queue->count) % queue->length) * queue->item_size], item, queue->item_size);
+    queue->count++;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->mutex);
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buffer, TickType_t ticks)
+{
+    struct timespec deadline;
+    host_deadline(&deadline, ticks);
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->count == 0)
+    {
+        if (!host_wait(&queue->cond, &queue->mutex, ticks, &deadline))
+        {
+            pthread_mutex_unlock(&queue->mutex);
+            return pdFALSE;
+        }
+    }
+    memcpy(buffer, &queue->items[queue->head * queue->item_size], queue->item_size);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->mutex);
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->mutex);
+    UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->mutex);
+    return count;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    pthread_cond_destroy(&queue->cond);
+    pthread_mutex_destroy(&queue->mutex);
+    free(queue->items);
+    free(queue);
+}
+
+static SemaphoreHandle_t host_semaphore_create(bool binary, int mutex_type)
+{
+    SemaphoreHandle_t semaphore = calloc(1, sizeof(struct host_semaphore));
+    if (semaphore == NULL)
+    {
+        return NULL;
+    }
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, mutex_type);
+    pthread_mutex_init(&semaphore->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    pthread_cond_init(&semaphore->cond, NULL);
+    semaphore->binary = binary;
+    return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return host_semaphore_create(false, PTHREAD_MUTEX_NORMAL);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void)
+{
+    return host_semaphore_create(false, PTHREAD_MUTEX_RECURSIVE);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return host_semaphore_create(true, PTHREAD_MUTEX_NORMAL);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks)
+{
+    if (!semaphore->binary)
+    {
+        return pthread_mutex_lock(&semaphore->mutex) == 0 ? pdTRUE : pdFALSE;
+    }
+
+    struct timespec deadline;
+    host_deadline(&deadline, ticks);
+    pthread_mutex_lock(&semaphore->mutex);
+    while (!semaphore->available)
+    {
+        if (!host_wait(&semaphore->cond, &semaphore->mutex, ticks, &deadline))
+        {
+            break;
+        }
+    }
+    BaseType_t taken = semaphore->available ? pdTRUE : pdFALSE;
+    semaphore->available = false;
+    pthread_mutex_unlock(&semaphore->mutex);
+    return taken;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    if (!semaphore->binary)
+    {
+        return pthread_mutex_unlock(&semaphore->mutex) == 0 ? pdTRUE : pdFALSE;
+    }
+
+    pthread_mutex_lock(&semaphore->mutex);
+    semaphore->available = true;
+    pthread_cond_signal(&semaphore->cond);
+    pthread_mutex_unlock(&semaphore->mutex);
+    return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+    pthread_cond_destroy(&semaphore->cond);
+    pthread_mutex_destroy(&semaphore->mutex);
+    free(semaphore);
+}
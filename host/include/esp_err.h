@@ -0,0 +1,52 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * @file
+ * 
+ * @brief host stand-in for the ESP-IDF error codes
+ * 
+ */
+#ifndef _host_ESP_ERR_H_
+#define _host_ESP_ERR_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include "sdkconfig.h"
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_SIZE 0x104
+
+#define ESP_ERROR_CHECK(x)                                                                 \
+    do                                                                                     \
+    {                                                                                      \
+        esp_err_t __err_rc = (x);                                                          \
+        if (__err_rc != ESP_OK)                                                            \
+        {                                                                                  \
+            fprintf(stderr, "ESP_ERROR_CHECK failed: 0x%x at %s:%d\n", __err_rc, __FILE__, __LINE__); \
+            abort();                                                                       \
+        }                                                                                  \
+    } while (0)
+
+#define ESP_ERROR_CHECK_WITHOUT_ABORT(x) (x)
+
+#endif
@@ -0,0 +1,79 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * @file
+ * 
+ * @brief host stand-in for ESP-IDF logging, prints to stderr
+ * 
+ */
+#ifndef _host_ESP_LOG_H_
+#define _host_ESP_LOG_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "sdkconfig.h"
+#include "esp_err.h"
+
+typedef enum
+{
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+/**
+ * @brief current log level of the host build, ESP_LOG_WARN by default
+ */
+extern esp_log_level_t host_log_level;
+
+#define ESP_LOG_LEVEL(level, tag, format, ...)                          \
+    do                                                                  \
+    {                                                                   \
+        if (host_log_level >= level)                                    \
+        {                                                               \
+            fprintf(stderr, "%s: " format "\n", tag, ##__VA_ARGS__);    \
+        }                                                               \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+
+#define ESP_LOG_BUFFER_HEX_LEVEL(tag, buffer, buff_len, level)                   \
+    do                                                                           \
+    {                                                                            \
+        if (host_log_level >= level)                                             \
+        {                                                                        \
+            esp_log_buffer_hex_host(tag, buffer, buff_len);                      \
+        }                                                                        \
+    } while (0)
+
+#define ESP_LOG_BUFFER_HEXDUMP(tag, buffer, buff_len, level) ESP_LOG_BUFFER_HEX_LEVEL(tag, buffer, buff_len, level)
+
+/**
+ * @brief print a buffer as hex to stderr
+ * 
+ * @param[in] tag       TAG for logging
+ * @param[in] buffer    the buffer to print
+ * @param[in] buff_len  length of the buffer
+ */
+void esp_log_buffer_hex_host(const char *tag, const void *buffer, size_t buff_len);
+
+#endif
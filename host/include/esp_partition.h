@@ -0,0 +1,108 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * @file
+ * 
+ * @brief host stand-in for the ESP-IDF partition API
+ * 
+ * The simulated partition behaves like NOR flash: erasing sets a sector to 0xFF and writing can only clear bits.
+ * All accesses are counted, see host_partition_stats().
+ * 
+ */
+#ifndef _host_ESP_PARTITION_H_
+#define _host_ESP_PARTITION_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+#define HOST_PARTITION_SECTOR_SIZE (4096) // erase granularity of the simulated flash
+#define HOST_PARTITION_SIZE (0x261000)    // size of the ena partition, see partitions.csv
+
+typedef enum
+{
+    ESP_PARTITION_TYPE_APP = 0x00,
+    ESP_PARTITION_TYPE_DATA = 0x01,
+} esp_partition_type_t;
+
+typedef enum
+{
+    ESP_PARTITION_SUBTYPE_ANY = 0xff,
+} esp_partition_subtype_t;
+
+typedef struct
+{
+    esp_partition_type_t type;
+    esp_partition_subtype_t subtype;
+    uint32_t address;
+    uint32_t size;
+    char label[17];
+    bool encrypted;
+} esp_partition_t;
+
+/**
+ * @brief statistics of accesses to the simulated partition
+ */
+typedef struct
+{
+    size_t read_count;    // number of read operations
+    size_t bytes_read;    // number of bytes read
+    size_t write_count;   // number of write operations
+    size_t bytes_written; // number of bytes written
+    size_t erase_count;   // number of erased sectors
+} host_partition_stats_t;
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label);
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size);
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size);
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size);
+
+/**
+ * @brief initialize the simulated partition
+ * 
+ * @param[in] file  file to back the partition with, NULL for a RAM only partition
+ * 
+ * @return
+ *          ESP_OK if the partition could be initialized
+ */
+esp_err_t host_partition_init(const char *file);
+
+/**
+ * @brief release the simulated partition, a file backed partition is synced to disk
+ */
+void host_partition_deinit(void);
+
+/**
+ * @brief get the current access statistics
+ * 
+ * @param[out] stats    pointer to write the statistics to
+ */
+void host_partition_stats(host_partition_stats_t *stats);
+
+/**
+ * @brief get number of erases of a single sector
+ * 
+ * @param[in] sector    the sector number
+ * 
+ * @return
+ *          number of erases of the sector since initialization
+ */
+size_t host_partition_sector_erase_count(size_t sector);
+
+#endif
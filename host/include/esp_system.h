@@ -0,0 +1,43 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * @file
+ * 
+ * @brief host stand-in for ESP-IDF system functions
+ * 
+ */
+#ifndef _host_ESP_SYSTEM_H_
+#define _host_ESP_SYSTEM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "esp_err.h"
+
+/**
+ * @brief get a random 32 bit word
+ */
+uint32_t esp_random(void);
+
+/**
+ * @brief fill buffer with random bytes
+ * 
+ * @param[out] buf  buffer to fill
+ * @param[in]  len  length of the buffer
+ */
+void esp_fill_random(void *buf, size_t len);
+
+#endif
@@ -0,0 +1,48 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * @file
+ * 
+ * @brief host stand-in for the FreeRTOS base definitions
+ * 
+ */
+#ifndef _host_FREERTOS_H_
+#define _host_FREERTOS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define portTICK_PERIOD_MS (1)
+#define portMAX_DELAY (0xffffffffUL)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define pdTRUE (1)
+#define pdFALSE (0)
+#define pdPASS (pdTRUE)
+#define pdFAIL (pdFALSE)
+#define errQUEUE_FULL (0)
+#define portNUM_PROCESSORS (2)
+#define tskNO_AFFINITY (0x7FFFFFFF)
+
+/**
+ * @brief free heap size, not tracked on host
+ */
+size_t xPortGetFreeHeapSize(void);
+
+#endif
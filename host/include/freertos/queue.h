@@ -0,0 +1,37 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * @file
+ * 
+ * @brief host stand-in for FreeRTOS queues, based on pthreads
+ * 
+ */
+#ifndef _host_FREERTOS_QUEUE_H_
+#define _host_FREERTOS_QUEUE_H_
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_queue *QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks);
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buffer, TickType_t ticks);
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+
+void vQueueDelete(QueueHandle_t queue);
+
+#endif
@@ -0,0 +1,42 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * @file
+ * 
+ * @brief host stand-in for FreeRTOS semaphores, based on pthreads
+ * 
+ */
+#ifndef _host_FREERTOS_SEMPHR_H_
+#define _host_FREERTOS_SEMPHR_H_
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_semaphore *SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void);
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks);
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+
+#define xSemaphoreTakeRecursive(semaphore, ticks) xSemaphoreTake(semaphore, ticks)
+#define xSemaphoreGiveRecursive(semaphore) xSemaphoreGive(semaphore)
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore);
+
+#endif
@@ -0,0 +1,47 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * @file
+ * 
+ * @brief host stand-in for FreeRTOS tasks
+ * 
+ */
+#ifndef _host_FREERTOS_TASK_H_
+#define _host_FREERTOS_TASK_H_
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+/**
+ * @brief delay is a no-op on host, storage and matching should be measured without artificial delays
+ */
+void vTaskDelay(const TickType_t ticks);
+
+/**
+ * @brief ticks of 1 ms since the first call
+ */
+TickType_t xTaskGetTickCount(void);
+
+/**
+ * @brief tasks run as detached pthreads, stack size, priority and core are ignored
+ */
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char *name, const uint32_t stack_depth, void *parameters,
+                                   UBaseType_t priority, TaskHandle_t *created_task, const BaseType_t core_id);
+
+#define xTaskCreate(task, name, stack_depth, parameters, priority, created_task) \
+    xTaskCreatePinnedToCore(task, name, stack_depth, parameters, priority, created_task, tskNO_AFFINITY)
+
+#endif
@@ -0,0 +1,78 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * @file
+ *
+ * @brief batch AES-128 for RPIs on the host build
+ *
+ * ena_crypto_rpi_range() of the host build encrypts many ENIN blocks per call instead of one mbedTLS block each.
+ * The backend is selected at runtime: AES-NI if the CPU supports it, otherwise a portable bitsliced AES which
+ * encrypts 64 blocks at once in constant time.
+ *
+ */
+#ifndef _host_CRYPTO_H_
+#define _host_CRYPTO_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief AES backends of the host build
+ */
+typedef enum
+{
+    HOST_CRYPTO_BITSLICE = 0, // portable bitsliced AES, 64 blocks at once
+    HOST_CRYPTO_AESNI,        // x86 AES-NI, 8 blocks interleaved
+} host_crypto_backend_t;
+
+/**
+ * @brief get the backend in use, detected on first use
+ *
+ * @return
+ *      backend used by host_crypto_rpi_range()
+ */
+host_crypto_backend_t host_crypto_backend(void);
+
+/**
+ * @brief select a backend, e.g. to benchmark the fallback
+ *
+ * @param[in] backend backend to use
+ *
+ * @return
+ *      false if the CPU does not support the backend, the backend in use is kept
+ */
+bool host_crypto_backend_select(host_crypto_backend_t backend);
+
+/**
+ * @brief get the name of a backend
+ *
+ * @param[in] backend backend to get the name of
+ *
+ * @return
+ *      name of the backend
+ */
+const char *host_crypto_backend_name(host_crypto_backend_t backend);
+
+/**
+ * @brief encrypt the RPI blocks of consecutive ENINs with a RPIK
+ *
+ * @param[in] rpik RPIK to encrypt with
+ * @param[in] enin_start ENIN of the first RPI
+ * @param[in] count number of RPIs
+ * @param[out] rpis pointer to count * ENA_KEY_LENGTH bytes for the RPIs
+ */
+void host_crypto_rpi_range(const uint8_t *rpik, uint32_t enin_start, size_t count, uint8_t *rpis);
+
+#endif
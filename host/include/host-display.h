@@ -0,0 +1,62 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * @file
+ * 
+ * @brief host mock of a TFT panel behind the display framebuffer
+ * 
+ * The mock keeps the panel memory in RAM and counts SPI transactions and bytes like the ST7735/ST7789 drivers would
+ * send them, see host_display_stats(). Transactions are queued and pixel data is read from its buffer only when the
+ * transaction completes, so buffers reused too early show up as wrong pixels.
+ * 
+ */
+#ifndef _host_DISPLAY_H_
+#define _host_DISPLAY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HOST_DISPLAY_WIDTH (240)            // panel width of the M5StickC PLUS
+#define HOST_DISPLAY_HEIGHT (135)           // panel height of the M5StickC PLUS
+#define HOST_DISPLAY_INTERFACE_OFFSETX (56) // x position of the interface area
+#define HOST_DISPLAY_INTERFACE_OFFSETY (35) // y position of the interface area
+
+/**
+ * @brief statistics of the mock panel
+ */
+typedef struct
+{
+    size_t transactions; // number of SPI transactions, commands and data
+    size_t bytes;        // number of bytes sent
+    size_t windows;      // number of address windows set
+} host_display_stats_t;
+
+/**
+ * @brief get the current statistics
+ * 
+ * @param[out] stats    pointer to write the statistics to
+ */
+void host_display_stats(host_display_stats_t *stats);
+
+/**
+ * @brief get a pixel of the panel memory, after all queued transactions completed
+ * 
+ * @param[in] x column of the pixel
+ * @param[in] y row of the pixel
+ * 
+ * @return RGB565 color of the pixel
+ */
+uint16_t host_display_pixel(uint16_t x, uint16_t y);
+
+#endif
@@ -0,0 +1,49 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * @file
+ * 
+ * @brief static configuration for the host build, mirrors the defaults of Kconfig.projbuild
+ * 
+ */
+#ifndef _host_SDKCONFIG_H_
+#define _host_SDKCONFIG_H_
+
+// Exposure Notification API -> Storage
+#define CONFIG_ENA_STORAGE_TEK_MAX 14
+#define CONFIG_ENA_STORAGE_EXPOSURE_INFORMATION_MAX 500
+#define CONFIG_ENA_STORAGE_TEMP_BEACONS_MAX 1000
+#define CONFIG_ENA_STORAGE_START_ADDRESS 0
+#define CONFIG_ENA_STORAGE_PARTITION_NAME "ena"
+#define CONFIG_ENA_STORAGE_CACHE_BLOCKS 4
+#define CONFIG_ENA_STORAGE_META_SECTORS 8
+#define CONFIG_ENA_STORAGE_FLUSH_INTERVAL 60
+#define CONFIG_ENA_STORAGE_BLOOM_BITS_PER_BEACON 12
+#define CONFIG_ENA_STORAGE_BLOOM_HASHES 8
+#define CONFIG_ENA_STORAGE_BLOOM_MAX_SIZE 32768
+
+// Exposure Notification API -> Scanning
+#define CONFIG_ENA_BEACON_TRESHOLD 300
+#define CONFIG_ENA_BEACON_CLEANUP_TRESHOLD 14
+#define CONFIG_ENA_BEACONS_TEMP_RAM_ONLY 1
+#define CONFIG_ENA_BEACONS_TEMP_CHECKPOINT_INTERVAL 300
+#define CONFIG_ENA_SCANNING_TIME 30
+#define CONFIG_ENA_SCANNING_INTERVAL 300
+
+// Exposure Notification API -> Advertising
+#define CONFIG_ENA_BT_ROTATION_TIMEOUT_INTERVAL 900
+#define CONFIG_ENA_BT_RANDOMIZE_ROTATION_TIMEOUT_INTERVAL 150
+#define CONFIG_ENA_TEK_ROLLING_PERIOD 144
+
+#endif
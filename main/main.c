@@ -82,10 +82,6 @@ void app_main(void)
 
     wifi_controller_reconnect(NULL);
 
-    while (1)
-    {
-        ena_run();
-        ena_eke_proxy_run();
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
-    }
+    // download and check keys
+    ena_eke_proxy_start();
 }